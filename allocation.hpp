@@ -0,0 +1,244 @@
+#ifndef ALLOCATION_HPP
+#define ALLOCATION_HPP
+
+#include <memory_resource>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+namespace mdf {
+
+	/**
+	 * @struct AllocationReport
+	 * @brief Allocazioni dinamiche avvenute nel percorso critico delle
+	 * 			esecuzioni: avvio dell'istanza, esecuzione dei nodi e
+	 * 			trasferimento dei token.
+	 */
+	struct AllocationReport {
+		uint64_t _allocations{0};
+		uint64_t _bytes{0};
+
+		/**
+		 * @brief Vero se gli operatori new globali sono contati, vedi
+		 * 			MDF_ALLOCATION_HOOKS. Altrimenti vengono contate solo le
+		 * 			allocazioni che passano dalle risorse dell'Executor.
+		 */
+		bool	 _hooked{false};
+	};
+
+	/**
+	 * @struct AllocationTally
+	 * @brief Contatori globali delle allocazioni nel percorso critico
+	 */
+	struct AllocationTally {
+		std::atomic<uint64_t> _allocations{0};
+		std::atomic<uint64_t> _bytes{0};
+		std::atomic_bool	  _hooked{false};
+
+		/**
+		 * @brief Ritorna i contatori del processo. L'inizializzazione è
+		 * 			costante, quindi non alloca e può essere usata dagli
+		 * 			operatori new sostituiti.
+		 */
+		static AllocationTally& instance() {
+			static AllocationTally tally;
+			return tally;
+		}
+
+		AllocationReport read() const {
+			return AllocationReport{_allocations.load(std::memory_order_relaxed),
+				_bytes.load(std::memory_order_relaxed),
+				_hooked.load(std::memory_order_relaxed)};
+		}
+	};
+
+	inline bool& hot_path_slot() {
+		thread_local bool hot_path = false;
+		return hot_path;
+	}
+
+	/**
+	 * @brief Conta un'allocazione se il thread è nel percorso critico
+	 */
+	inline void record_allocation(size_t bytes) {
+		if (!hot_path_slot())
+			return;
+
+		AllocationTally& tally = AllocationTally::instance();
+		tally._allocations.fetch_add(1, std::memory_order_relaxed);
+		tally._bytes.fetch_add(bytes, std::memory_order_relaxed);
+	}
+
+	/**
+	 * @class HotPathScope
+	 * @brief Marca il thread come nel percorso critico per la durata dello
+	 * 			scope, o lo esclude con hot falso
+	 */
+	class HotPathScope {
+	public:
+
+		explicit HotPathScope(bool hot = true) :
+			_previous{hot_path_slot()}
+		{
+			hot_path_slot() = hot;
+		}
+
+		HotPathScope(const HotPathScope &) = delete;
+
+		~HotPathScope() {
+			hot_path_slot() = _previous;
+		}
+
+	private:
+
+		bool _previous;
+
+	};
+
+	/**
+	 * @class CountingResource
+	 * @brief Risorsa che inoltra le allocazioni alla risorsa a monte,
+	 * 			contando quelle avvenute nel percorso critico
+	 */
+	class CountingResource : public std::pmr::memory_resource {
+	public:
+
+		CountingResource(std::pmr::memory_resource* upstream) :
+			_upstream{upstream}
+		{}
+
+	private:
+
+		void* do_allocate(size_t bytes, size_t alignment) {
+			record_allocation(bytes);
+			
+			// già contata: gli operatori new sostituiti non la contano di nuovo
+			HotPathScope counted(false);
+			return _upstream -> allocate(bytes, alignment);
+		}
+
+		void do_deallocate(void* p, size_t bytes, size_t alignment) {
+			_upstream -> deallocate(p, bytes, alignment);
+		}
+
+		bool do_is_equal(const std::pmr::memory_resource& other) const noexcept {
+			return this == &other;
+		}
+
+		std::pmr::memory_resource* _upstream;
+
+	};
+
+	/**
+	 * @brief Risorsa dei token in modalità a regime: una pool sincronizzata
+	 * 			che, dopo il riscaldamento, ricicla i blocchi liberati senza
+	 * 			chiedere memoria al sistema. Non viene mai distrutta, così
+	 * 			che i token di output possano sopravvivere all'Executor.
+	 */
+	inline std::pmr::memory_resource* steady_state_resource() {
+		static CountingResource* upstream = new CountingResource(std::pmr::new_delete_resource());
+		static std::pmr::synchronized_pool_resource* pool = new std::pmr::synchronized_pool_resource(upstream);
+
+		return pool;
+	}
+
+}
+
+/*
+ * Definendo MDF_ALLOCATION_HOOKS in una sola unità di traduzione, tipicamente
+ * nelle build di debug, gli operatori new globali vengono sostituiti per
+ * contare anche le allocazioni che non passano dalle risorse dell'Executor.
+ */
+#if defined(MDF_ALLOCATION_HOOKS)
+
+namespace mdf {
+
+	struct AllocationHooks {
+		AllocationHooks() {
+			AllocationTally::instance()._hooked = true;
+		}
+	};
+
+	static AllocationHooks allocation_hooks;
+
+}
+
+/*
+ * Gli operatori non vengono espansi inline, così che il compilatore non
+ * confronti il free() interno con l'operator new del chiamante
+ */
+#define MDF_HOOK __attribute__((noinline))
+
+MDF_HOOK void* operator new(size_t size) {
+	mdf::record_allocation(size);
+
+	void* p = std::malloc(size != 0 ? size : 1);
+
+	if (p == nullptr)
+		throw std::bad_alloc();
+
+	return p;
+}
+
+MDF_HOOK void* operator new[](size_t size) {
+	return ::operator new(size);
+}
+
+/*
+ * Le forme allineate sono usate, tra le altre, da new_delete_resource e
+ * quindi dalle risorse di default dell'Executor
+ */
+MDF_HOOK void* operator new(size_t size, std::align_val_t alignment) {
+	mdf::record_allocation(size);
+
+	size_t align = static_cast<size_t>(alignment);
+	void* p = std::aligned_alloc(align, (size + align - 1) / align * align);
+
+	if (p == nullptr)
+		throw std::bad_alloc();
+
+	return p;
+}
+
+MDF_HOOK void* operator new[](size_t size, std::align_val_t alignment) {
+	return ::operator new(size, alignment);
+}
+
+MDF_HOOK void operator delete(void* p) noexcept {
+	std::free(p);
+}
+
+MDF_HOOK void operator delete(void* p, size_t) noexcept {
+	std::free(p);
+}
+
+MDF_HOOK void operator delete[](void* p) noexcept {
+	std::free(p);
+}
+
+MDF_HOOK void operator delete[](void* p, size_t) noexcept {
+	std::free(p);
+}
+
+MDF_HOOK void operator delete(void* p, std::align_val_t) noexcept {
+	std::free(p);
+}
+
+MDF_HOOK void operator delete(void* p, size_t, std::align_val_t) noexcept {
+	std::free(p);
+}
+
+MDF_HOOK void operator delete[](void* p, std::align_val_t) noexcept {
+	std::free(p);
+}
+
+MDF_HOOK void operator delete[](void* p, size_t, std::align_val_t) noexcept {
+	std::free(p);
+}
+
+#undef MDF_HOOK
+
+#endif
+
+#endif /* ALLOCATION_HPP */
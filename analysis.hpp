@@ -0,0 +1,364 @@
+#ifndef ANALYSIS_HPP
+#define ANALYSIS_HPP
+
+#include <vector>
+#include <queue>
+#include <string>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <functional>
+#include "graph.hpp"
+
+namespace mdf {
+
+	/**
+	 * @struct GraphReport
+	 * @brief Analisi statica di un grafo, vedi Mdf::analyze.
+	 * I costi sono in nanosecondi e riguardano l'esecuzione di una sola
+	 * istanza: con più istanze in volo il parallelismo disponibile è
+	 * limitato dal lavoro totale più che dal cammino critico.
+	 */
+	struct GraphReport {
+
+		size_t 				_nodes = 0;
+
+		size_t 				_edges = 0;
+
+		/**
+		 * @brief Numero di nodi per livello, dove il livello di un nodo è
+		 * 			la lunghezza del cammino più lungo da un nodo sorgente
+		 */
+		std::vector<size_t> _level_widths;
+
+		size_t 				_max_width = 0;
+
+		/**
+		 * @brief Il costo di ogni nodo usato dall'analisi
+		 */
+		std::vector<double> _costs;
+
+		/**
+		 * @brief Nodi senza costo annotato né misurato, a cui è stato
+		 * 			assegnato il costo medio degli altri
+		 */
+		size_t 				_unknown_costs = 0;
+
+		/**
+		 * @brief Somma dei costi dei nodi
+		 */
+		double 				_work = 0;
+
+		/**
+		 * @brief Costo del cammino critico
+		 */
+		double 				_span = 0;
+
+		/**
+		 * @brief I nodi del cammino critico, dall'input all'output
+		 */
+		std::vector<size_t> _critical_path;
+
+		/**
+		 * @brief Lo speedup stimato con i thread, all'indice thread - 1,
+		 * 			simulando uno scheduling a lista che privilegia i nodi
+		 * 			più lontani dalla fine del grafo
+		 */
+		std::vector<double> _speedup;
+
+		/**
+		 * @brief Il numero di thread oltre il quale lo speedup stimato
+		 * 			cresce meno del 5%
+		 */
+		size_t 				_recommended_threads = 1;
+
+		/**
+		 * @brief Ritorna il rapporto lavoro/cammino critico, lo speedup
+		 * 			massimo teorico di una singola istanza
+		 */
+		double parallelism() const {
+			return _span > 0 ? _work / _span : 1;
+		}
+
+		std::string to_string() const;
+
+	};
+
+	inline std::string GraphReport::to_string() const {
+		std::ostringstream out;
+
+		out << std::fixed << std::setprecision(2);
+		out << "nodi: " << _nodes << ", archi: " << _edges << "\n";
+		out << "livelli: " << _level_widths.size() << ", larghezza massima: " << _max_width << "\n";
+		out << "larghezza dei livelli:";
+
+		for(const size_t& width : _level_widths) {
+			out << " " << width;
+		}
+
+		out << "\nlavoro: " << _work / 1000 << " us, cammino critico: " << _span / 1000 << " us";
+		out << ", parallelismo: " << parallelism() << "\n";
+		out << "cammino critico:";
+
+		for(const size_t& id : _critical_path) {
+			out << " " << id;
+		}
+
+		if (_unknown_costs > 0)
+			out << "\nnodi di costo ignoto: " << _unknown_costs;
+
+		out << "\nthread consigliati: " << _recommended_threads;
+
+		if (_recommended_threads <= _speedup.size())
+			out << " (speedup stimato " << _speedup[_recommended_threads - 1] << ")";
+
+		out << "\n";
+
+		return out.str();
+	}
+
+	/**
+	 * @class GraphAnalysis
+	 * @brief Calcola il GraphReport di un grafo validato
+	 */
+	class GraphAnalysis {
+	public:
+
+		/**
+		 * @param max_threads il numero massimo di thread simulati
+		 */
+		static GraphReport analyze(const Graph& graph, size_t max_threads = 256);
+
+		/**
+		 * @brief Ritorna il costo di ogni nodo usato dall'analisi
+		 *
+		 * @param unknown il numero dei nodi di costo ignoto
+		 */
+		static std::vector<double> node_costs(const Graph& graph, size_t& unknown);
+
+		/**
+		 * @brief Ritorna per ogni nodo il costo del cammino più lungo dal
+		 * 			nodo, compreso, alla fine del grafo
+		 */
+		static std::vector<double> bottom_levels(const Graph& graph, const std::vector<double>& costs);
+		
+		/**
+		 * @brief Ritorna i nodi del cammino di costo massimo, dall'input
+		 * 			all'output
+		 */
+		static std::vector<size_t> critical_path(const Graph& graph, const std::vector<double>& costs);
+
+	private:
+
+		static double simulate(const Graph& graph, const std::vector<double>& costs,
+			const std::vector<double>& priority, size_t threads);
+
+	};
+
+	/**
+	 * @brief Il costo di un nodo è quello annotato con Mdf::set_cost o, in
+	 * 			mancanza, quello misurato dall'Executor. Ai nodi di split e
+	 * 			merge mai eseguiti viene assegnato costo nullo, agli altri
+	 * 			nodi di costo ignoto la media dei costi noti.
+	 */
+	inline std::vector<double> GraphAnalysis::node_costs(const Graph& graph, size_t& unknown) {
+		std::vector<double> costs(graph._nodes.size(), -1);
+		double known_total = 0;
+		size_t known = 0;
+
+		for(size_t id = 0; id < costs.size(); id++) {
+			const Node& node = *graph._nodes[id];
+			double cost = node._stats -> annotated_cost();
+
+			if (cost < 0)
+				cost = node._stats -> known() ? node._stats -> cost() :
+					node._stats -> _count.load(std::memory_order_relaxed) > 0 ? node._stats -> mean_ns() : -1;
+
+			if (cost < 0 && node._type != STANDARD)
+				cost = 0;
+
+			if (cost >= 0) {
+				known_total += cost;
+				known++;
+			}
+
+			costs[id] = cost;
+		}
+
+		double fallback = known > 0 ? known_total / known : 1;
+		unknown = 0;
+
+		for(double& cost : costs) {
+			if (cost < 0) {
+				cost = fallback;
+				unknown++;
+			}
+		}
+
+		return costs;
+	}
+
+	inline std::vector<double> GraphAnalysis::bottom_levels(const Graph& graph, const std::vector<double>& costs) {
+		std::vector<size_t> order = graph.topological_order();
+		std::vector<double> bottom(graph._nodes.size(), 0);
+
+		for(auto it = order.rbegin(); it != order.rend(); ++it) {
+			double longest = 0;
+
+			for(const size_t& next : *graph._nodes[*it] -> _successors) {
+				longest = std::max(longest, bottom[next]);
+			}
+
+			bottom[*it] = costs[*it] + longest;
+		}
+
+		return bottom;
+	}
+
+	inline GraphReport GraphAnalysis::analyze(const Graph& graph, size_t max_threads) {
+		GraphReport report;
+		std::vector<size_t> order = graph.topological_order();
+		size_t n = graph._nodes.size();
+
+		report._nodes = n;
+		report._costs = node_costs(graph, report._unknown_costs);
+
+		for(size_t id = 0; id < n; id++) {
+			report._edges += graph._nodes[id] -> _output_map -> size();
+			report._work  += report._costs[id];
+		}
+
+		std::vector<size_t> level(n, 0);
+		std::vector<double> bottom = bottom_levels(graph, report._costs);
+
+		for(const size_t& id : order) {
+			for(const size_t& next : *graph._nodes[id] -> _successors) {
+				level[next] = std::max(level[next], level[id] + 1);
+			}
+		}
+
+		for(const size_t& id : order) {
+			if (level[id] >= report._level_widths.size())
+				report._level_widths.resize(level[id] + 1, 0);
+
+			report._level_widths[level[id]]++;
+		}
+
+		report._max_width = report._level_widths.empty() ? 0 :
+			*std::max_element(report._level_widths.begin(), report._level_widths.end());
+
+		report._critical_path = critical_path(graph, report._costs);
+
+		for(const size_t& id : report._critical_path) {
+			report._span += report._costs[id];
+		}
+
+		size_t limit = std::max<size_t>(1, std::min(report._max_width, max_threads));
+
+		for(size_t threads = 1; threads <= limit; threads++) {
+			double makespan = simulate(graph, report._costs, bottom, threads);
+			report._speedup.push_back(makespan > 0 ? report._work / makespan : 1);
+		}
+
+		double best = *std::max_element(report._speedup.begin(), report._speedup.end());
+
+		while (report._recommended_threads < limit &&
+			report._speedup[report._recommended_threads - 1] * 1.05 < best) {
+			report._recommended_threads++;
+		}
+
+		return report;
+	}
+
+	inline std::vector<size_t> GraphAnalysis::critical_path(const Graph& graph, const std::vector<double>& costs) {
+		std::vector<size_t> order = graph.topological_order();
+		size_t n = graph._nodes.size();
+		std::vector<double> finish(n, 0);
+		std::vector<size_t> parent(n, n);
+		std::vector<size_t> path;
+
+		for(const size_t& id : order) {
+			finish[id] += costs[id];
+
+			for(const size_t& next : *graph._nodes[id] -> _successors) {
+				if (parent[next] == n || finish[id] > finish[next]) {
+					finish[next] = finish[id];
+					parent[next] = id;
+				}
+			}
+		}
+
+		if (order.empty())
+			return path;
+
+		size_t last = *std::max_element(order.begin(), order.end(), [&](size_t a, size_t b) {
+			return finish[a] < finish[b];
+		});
+
+		for(size_t id = last; id != n; id = parent[id]) {
+			path.push_back(id);
+		}
+
+		std::reverse(path.begin(), path.end());
+
+		return path;
+	}
+
+	/**
+	 * @brief Simula l'esecuzione di un'istanza con i thread dati, avviando
+	 * 			per primi i nodi pronti di priorità maggiore
+	 *
+	 * @return il tempo di completamento dell'istanza
+	 */
+	inline double GraphAnalysis::simulate(const Graph& graph, const std::vector<double>& costs,
+		const std::vector<double>& priority, size_t threads) {
+		using event_t = std::pair<double, size_t>;
+
+		size_t n = graph._nodes.size();
+		std::vector<size_t> missing(n, 0);
+		std::priority_queue<event_t> ready;
+		std::priority_queue<event_t, std::vector<event_t>, std::greater<event_t>> running;
+		double time = 0;
+		size_t idle = threads;
+
+		for(const auto& node : graph._nodes) {
+			for(const size_t& next : *node -> _successors) {
+				missing[next]++;
+			}
+		}
+
+		for(size_t id = 0; id < n; id++) {
+			if (missing[id] == 0)
+				ready.push({priority[id], id});
+		}
+
+		for(;;) {
+			while (idle > 0 && !ready.empty()) {
+				size_t id = ready.top().second;
+				ready.pop();
+
+				running.push({time + costs[id], id});
+				idle--;
+			}
+
+			if (running.empty())
+				return time;
+
+			time = running.top().first;
+
+			while (!running.empty() && running.top().first <= time) {
+				size_t id = running.top().second;
+				running.pop();
+				idle++;
+
+				for(const size_t& next : *graph._nodes[id] -> _successors) {
+					if (--missing[next] == 0)
+						ready.push({priority[next], next});
+				}
+			}
+		}
+	}
+
+}
+
+#endif /* ANALYSIS_HPP */
@@ -0,0 +1,177 @@
+/**
+ * Confronto dei dTLB miss di un grafo grande con le istanze allocate
+ * dalla risorsa di default e da una HugePageResource.
+ *
+ * Il grafo è un fan-out: il nodo di input viene replicato da uno split
+ * su N nodi, i cui risultati sono raccolti da un merge in ordine
+ * casuale, così che transfer_tokens acceda ai nodi dell'istanza in modo
+ * sparso.
+ *
+ * Compilazione, dalla radice del repository:
+ * 	g++ -std=c++17 -O2 -I. bench/hugepage_tlb.cpp -o hugepage_tlb -pthread
+ *
+ * Uso: ./hugepage_tlb [nodi] [esecuzioni]
+ * I contatori richiedono perf_event_open (kernel.perf_event_paranoid <= 2),
+ * altrimenti viene riportato solo il tempo.
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <numeric>
+#include "../executor.hpp"
+#include "../hugepage.hpp"
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+using namespace mdf;
+
+/**
+ * @brief Contatore dei dTLB miss in lettura di tutto il processo
+ */
+class TlbCounter {
+public:
+
+	TlbCounter() : _fd{-1} {
+#if defined(__linux__)
+		perf_event_attr attr;
+		memset(&attr, 0, sizeof(attr));
+
+		attr.size 			= sizeof(attr);
+		attr.type 			= PERF_TYPE_HW_CACHE;
+		attr.config 		= PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+		attr.disabled 		= 1;
+		attr.inherit 		= 1;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv 	= 1;
+
+		_fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+	}
+
+	~TlbCounter() {
+#if defined(__linux__)
+		if (_fd >= 0)
+			close(_fd);
+#endif
+	}
+
+	bool available() const {
+		return _fd >= 0;
+	}
+
+	void start() {
+#if defined(__linux__)
+		if (_fd >= 0) {
+			ioctl(_fd, PERF_EVENT_IOC_RESET, 0);
+			ioctl(_fd, PERF_EVENT_IOC_ENABLE, 0);
+		}
+#endif
+	}
+
+	long long stop() {
+		long long count = 0;
+#if defined(__linux__)
+		if (_fd >= 0) {
+			ioctl(_fd, PERF_EVENT_IOC_DISABLE, 0);
+
+			if (read(_fd, &count, sizeof(count)) != sizeof(count))
+				count = 0;
+		}
+#endif
+		return count;
+	}
+
+private:
+
+	int _fd;
+
+};
+
+/**
+ * @brief Costruisce il grafo di fan-out con n nodi intermedi
+ */
+static void build(Mdf& graph, size_t n) {
+	std::vector<size_t> order(n);
+	std::iota(order.begin(), order.end(), 0);
+	std::shuffle(order.begin(), order.end(), std::mt19937(42));
+
+	Instruction input = graph.emplace_back([](const int& x) { return std::make_tuple(x); }, Param<int>{});
+	Instruction split = graph.split_node(n);
+	Instruction merge = graph.merge_node(n);
+	Instruction output = graph.emplace_back([](const token_vector_t& tokens) {
+		long sum = 0;
+
+		for(const auto& token : tokens) {
+			sum += TokenSlot<int>::from_token(token.get());
+		}
+
+		return std::make_tuple(sum);
+	}, Param<token_vector_t>{});
+
+	std::vector<Instruction> workers;
+
+	for(size_t i = 0; i < n; i++) {
+		workers.push_back(graph.emplace_back([](const int& x) { return std::make_tuple(x + 1); }, Param<int>{}));
+	}
+
+	graph.add_output(input, {split(), 0});
+
+	for(size_t i = 0; i < n; i++) {
+		graph.add_output(split, {workers[order[i]](), 0});
+		graph.add_output(workers[order[i]], {merge(), i});
+	}
+
+	graph.add_output(merge, {output(), 0});
+
+	graph.mark_as_input(input);
+	graph.mark_as_output(output);
+}
+
+static void measure(const char* name, std::pmr::memory_resource* resource, size_t n, size_t runs) {
+	Mdf graph(resource);
+	build(graph, n);
+
+	Executor executor(1);
+	TlbCounter counter;
+
+	// prima esecuzione fuori misura: crea l'istanza riutilizzata dopo
+	release_token_vector(executor.run(graph, 1).get());
+
+	auto start = std::chrono::steady_clock::now();
+	counter.start();
+
+	for(size_t i = 0; i < runs; i++) {
+		release_token_vector(executor.run(graph, (int) i).get());
+	}
+
+	long long misses = counter.stop();
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	if (counter.available())
+		printf("%-12s %10.2f ms/run %14.0f dTLB miss/run\n", name, ms / runs, (double) misses / runs);
+	else
+		printf("%-12s %10.2f ms/run (contatori non disponibili)\n", name, ms / runs);
+}
+
+int main(int argc, char** argv) {
+	size_t n 	= argc > 1 ? strtoul(argv[1], nullptr, 10) : 50000;
+	size_t runs = argc > 2 ? strtoul(argv[2], nullptr, 10) : 20;
+
+	measure("default", nullptr, n, runs);
+
+	HugePageResource huge;
+	measure("huge pages", &huge, n, runs);
+
+	printf("regioni: hugetlb %zu MB, thp %zu MB, riserva %zu MB\n",
+		huge.reserved(HugePageResource::HUGETLB) >> 20,
+		huge.reserved(HugePageResource::TRANSPARENT) >> 20,
+		huge.reserved(HugePageResource::FALLBACK) >> 20);
+
+	return 0;
+}
@@ -0,0 +1,284 @@
+/**
+ * Microbenchmark del costo del framework, al netto del lavoro dei nodi:
+ * creazione dei TokenSlot, invocazione della callable con CallTuple,
+ * FunctionImp::execute, send_output, Graph::transfer_tokens, copia del
+ * grafo e inserimento/estrazione dalla JobQueue.
+ *
+ * Per ogni primitiva vengono riportati il tempo e le allocazioni per
+ * operazione, al variare della dimensione del payload e dell'arietà.
+ * Le allocazioni sono contate sostituendo gli operatori new globali
+ * (MDF_ALLOCATION_HOOKS), anche quelli allineati usati dalla risorsa di
+ * default, dopo un riscaldamento che porta pool e buffer a regime.
+ *
+ * Compilazione, dalla radice del repository:
+ * 	g++ -std=c++17 -O2 -I. bench/microbench.cpp -o microbench -pthread
+ *
+ * Uso: ./microbench [filtro]
+ * Con il filtro vengono eseguite solo le primitive il cui nome lo contiene.
+ */
+#define MDF_ALLOCATION_HOOKS
+
+#include <cstdio>
+#include <string>
+#include <chrono>
+#include <utility>
+#include "../executor.hpp"
+
+using namespace mdf;
+
+static const char* filter = "";
+
+template <size_t>
+using Int = int;
+
+template <size_t N>
+struct Blob {
+	char _data[N];
+};
+
+/**
+ * @brief Impedisce al compilatore di eliminare il calcolo di value
+ */
+template <typename T>
+static void keep(T& value) {
+	asm volatile("" : : "g"(&value) : "memory");
+}
+
+/**
+ * @brief Misura step, che esegue ops operazioni, raddoppiando le
+ * 			iterazioni finché la misura non dura almeno 50 ms
+ */
+template <typename F>
+static void run(const char* name, const std::string& params, size_t ops, F&& step) {
+	if (std::string(name).find(filter) == std::string::npos)
+		return;
+
+	for(size_t i = 0; i < 1000; i++) {
+		step();
+	}
+
+	size_t iterations = 1000;
+	double ns;
+	AllocationReport before, after;
+
+	while (true) {
+		before = AllocationTally::instance().read();
+		auto start = std::chrono::steady_clock::now();
+
+		{
+			HotPathScope scope;
+
+			for(size_t i = 0; i < iterations; i++) {
+				step();
+			}
+		}
+
+		ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+		after = AllocationTally::instance().read();
+
+		if (ns >= 50e6 || iterations >= (1 << 24))
+			break;
+
+		iterations *= 2;
+	}
+
+	double total = (double) iterations * ops;
+
+	printf("%-24s %-16s %10.1f %10.2f %10.1f\n", name, params.c_str(), ns / total,
+		(after._allocations - before._allocations) / total, (after._bytes - before._bytes) / total);
+}
+
+template <typename T>
+static void bench_token(const char* payload, const T& value) {
+	run("make_token", payload, 1, [&value]() {
+		auto token = make_token<T>(value);
+		keep(token);
+	});
+}
+
+template <size_t ... I>
+static void bench_call(std::index_sequence<I...>) {
+	std::tuple<Param<Int<I>>...> params;
+	auto callable = [](const Int<I>& ... values) { return std::make_tuple((0 + ... + values)); };
+	token_vector_t input;
+
+	(input.push_back(make_token<int>((int) I)), ...);
+
+	run("CallTuple", "arietà " + std::to_string(sizeof...(I)), 1, [&]() {
+		auto result = CallTuple<sizeof...(I)>::call_tuple(callable, params, input);
+		keep(result);
+	});
+}
+
+template <size_t ... I>
+static void bench_execute(std::index_sequence<I...>) {
+	std::shared_ptr<Function> function = Function::function_create(
+		[](const Int<I>& ... values) { return std::make_tuple((0 + ... + values)); }, Param<Int<I>>{}...);
+	token_vector_t input;
+
+	(input.push_back(make_token<int>((int) I)), ...);
+
+	run("FunctionImp::execute", "arietà " + std::to_string(sizeof...(I)), 1, [&]() {
+		release_token_vector(function -> execute(input));
+	});
+}
+
+template <typename T, size_t ... I>
+static void bench_send(const char* payload, const T& value, std::index_sequence<I...>) {
+	auto tuple = std::make_tuple(((void) I, value)...);
+
+	run("send_output", std::string(payload) + " x " + std::to_string(sizeof...(I)), 1, [&]() {
+		token_vector_t* output = acquire_token_vector(sizeof...(I));
+		send_output(tuple, output);
+		release_token_vector(output);
+	});
+}
+
+static void bench_queue() {
+	JobQueue queue(std::pmr::get_default_resource());
+
+	run("JobQueue push/pop", "singolo", 1, [&queue]() {
+		queue.push(Job(nullptr, 0));
+		keep(queue.front());
+		queue.pop();
+	});
+
+	run("JobQueue push/pop", "raffica 256", 256, [&queue]() {
+		for(size_t i = 0; i < 256; i++) {
+			queue.push(Job(nullptr, i));
+		}
+
+		for(size_t i = 0; i < 256; i++) {
+			keep(queue.front());
+			queue.pop();
+		}
+	});
+}
+
+namespace mdf {
+
+	/**
+	 * @struct MicroBench
+	 * @brief Le misure che richiedono l'accesso alle istanze del grafo
+	 */
+	struct MicroBench {
+
+		/**
+		 * @brief Costruisce un fan-out con n nodi intermedi tra uno split
+		 * 			e un merge, e ritorna l'id dello split
+		 */
+		static size_t fan_out(Mdf& graph, size_t n) {
+			Instruction input = graph.emplace_back([](const int& x) { return std::make_tuple(x); }, Param<int>{});
+			Instruction split = graph.split_node(n);
+			Instruction merge = graph.merge_node(n);
+			Instruction output = graph.emplace_back([](const token_vector_t& tokens) {
+				return std::make_tuple(tokens.size());
+			}, Param<token_vector_t>{});
+
+			graph.add_output(input, {split(), 0});
+
+			for(size_t i = 0; i < n; i++) {
+				Instruction worker = graph.emplace_back([](const int& x) { return std::make_tuple(x + 1); }, Param<int>{});
+
+				graph.add_output(split, {worker(), 0});
+				graph.add_output(worker, {merge(), i});
+			}
+
+			graph.add_output(merge, {output(), 0});
+
+			graph.mark_as_input(input);
+			graph.mark_as_output(output);
+			graph.validate();
+
+			return split();
+		}
+
+		/**
+		 * @brief Consegna i token di uno split agli n successori; i loro
+		 * 			contatori vengono ripristinati ad ogni operazione
+		 */
+		static void transfer(size_t n) {
+			Mdf graph;
+			size_t split 		= fan_out(graph, n);
+			Graph* instance 	= graph._graph -> acquire_instance();
+			token_map_t& map 	= *instance -> _nodes[split] -> _output_map;
+			std::shared_ptr<Token> token = make_token<int>(1);
+
+			run("Graph::transfer_tokens", "fan-out " + std::to_string(n), 1, [&]() {
+				token_vector_t* output = acquire_token_vector(n);
+				output -> assign(n, token);
+
+				instance -> transfer_tokens(output, map);
+
+				for(const auto& target : map) {
+					instance -> _nodes[std::get<0>(target)] -> _tokens_count.store(1, std::memory_order_relaxed);
+				}
+			});
+
+			graph._graph -> release_instance(instance);
+		}
+
+		/**
+		 * @brief Copia un grafo di n nodi, come alla creazione di una
+		 * 			nuova istanza, e la confronta con il riciclo di un'istanza
+		 */
+		static void copy(size_t n) {
+			Mdf graph;
+			fan_out(graph, n - 4);
+
+			Graph& model = *graph._graph;
+
+			run("Graph(const Graph&)", std::to_string(n) + " nodi", 1, [&model]() {
+				ResourceScope scope(model._resource);
+				Graph* instance = new Graph(model);
+				delete instance;
+			});
+
+			run("Graph::acquire_instance", std::to_string(n) + " nodi", 1, [&model]() {
+				model.release_instance(model.acquire_instance());
+			});
+		}
+
+	};
+
+}
+
+int main(int argc, char** argv) {
+	if (argc > 1)
+		filter = argv[1];
+
+	printf("%-24s %-16s %10s %10s %10s\n", "primitiva", "parametri", "ns/op", "alloc/op", "byte/op");
+
+	bench_token("int", 1);
+	bench_token("64 B", Blob<64>{});
+	bench_token("1 KB", Blob<1024>{});
+	bench_token("string 256", std::string(256, 'x'));
+
+	bench_call(std::make_index_sequence<1>{});
+	bench_call(std::make_index_sequence<2>{});
+	bench_call(std::make_index_sequence<4>{});
+	bench_call(std::make_index_sequence<8>{});
+
+	bench_execute(std::make_index_sequence<1>{});
+	bench_execute(std::make_index_sequence<2>{});
+	bench_execute(std::make_index_sequence<4>{});
+	bench_execute(std::make_index_sequence<8>{});
+
+	bench_send("int", 1, std::make_index_sequence<1>{});
+	bench_send("int", 1, std::make_index_sequence<4>{});
+	bench_send("int", 1, std::make_index_sequence<8>{});
+	bench_send("64 B", Blob<64>{}, std::make_index_sequence<4>{});
+	bench_send("1 KB", Blob<1024>{}, std::make_index_sequence<4>{});
+	bench_send("string 256", std::string(256, 'x'), std::make_index_sequence<4>{});
+
+	MicroBench::transfer(1);
+	MicroBench::transfer(8);
+	MicroBench::transfer(64);
+
+	MicroBench::copy(16);
+	MicroBench::copy(256);
+
+	bench_queue();
+
+	return 0;
+}
@@ -0,0 +1,491 @@
+#ifndef CHECKPOINT_HPP
+#define CHECKPOINT_HPP
+
+#include <string>
+#include <fstream>
+#include <thread>
+#include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <chrono>
+#include <typeinfo>
+#include <cstdio>
+#include <cstring>
+#include "graph.hpp"
+
+namespace mdf {
+
+	/**
+	 * @struct CheckpointConfig
+	 * @brief Parametri dei checkpoint delle istanze
+	 */
+	struct CheckpointConfig {
+
+		/**
+		 * @brief Intervallo tra due snapshot della stessa istanza
+		 */
+		std::chrono::milliseconds _period{60000};
+
+		/**
+		 * @brief Dimensione del buffer dei file di snapshot
+		 */
+		size_t _buffer_size = 1 << 20;
+	};
+
+	/**
+	 * @struct CheckpointStats
+	 * @brief Contatori dei checkpoint
+	 */
+	struct CheckpointStats {
+		uint64_t _snapshots{0};
+
+		/**
+		 * @brief Snapshot non scritti perché un token della frontiera non
+		 * 			è serializzabile o il file non è scrivibile
+		 */
+		uint64_t _skipped{0};
+
+		uint64_t _bytes_written{0};
+
+		uint64_t _resumed{0};
+	};
+
+	/**
+	 * @struct Checkpoint
+	 * @brief Stato del checkpoint di un'istanza in esecuzione
+	 */
+	struct Checkpoint {
+		Graph*				_instance;
+
+		std::string			_path;
+
+		/**
+		 * @brief Preso in condivisione dai worker mentre trasferiscono i
+		 * 			token di output di un nodo dell'istanza, in esclusiva
+		 * 			durante lo snapshot
+		 */
+		std::shared_mutex	_guard;
+
+		/**
+		 * @brief Vero mentre lo snapshot attende il guard: i worker non
+		 * 			iniziano nuovi trasferimenti, così che lo snapshot non
+		 * 			attenda indefinitamente
+		 */
+		std::atomic_bool	_pausing{false};
+
+		/**
+		 * @brief I nodi eseguiti, i cui token sono stati trasferiti
+		 */
+		std::vector<char>	_done;
+
+		/**
+		 * @brief Preso dallo snapshot per tutta la scrittura del file e da
+		 * 			finish, così che uno snapshot in corso non ricrei il file
+		 * 			rimosso né legga un'istanza già restituita al grafo
+		 */
+		std::mutex			_writing;
+
+		/**
+		 * @brief Vero dopo finish, protetto da _writing
+		 */
+		bool				_finished = false;
+
+		/**
+		 * @brief Vero quando l'istanza è visibile agli snapshot, protetto
+		 * 			dal lock del CheckpointManager
+		 */
+		bool				_published = false;
+	};
+
+	/**
+	 * @class CheckpointManager
+	 * @brief Scrive periodicamente su disco lo stato delle istanze
+	 * 			registrate: i nodi completati e i token, serializzati con
+	 * 			il loro Serializer, in attesa sui nodi non ancora eseguiti.
+	 * Un altro processo, costruito lo stesso grafo, può riprendere
+	 * l'istanza dallo snapshot rieseguendo solo i nodi non completati.
+	 * I token in ingresso ai nodi di split hanno il tipo atteso dai loro
+	 * successori; uno snapshot con token in ingresso a nodi di merge, o di
+	 * tipi senza Serializer, viene saltato.
+	 * Lo snapshot non attende i nodi in esecuzione, di cui scrive i token
+	 * di input mentre la funzione li legge: le funzioni non devono
+	 * modificare i propri argomenti.
+	 */
+	class CheckpointManager {
+	public:
+
+		CheckpointManager(const CheckpointConfig& config);
+
+		CheckpointManager(const CheckpointManager &) = delete;
+
+		~CheckpointManager();
+
+		/**
+		 * @brief Registra un'istanza, i cui snapshot verranno scritti nel
+		 * 			file dato. Gli snapshot iniziano solo dopo publish.
+		 */
+		Checkpoint* attach(Graph& instance, const std::string& path);
+
+		/**
+		 * @brief Rende l'istanza visibile agli snapshot, va chiamato dopo
+		 * 			aver inviato gli argomenti al nodo di input: uno snapshot
+		 * 			senza di essi non potrebbe essere ripreso
+		 */
+		void publish(Checkpoint* checkpoint);
+
+		/**
+		 * @brief Carica lo snapshot nell'istanza, che deve essere nuova, e
+		 * 			la registra
+		 *
+		 * @param instance l'istanza del grafo da cui è stato scritto lo snapshot
+		 * @param path il file dello snapshot
+		 * @param ready riceve i nodi pronti per essere eseguiti
+		 * @throw std::runtime_error se il file non è valido o non
+		 * 			corrisponde al grafo
+		 */
+		Checkpoint* resume(Graph& instance, const std::string& path, std::vector<size_t>& ready);
+
+		/**
+		 * @brief Prende il guard condiviso, va chiamato prima di trasferire
+		 * 			i token di output di un nodo dell'istanza. Il nodo può
+		 * 			essere eseguito fuori dal guard: finché non è segnato
+		 * 			come completato viene rieseguito alla ripresa.
+		 */
+		static void enter(Checkpoint* checkpoint) {
+			while (checkpoint -> _pausing.load(std::memory_order_acquire)) {
+				std::this_thread::yield();
+			}
+
+			checkpoint -> _guard.lock_shared();
+		}
+
+		/**
+		 * @brief Segna il nodo come completato, dopo il trasferimento dei
+		 * 			suoi token, e rilascia il guard
+		 */
+		static void leave(Checkpoint* checkpoint, size_t node_id) {
+			checkpoint -> _done[node_id] = 1;
+			checkpoint -> _guard.unlock_shared();
+		}
+
+		/**
+		 * @brief Rimuove l'istanza completata e il suo snapshot, attendendo
+		 * 			lo snapshot eventualmente in corso
+		 */
+		void finish(Checkpoint* checkpoint);
+
+		CheckpointStats stats();
+
+		/**
+		 * @brief Ritorna un'impronta della struttura del grafo e dei tipi
+		 * 			delle sue funzioni, vedi la definizione
+		 */
+		static uint64_t fingerprint(const Graph& graph);
+
+	private:
+
+		static constexpr char MAGIC[8] = {'M', 'D', 'F', 'C', 'K', 'P', 'T', '2'};
+
+		static constexpr uint64_t END = UINT64_MAX;
+
+		bool snapshot(Checkpoint& checkpoint);
+
+		void snapshot_loop();
+
+		CheckpointConfig	_config;
+
+		std::mutex			_mutex;
+
+		std::condition_variable _changed;
+
+		std::vector<std::shared_ptr<Checkpoint>> _active;
+
+		CheckpointStats		_stats;
+
+		bool				_stop;
+
+		std::thread			_thread;
+
+	};
+
+	inline CheckpointManager::CheckpointManager(const CheckpointConfig& config) :
+		_config{config},
+		_stop{false}
+	{
+		_thread = std::thread([this] { snapshot_loop(); });
+	}
+
+	inline CheckpointManager::~CheckpointManager() {
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_stop = true;
+		}
+
+		_changed.notify_all();
+		_thread.join();
+	}
+
+	/**
+	 * @brief Ritorna un'impronta della struttura del grafo e dei tipi delle
+	 * 			sue funzioni, stabile tra esecuzioni dello stesso programma
+	 */
+	inline uint64_t CheckpointManager::fingerprint(const Graph& graph) {
+		uint64_t seed = graph._nodes.size();
+
+		for(const auto& node : graph._nodes) {
+			hash_combine(seed, node -> _type);
+			hash_combine(seed, node -> _input_size);
+			hash_combine(seed, node -> _output_size);
+
+			if (node -> _type == STANDARD)
+				hash_combine(seed, std::hash<std::string>{}(typeid(*node -> _function).name()));
+
+			for(const auto& target : *node -> _output_map) {
+				hash_combine(seed, std::get<0>(target));
+				hash_combine(seed, std::get<1>(target));
+			}
+		}
+
+		return seed;
+	}
+
+	inline Checkpoint* CheckpointManager::attach(Graph& instance, const std::string& path) {
+		std::shared_ptr<Checkpoint> checkpoint = std::make_shared<Checkpoint>();
+
+		checkpoint -> _instance = &instance;
+		checkpoint -> _path 	= path;
+		checkpoint -> _done.assign(instance._nodes.size(), 0);
+
+		std::lock_guard<std::mutex> lock(_mutex);
+		_active.push_back(std::move(checkpoint));
+
+		return _active.back().get();
+	}
+
+	inline void CheckpointManager::publish(Checkpoint* checkpoint) {
+		std::lock_guard<std::mutex> lock(_mutex);
+		checkpoint -> _published = true;
+	}
+
+	inline void CheckpointManager::finish(Checkpoint* checkpoint) {
+		{
+			std::lock_guard<std::mutex> writing(checkpoint -> _writing);
+
+			checkpoint -> _finished = true;
+			std::remove(checkpoint -> _path.c_str());
+		}
+
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		for(auto it = _active.begin(); it != _active.end(); ++it) {
+			if (it -> get() == checkpoint) {
+				_active.erase(it);
+				break;
+			}
+		}
+	}
+
+	/**
+	 * @brief Scrive lo snapshot in un file temporaneo che poi sostituisce
+	 * 			il precedente, così che un crash durante la scrittura non
+	 * 			lo corrompa. L'istanza resta ferma finché i token non sono
+	 * 			stati scritti. Va chiamato senza il lock, che viene preso
+	 * 			solo per aggiornare le statistiche.
+	 *
+	 * @return falso se lo snapshot è stato saltato
+	 */
+	inline bool CheckpointManager::snapshot(Checkpoint& checkpoint) {
+		std::lock_guard<std::mutex> writing(checkpoint._writing);
+
+		if (checkpoint._finished)
+			return false;
+
+		checkpoint._pausing.store(true, std::memory_order_release);
+
+		std::unique_lock<std::shared_mutex> guard(checkpoint._guard);
+		const Graph& graph = *checkpoint._instance;
+
+		checkpoint._pausing.store(false, std::memory_order_release);
+
+		for(size_t id = 0; id < graph._nodes.size(); id++) {
+			if (checkpoint._done[id])
+				continue;
+
+			for(size_t slot = 0; slot < graph._nodes[id] -> _input_size; slot++) {
+				if (graph._nodes[id] -> _input_tokens[slot] != nullptr && graph.slot_codec(id, slot) == nullptr)
+					return false;
+			}
+		}
+
+		std::string temporary = checkpoint._path + ".tmp";
+		std::vector<char> buffer(_config._buffer_size);
+		std::ofstream out;
+
+		out.rdbuf() -> pubsetbuf(buffer.data(), buffer.size());
+		out.open(temporary, std::ios::binary | std::ios::trunc);
+
+		uint64_t header[2] = {fingerprint(graph), graph._nodes.size()};
+
+		out.write(MAGIC, sizeof(MAGIC));
+		out.write(reinterpret_cast<const char*>(header), sizeof(header));
+		out.write(checkpoint._done.data(), checkpoint._done.size());
+
+		for(size_t id = 0; id < graph._nodes.size() && out; id++) {
+			if (checkpoint._done[id])
+				continue;
+
+			const Node& node = *graph._nodes[id];
+
+			for(size_t slot = 0; slot < node._input_size; slot++) {
+				if (node._input_tokens[slot] == nullptr)
+					continue;
+
+				uint64_t position[2] = {id, slot};
+
+				out.write(reinterpret_cast<const char*>(position), sizeof(position));
+				write_token(graph.slot_codec(id, slot), node._input_tokens[slot].get(), out);
+			}
+		}
+
+		guard.unlock();
+
+		out.write(reinterpret_cast<const char*>(&END), sizeof(END));
+		uint64_t size = out.tellp();
+		out.close();
+
+		if (!out || std::rename(temporary.c_str(), checkpoint._path.c_str()) != 0) {
+			std::remove(temporary.c_str());
+			return false;
+		}
+
+		std::lock_guard<std::mutex> lock(_mutex);
+		_stats._bytes_written += size;
+		return true;
+	}
+
+	inline Checkpoint* CheckpointManager::resume(Graph& instance, const std::string& path, std::vector<size_t>& ready) {
+		std::vector<char> buffer(_config._buffer_size);
+		std::ifstream in;
+
+		in.rdbuf() -> pubsetbuf(buffer.data(), buffer.size());
+		in.open(path, std::ios::binary);
+
+		if (!in)
+			throw std::runtime_error("Impossibile aprire lo snapshot " + path);
+
+		char magic[sizeof(MAGIC)];
+		uint64_t header[2];
+
+		in.read(magic, sizeof(magic));
+		in.read(reinterpret_cast<char*>(header), sizeof(header));
+
+		if (!in || std::memcmp(magic, MAGIC, sizeof(MAGIC)) != 0)
+			throw std::runtime_error("Il file " + path + " non è uno snapshot");
+
+		if (header[0] != fingerprint(instance) || header[1] != instance._nodes.size())
+			throw std::runtime_error("Lo snapshot " + path + " è stato scritto da un grafo diverso");
+
+		std::vector<char> done(instance._nodes.size());
+		in.read(done.data(), done.size());
+
+		for(;;) {
+			uint64_t position[2];
+
+			in.read(reinterpret_cast<char*>(position), sizeof(uint64_t));
+
+			if (in && position[0] == END)
+				break;
+
+			in.read(reinterpret_cast<char*>(position + 1), sizeof(uint64_t));
+
+			if (!in || position[0] >= instance._nodes.size() || position[1] >= instance._nodes[position[0]] -> _input_size)
+				throw std::runtime_error("Lo snapshot " + path + " è danneggiato");
+
+			Node& node = *instance._nodes[position[0]];
+			const TokenCodec* codec = instance.slot_codec(position[0], position[1]);
+
+			if (codec == nullptr)
+				throw std::runtime_error("Lo snapshot " + path + " è danneggiato");
+
+			if (read_token_codec(in) -> _type != codec -> _type)
+				throw std::runtime_error("Lo snapshot " + path + " contiene un token di tipo diverso da quello atteso");
+
+			// stesso id, stessa forma serializzata: il token viene creato
+			// del tipo atteso dal nodo, che per gli alias come long e long
+			// long può differire da quello registrato
+			node._input_tokens[position[1]] = codec -> _make(in);
+			node._tokens_count.fetch_sub(1, std::memory_order_relaxed);
+		}
+
+		for(size_t id = 0; id < instance._nodes.size(); id++) {
+			Node& node = *instance._nodes[id];
+
+			if (done[id]) {
+				node._tokens_count = 0;
+				node._processed.test_and_set();
+			} else if (node._tokens_count.load(std::memory_order_relaxed) == 0) {
+				node._processed.test_and_set();
+				ready.push_back(id);
+			}
+		}
+
+		std::shared_ptr<Checkpoint> checkpoint = std::make_shared<Checkpoint>();
+
+		checkpoint -> _instance 	= &instance;
+		checkpoint -> _path 		= path;
+		checkpoint -> _done 		= std::move(done);
+		checkpoint -> _published 	= true;
+
+		std::lock_guard<std::mutex> lock(_mutex);
+		_active.push_back(std::move(checkpoint));
+		_stats._resumed++;
+
+		return _active.back().get();
+	}
+
+	/**
+	 * @brief Copia le istanze registrate sotto il lock e le scrive senza,
+	 * 			così che attach e finish non attendano l'I/O
+	 */
+	inline void CheckpointManager::snapshot_loop() {
+		std::unique_lock<std::mutex> lock(_mutex);
+		std::vector<std::shared_ptr<Checkpoint>> active;
+
+		while (!_stop) {
+			_changed.wait_for(lock, _config._period, [this] { return _stop; });
+
+			if (_stop)
+				return;
+
+			for(const auto& checkpoint : _active) {
+				if (checkpoint -> _published)
+					active.push_back(checkpoint);
+			}
+
+			lock.unlock();
+
+			size_t written = 0;
+
+			for(const auto& checkpoint : active) {
+				if (snapshot(*checkpoint))
+					written++;
+			}
+
+			lock.lock();
+			_stats._snapshots 	+= written;
+			_stats._skipped 	+= active.size() - written;
+			active.clear();
+		}
+	}
+
+	inline CheckpointStats CheckpointManager::stats() {
+		std::lock_guard<std::mutex> lock(_mutex);
+		return _stats;
+	}
+
+}
+
+#endif /* CHECKPOINT_HPP */
@@ -0,0 +1,776 @@
+#ifndef DISTRIBUTED_HPP
+#define DISTRIBUTED_HPP
+
+#include <future>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <stdexcept>
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <signal.h>
+#include "partition.hpp"
+#include "socket.hpp"
+
+namespace mdf {
+
+	/**
+	 * @struct Endpoint
+	 * @brief L'indirizzo su cui una partizione riceve i token
+	 */
+	struct Endpoint {
+		std::string _host;
+		uint16_t 	_port;
+	};
+
+	/**
+	 * @struct DistributedConfig
+	 * @brief Parametri dell'esecuzione distribuita
+	 */
+	struct DistributedConfig {
+
+		/**
+		 * @brief Byte accumulati per una connessione prima di inviarli.
+		 * I token più piccoli viaggiano insieme in un solo messaggio, che
+		 * viene comunque inviato quando la partizione non ha altro da fare.
+		 */
+		size_t _batch_size = 64 << 10;
+
+		/**
+		 * @brief Tempo entro cui una partizione deve accettare la connessione
+		 */
+		std::chrono::milliseconds _connect_timeout{10000};
+	};
+
+	/**
+	 * @class TcpTransport
+	 * @brief Le connessioni di una partizione con le altre. I token
+	 * 			destinati a una partizione vengono accumulati e inviati in
+	 * 			un unico frame; i frame ricevuti vengono letti da un thread
+	 * 			per connessione e accodati.
+	 * Un frame è composto dalla sua lunghezza seguita dai record, ciascuno
+	 * con tipo, istanza, nodo, slot, dimensione e byte del token.
+	 */
+	class TcpTransport {
+	public:
+
+		struct Record {
+
+			enum record_kind : uint64_t {
+				TOKEN,
+				INPUT,
+				STOP
+			};
+
+			uint64_t 	_kind;
+			uint64_t 	_instance;
+			uint64_t 	_node;
+
+			/**
+			 * @brief Lo slot del token o, per i record INPUT locali, il
+			 * 			vettore dei token di input
+			 */
+			uint64_t 	_slot;
+
+			std::string _data;
+		};
+
+		/**
+		 * @param partition l'indice della partizione locale
+		 * @param endpoints gli indirizzi di tutte le partizioni
+		 * @param config i parametri delle connessioni
+		 * @param listener un socket già in ascolto per la partizione
+		 * 			locale, o -1 per aprirlo sul suo Endpoint
+		 */
+		TcpTransport(size_t partition, const std::vector<Endpoint>& endpoints,
+			const DistributedConfig& config, int listener = -1);
+
+		TcpTransport(const TcpTransport &) = delete;
+
+		~TcpTransport();
+
+		/**
+		 * @brief Accoda un record per la partizione, inviando il frame se
+		 * 			supera la dimensione del batch
+		 *
+		 * @throw std::runtime_error se la connessione non è disponibile
+		 */
+		void post(size_t to, const Record& record);
+
+		/**
+		 * @brief Accoda un record con i byte del token. I token più grandi
+		 * 			di un batch vengono inviati subito, insieme ai record già
+		 * 			accodati, senza copiarli.
+		 *
+		 * @throw std::runtime_error se la connessione non è disponibile
+		 */
+		void post(size_t to, const Record& record, const IoVector& data);
+
+		/**
+		 * @brief Invia i record accodati per tutte le partizioni
+		 */
+		void flush();
+
+		/**
+		 * @brief Accoda un record alla partizione locale
+		 */
+		void deliver(Record&& record);
+
+		/**
+		 * @brief Attende almeno un record e sposta tutti quelli ricevuti
+		 */
+		void wait(std::deque<Record>& records);
+
+		/**
+		 * @brief Ritorna il numero dei frame inviati
+		 */
+		uint64_t frames() const {
+			return _frames.load(std::memory_order_relaxed);
+		}
+
+	private:
+
+		static constexpr size_t RECORD_HEADER = 5 * sizeof(uint64_t);
+
+		int connect_to(size_t to);
+
+		void send_frame(size_t to);
+
+		void accept_loop();
+
+		void read_loop(int fd);
+
+		size_t 					_partition;
+
+		std::vector<Endpoint> 	_endpoints;
+
+		DistributedConfig 		_config;
+
+		int 					_listener;
+
+		std::mutex 				_send_mutex;
+
+		std::vector<int> 		_connections;
+
+		std::vector<std::string> _buffers;
+
+		IoVector 				_frame;
+
+		std::mutex 				_mutex;
+
+		std::condition_variable _received;
+
+		std::deque<Record> 		_inbox;
+
+		std::vector<int> 		_accepted;
+
+		std::vector<std::thread> _readers;
+
+		std::atomic<uint64_t> 	_frames;
+
+		std::atomic_bool 		_stop;
+
+		std::thread 			_acceptor;
+
+	};
+
+	/**
+	 * @brief Legge esattamente size byte dal socket
+	 *
+	 * @return falso se la connessione è stata chiusa
+	 */
+	inline bool read_all(int fd, char* data, size_t size) {
+		while (size > 0) {
+			ssize_t count = recv(fd, data, size, 0);
+
+			if (count < 0 && errno == EINTR)
+				continue;
+
+			if (count <= 0)
+				return false;
+
+			data += count;
+			size -= count;
+		}
+
+		return true;
+	}
+
+	inline TcpTransport::TcpTransport(size_t partition, const std::vector<Endpoint>& endpoints,
+		const DistributedConfig& config, int listener) :
+		_partition{partition},
+		_endpoints{endpoints},
+		_config{config},
+		_listener{listener},
+		_connections(endpoints.size(), -1),
+		_buffers(endpoints.size()),
+		_frames{0},
+		_stop{false}
+	{
+		if (_listener < 0)
+			_listener = tcp_listen(_endpoints.at(partition)._host, _endpoints.at(partition)._port).first;
+
+		_acceptor = std::thread([this] { accept_loop(); });
+	}
+
+	inline TcpTransport::~TcpTransport() {
+		_stop = true;
+
+		shutdown(_listener, SHUT_RDWR);
+		close(_listener);
+		_acceptor.join();
+
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+
+			for(int fd : _accepted) {
+				shutdown(fd, SHUT_RDWR);
+			}
+		}
+
+		for(std::thread& reader : _readers) {
+			reader.join();
+		}
+
+		for(int fd : _accepted) {
+			close(fd);
+		}
+
+		for(int fd : _connections) {
+			if (fd >= 0)
+				close(fd);
+		}
+	}
+
+	/**
+	 * @brief Apre la connessione verso la partizione, ritentando finché
+	 * 			non viene accettata o scade il tempo. Richiede il lock di invio.
+	 */
+	inline int TcpTransport::connect_to(size_t to) {
+		if (_connections[to] >= 0)
+			return _connections[to];
+
+		const Endpoint& endpoint = _endpoints.at(to);
+		auto deadline = std::chrono::steady_clock::now() + _config._connect_timeout;
+
+		for(;;) {
+			addrinfo hints{};
+			addrinfo* result = nullptr;
+			int fd = -1;
+
+			hints.ai_family   = AF_INET;
+			hints.ai_socktype = SOCK_STREAM;
+
+			if (getaddrinfo(endpoint._host.c_str(), std::to_string(endpoint._port).c_str(), &hints, &result) == 0) {
+				fd = socket(result -> ai_family, result -> ai_socktype, result -> ai_protocol);
+
+				if (fd >= 0 && connect(fd, result -> ai_addr, result -> ai_addrlen) != 0) {
+					close(fd);
+					fd = -1;
+				}
+
+				freeaddrinfo(result);
+			}
+
+			if (fd >= 0) {
+				int enable = 1;
+				setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+
+				return _connections[to] = fd;
+			}
+
+			if (std::chrono::steady_clock::now() > deadline)
+				throw std::runtime_error("Impossibile connettersi alla partizione " + std::to_string(to) + " su " +
+					endpoint._host + ":" + std::to_string(endpoint._port));
+
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		}
+	}
+
+	inline void TcpTransport::post(size_t to, const Record& record) {
+		uint64_t header[5] = {record._kind, record._instance, record._node, record._slot, record._data.size()};
+		std::lock_guard<std::mutex> lock(_send_mutex);
+		std::string& buffer = _buffers.at(to);
+
+		buffer.append(reinterpret_cast<const char*>(header), sizeof(header));
+		buffer.append(record._data);
+
+		if (buffer.size() >= _config._batch_size)
+			send_frame(to);
+	}
+
+	inline void TcpTransport::post(size_t to, const Record& record, const IoVector& data) {
+		uint64_t header[5] = {record._kind, record._instance, record._node, record._slot, data.size()};
+		std::lock_guard<std::mutex> lock(_send_mutex);
+		std::string& buffer = _buffers.at(to);
+
+		buffer.append(reinterpret_cast<const char*>(header), sizeof(header));
+
+		if (data.size() < _config._batch_size) {
+			data.append_to(buffer);
+
+			if (buffer.size() >= _config._batch_size)
+				send_frame(to);
+
+			return;
+		}
+
+		uint64_t size = buffer.size() + data.size();
+
+		_frame.clear();
+		_frame.copy_value(size);
+		_frame.append(buffer.data(), buffer.size());
+		_frame.append(data);
+
+		if (!_frame.send(connect_to(to)))
+			throw std::runtime_error("Connessione con la partizione " + std::to_string(to) + " interrotta");
+
+		buffer.clear();
+		_frames.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	inline void TcpTransport::flush() {
+		std::lock_guard<std::mutex> lock(_send_mutex);
+
+		for(size_t to = 0; to < _buffers.size(); to++) {
+			if (!_buffers[to].empty())
+				send_frame(to);
+		}
+	}
+
+	/**
+	 * @brief Invia i record accodati per la partizione. Richiede il lock di invio.
+	 */
+	inline void TcpTransport::send_frame(size_t to) {
+		std::string& buffer = _buffers[to];
+		uint64_t size = buffer.size();
+
+		_frame.clear();
+		_frame.copy_value(size);
+		_frame.append(buffer.data(), buffer.size());
+
+		if (!_frame.send(connect_to(to)))
+			throw std::runtime_error("Connessione con la partizione " + std::to_string(to) + " interrotta");
+
+		buffer.clear();
+		_frames.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	inline void TcpTransport::deliver(Record&& record) {
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_inbox.push_back(std::move(record));
+		}
+
+		_received.notify_one();
+	}
+
+	inline void TcpTransport::wait(std::deque<Record>& records) {
+		std::unique_lock<std::mutex> lock(_mutex);
+		_received.wait(lock, [this] { return !_inbox.empty(); });
+
+		std::move(_inbox.begin(), _inbox.end(), std::back_inserter(records));
+		_inbox.clear();
+	}
+
+	inline void TcpTransport::accept_loop() {
+		for(;;) {
+			int fd = accept(_listener, nullptr, nullptr);
+
+			if (fd < 0) {
+				if (_stop)
+					return;
+
+				continue;
+			}
+
+			std::lock_guard<std::mutex> lock(_mutex);
+
+			_accepted.push_back(fd);
+			_readers.emplace_back([this, fd] { read_loop(fd); });
+		}
+	}
+
+	inline void TcpTransport::read_loop(int fd) {
+		std::string frame;
+
+		for(;;) {
+			uint64_t size;
+
+			if (!read_all(fd, reinterpret_cast<char*>(&size), sizeof(size)))
+				return;
+
+			frame.resize(size);
+
+			if (!read_all(fd, frame.data(), size))
+				return;
+
+			std::deque<Record> records;
+
+			for(size_t position = 0; position + RECORD_HEADER <= size;) {
+				uint64_t header[5];
+				std::memcpy(header, frame.data() + position, RECORD_HEADER);
+				position += RECORD_HEADER;
+
+				records.push_back(Record{header[0], header[1], header[2], header[3], frame.substr(position, header[4])});
+				position += header[4];
+			}
+
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				std::move(records.begin(), records.end(), std::back_inserter(_inbox));
+			}
+
+			_received.notify_one();
+		}
+	}
+
+	/**
+	 * @brief Serve la partizione finché non riceve STOP: esegue i nodi
+	 * 			dei token ricevuti e, quando non ci sono altri record,
+	 * 			invia i token accumulati per le altre partizioni
+	 *
+	 * @param complete chiamata con il risultato delle istanze, solo nella
+	 * 			partizione 0
+	 */
+	template <typename Complete>
+	inline void serve_partition(Graph& model, size_t index, TcpTransport& transport, Complete&& complete) {
+		Partition partition(model, index);
+		std::deque<TcpTransport::Record> records;
+
+		auto forward = [&model, &transport](size_t to, uint64_t id, size_t node_id, size_t slot, Token* token) {
+			transport.post(to, TcpTransport::Record{TcpTransport::Record::TOKEN, id, node_id, slot, std::string()},
+				Partition::serialize(model, node_id, slot, token));
+		};
+
+		for(;;) {
+			transport.wait(records);
+
+			while (!records.empty()) {
+				TcpTransport::Record record = std::move(records.front());
+				records.pop_front();
+
+				if (record._kind == TcpTransport::Record::STOP) {
+					transport.flush();
+					return;
+				}
+
+				if (record._kind == TcpTransport::Record::INPUT) {
+					partition.input(record._instance, reinterpret_cast<token_vector_t*>(record._slot), forward, complete);
+					continue;
+				}
+
+				MemoryBuffer buffer(record._data.data(), record._data.size());
+				std::istream in(&buffer);
+
+				partition.receive(record._instance, record._node, record._slot, in, forward, complete);
+			}
+
+			transport.flush();
+		}
+	}
+
+	/**
+	 * @class RemoteAgent
+	 * @brief Esegue una partizione del grafo per un DistributedExecutor.
+	 * Ogni macchina costruisce lo stesso grafo, con le stesse assegnazioni
+	 * Mdf::set_process, e avvia un agente per ciascuna delle sue partizioni.
+	 */
+	class RemoteAgent {
+	public:
+
+		/**
+		 * @param graph il grafo, uguale a quello del DistributedExecutor
+		 * @param partition la partizione eseguita dall'agente, almeno 1
+		 * @param endpoints gli indirizzi di tutte le partizioni, il primo
+		 * 			è quello del DistributedExecutor
+		 * @param listener un socket già in ascolto, o -1
+		 */
+		RemoteAgent(Mdf& graph, size_t partition, const std::vector<Endpoint>& endpoints,
+			const DistributedConfig& config = DistributedConfig(), int listener = -1);
+
+		RemoteAgent(const RemoteAgent &) = delete;
+
+		/**
+		 * @brief Esegue i token ricevuti finché il DistributedExecutor non
+		 * 			viene distrutto
+		 */
+		void serve();
+
+	private:
+
+		Graph* 			_model;
+
+		size_t 			_partition;
+
+		TcpTransport 	_transport;
+
+	};
+
+	inline RemoteAgent::RemoteAgent(Mdf& graph, size_t partition, const std::vector<Endpoint>& endpoints,
+		const DistributedConfig& config, int listener) :
+		_model{graph._graph},
+		_partition{partition},
+		_transport(partition, endpoints, config, listener)
+	{
+		graph.validate();
+		Partition::check(*_model, endpoints.size());
+	}
+
+	inline void RemoteAgent::serve() {
+		serve_partition(*_model, _partition, _transport, [](uint64_t, token_vector_t*) {});
+	}
+
+	/**
+	 * @class DistributedExecutor
+	 * @brief Esegue un grafo ripartito tra questo processo, la partizione
+	 * 			0, e dei RemoteAgent raggiunti via TCP, vedi Mdf::set_process.
+	 * I token tra partizioni vengono serializzati e raccolti in un frame
+	 * per connessione; tra nodi della stessa partizione vengono spostati.
+	 * Ogni partizione viene eseguita su un solo thread.
+	 * È un prototipo: una connessione interrotta termina il processo.
+	 */
+	class DistributedExecutor {
+	public:
+
+		/**
+		 * @param graph il grafo da eseguire, non più modificabile
+		 * @param endpoints gli indirizzi delle partizioni, il primo è
+		 * 			quello su cui questo processo riceve i token
+		 * @param config i parametri delle connessioni
+		 * @param listener un socket già in ascolto per la partizione 0, o -1
+		 * @throw std::invalid_argument se la ripartizione non è eseguibile,
+		 * 			vedi Partition::check
+		 */
+		DistributedExecutor(Mdf& graph, const std::vector<Endpoint>& endpoints,
+			const DistributedConfig& config = DistributedConfig(), int listener = -1);
+
+		DistributedExecutor(const DistributedExecutor &) = delete;
+
+		/**
+		 * @brief Ferma gli agenti. Le esecuzioni in corso vengono abbandonate.
+		 */
+		~DistributedExecutor();
+
+		/**
+		 * @brief Esegue un'istanza del grafo, passati gli argomenti di input
+		 *
+		 * @return un future contenente il risultato dell'esecuzione
+		 */
+		template <typename ... Args>
+		std::future<token_vector_t*> run(Args && ... input_args);
+
+		/**
+		 * @brief Ritorna il numero dei frame inviati da questo processo
+		 */
+		uint64_t frames() const {
+			return _transport.frames();
+		}
+
+	private:
+
+		Graph* 			_model;
+
+		size_t 			_partitions;
+
+		TcpTransport 	_transport;
+
+		std::mutex 		_mutex;
+
+		std::unordered_map<uint64_t, std::promise<token_vector_t*>> _promises;
+
+		std::atomic<uint64_t> _next_instance;
+
+		std::thread 	_dispatcher;
+
+	};
+
+	inline DistributedExecutor::DistributedExecutor(Mdf& graph, const std::vector<Endpoint>& endpoints,
+		const DistributedConfig& config, int listener) :
+		_model{graph._graph},
+		_partitions{endpoints.size()},
+		_transport(0, endpoints, config, listener),
+		_next_instance{0}
+	{
+		graph.validate();
+		Partition::check(*_model, _partitions);
+
+		_dispatcher = std::thread([this] {
+			serve_partition(*_model, 0, _transport, [this](uint64_t id, token_vector_t* output) {
+				std::lock_guard<std::mutex> lock(_mutex);
+				auto it = _promises.find(id);
+
+				it -> second.set_value(output);
+				_promises.erase(it);
+			});
+		});
+	}
+
+	inline DistributedExecutor::~DistributedExecutor() {
+		for(size_t i = 1; i < _partitions; i++) {
+			_transport.post(i, TcpTransport::Record{TcpTransport::Record::STOP, 0, 0, 0, std::string()});
+		}
+
+		_transport.flush();
+		_transport.deliver(TcpTransport::Record{TcpTransport::Record::STOP, 0, 0, 0, std::string()});
+		_dispatcher.join();
+	}
+
+	template <typename ... Args>
+	inline std::future<token_vector_t*> DistributedExecutor::run(Args && ... input_args) {
+		Node& input = *_model -> _nodes[_model -> _input_node];
+		uint64_t id = _next_instance++;
+
+		if (input._input_size != sizeof...(Args))
+			throw std::invalid_argument("Il numero degli argomenti non corrisponde all'input del grafo");
+
+		token_vector_t* tokens = acquire_token_vector(sizeof...(Args));
+		(tokens -> push_back(make_input_token(std::forward<Args>(input_args))), ...);
+
+		std::future<token_vector_t*> future;
+
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			future = _promises[id].get_future();
+		}
+
+		if (input._process == 0) {
+			_transport.deliver(TcpTransport::Record{TcpTransport::Record::INPUT, id, input._node_id,
+				reinterpret_cast<uint64_t>(tokens), std::string()});
+			return future;
+		}
+
+		for(size_t slot = 0; slot < tokens -> size(); slot++) {
+			_transport.post(input._process, TcpTransport::Record{TcpTransport::Record::TOKEN, id, input._node_id, slot, std::string()},
+				Partition::serialize(*_model, input._node_id, slot, tokens -> at(slot).get()));
+		}
+
+		_transport.flush();
+		release_token_vector(tokens);
+
+		return future;
+	}
+
+	/**
+	 * @class LoopbackCluster
+	 * @brief Avvia su questa macchina un DistributedExecutor e un processo
+	 * 			RemoteAgent per ciascuna partizione, collegati su 127.0.0.1,
+	 * 			per provare un grafo distribuito senza altre macchine.
+	 * Gli agenti vengono creati con fork, quindi il cluster va costruito
+	 * prima di avviare altri thread.
+	 */
+	class LoopbackCluster {
+	public:
+
+		/**
+		 * @param graph il grafo da eseguire
+		 * @param agents il numero degli agenti, che eseguono le partizioni
+		 * 			da 1 ad agents
+		 */
+		LoopbackCluster(Mdf& graph, size_t agents, const DistributedConfig& config = DistributedConfig());
+
+		LoopbackCluster(const LoopbackCluster &) = delete;
+
+		/**
+		 * @brief Ferma gli agenti e ne attende la terminazione
+		 */
+		~LoopbackCluster();
+
+		DistributedExecutor& executor() {
+			return *_executor;
+		}
+
+		const std::vector<Endpoint>& endpoints() const {
+			return _endpoints;
+		}
+
+	private:
+
+		std::vector<Endpoint> 	_endpoints;
+
+		std::vector<pid_t> 		_agents;
+
+		std::unique_ptr<DistributedExecutor> _executor;
+
+	};
+
+	inline LoopbackCluster::LoopbackCluster(Mdf& graph, size_t agents, const DistributedConfig& config) {
+		std::vector<int> listeners;
+
+		graph.validate();
+
+		// i socket vengono aperti prima di creare gli agenti, così che le
+		// connessioni vengano accettate anche se un agente non è ancora pronto
+		for(size_t i = 0; i <= agents; i++) {
+			std::pair<int, uint16_t> listener = tcp_listen("127.0.0.1", 0);
+
+			listeners.push_back(listener.first);
+			_endpoints.push_back(Endpoint{"127.0.0.1", listener.second});
+		}
+
+		for(size_t i = 1; i <= agents; i++) {
+			pid_t pid = fork();
+
+			if (pid == 0) {
+				for(size_t j = 0; j < listeners.size(); j++) {
+					if (j != i)
+						close(listeners[j]);
+				}
+
+				{
+					RemoteAgent agent(graph, i, _endpoints, config, listeners[i]);
+					agent.serve();
+				}
+
+				_exit(0);
+			}
+
+			if (pid < 0) {
+				int error = errno;
+
+				// il distruttore non viene chiamato: gli agenti già creati
+				// attendono in serve() un executor che non esisterà
+				for(pid_t& agent : _agents) {
+					kill(agent, SIGKILL);
+					waitpid(agent, nullptr, 0);
+				}
+
+				close(listeners[0]);
+
+				for(size_t j = i; j < listeners.size(); j++) {
+					close(listeners[j]);
+				}
+
+				throw std::runtime_error(std::string("Impossibile creare il processo: ") + std::strerror(error));
+			}
+
+			_agents.push_back(pid);
+			close(listeners[i]);
+		}
+
+		_executor = std::make_unique<DistributedExecutor>(graph, _endpoints, config, listeners[0]);
+	}
+
+	inline LoopbackCluster::~LoopbackCluster() {
+		_executor.reset();
+
+		for(pid_t& agent : _agents) {
+			waitpid(agent, nullptr, 0);
+		}
+	}
+
+}
+
+#endif /* DISTRIBUTED_HPP */
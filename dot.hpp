@@ -0,0 +1,169 @@
+#ifndef DOT_HPP
+#define DOT_HPP
+
+#include <ostream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "analysis.hpp"
+
+namespace mdf {
+
+	/**
+	 * @struct DotConfig
+	 * @brief Opzioni dell'esportazione in DOT, vedi Mdf::export_dot
+	 */
+	struct DotConfig {
+
+		/**
+		 * @brief Il nome del digraph
+		 */
+		std::string _name = "mdf";
+
+		/**
+		 * @brief Colora i nodi in base al costo e ne allarga la forma in
+		 * 			base all'attesa media in coda
+		 */
+		bool 		_heat = true;
+
+		/**
+		 * @brief Evidenzia i nodi e gli archi del cammino critico
+		 */
+		bool 		_critical_path = true;
+	};
+
+	/**
+	 * @class GraphDot
+	 * @brief Scrive un grafo validato nel formato DOT di Graphviz.
+	 * La forma dei nodi dipende dal tipo: box per i nodi standard, triangolo
+	 * per gli split e triangolo rovesciato per i merge; i nodi di input e
+	 * di output hanno il bordo doppio. Ogni arco è etichettato con l'indice
+	 * del token di output e lo slot di input che raggiunge.
+	 * I costi sono quelli di GraphAnalysis::node_costs, le attese quelle
+	 * misurate dall'Executor con il profiling attivo.
+	 */
+	class GraphDot {
+	public:
+
+		static void write(const Graph& graph, std::ostream& out, const DotConfig& config = DotConfig());
+
+	private:
+
+		/**
+		 * @brief Ritorna il colore HSV di un nodo, dal blu per heat 0 al
+		 * 			rosso per heat 1
+		 */
+		static std::string color(double heat);
+
+		static std::string label(const Graph& graph, size_t id, double cost);
+
+	};
+
+	inline std::string GraphDot::color(double heat) {
+		std::ostringstream out;
+
+		out << std::fixed << std::setprecision(3) << 0.66 * (1 - std::min(std::max(heat, 0.0), 1.0)) << " 0.6 1.0";
+
+		return out.str();
+	}
+
+	inline std::string GraphDot::label(const Graph& graph, size_t id, double cost) {
+		const Node& node = *graph._nodes[id];
+		std::ostringstream out;
+
+		out << std::fixed << std::setprecision(1) << id;
+
+		if (node._type == SPLIT)
+			out << " split";
+		else if (node._type == MERGE)
+			out << " merge";
+
+		out << "\\n" << cost / 1000 << " us";
+
+		if (node._stats -> annotated_cost() < 0 && node._stats -> _count.load(std::memory_order_relaxed) == 0)
+			out << " (stimato)";
+		else if (node._stats -> _count.load(std::memory_order_relaxed) > 0)
+			out << " x " << node._stats -> _count.load(std::memory_order_relaxed);
+
+		if (node._stats -> _waits.load(std::memory_order_relaxed) > 0)
+			out << "\\nattesa " << node._stats -> mean_wait_ns() / 1000 << " us";
+
+		return out.str();
+	}
+
+	inline void GraphDot::write(const Graph& graph, std::ostream& out, const DotConfig& config) {
+		size_t n = graph._nodes.size();
+		size_t unknown;
+		std::vector<double> costs = GraphAnalysis::node_costs(graph, unknown);
+		std::vector<bool> critical(n, false);
+		std::vector<size_t> next_on_path(n, n);
+		double max_cost = 0;
+		double max_wait = 0;
+
+		if (config._critical_path) {
+			std::vector<size_t> path = GraphAnalysis::critical_path(graph, costs);
+
+			for(size_t i = 0; i < path.size(); i++) {
+				critical[path[i]] = true;
+
+				if (i + 1 < path.size())
+					next_on_path[path[i]] = path[i + 1];
+			}
+		}
+
+		for(size_t id = 0; id < n; id++) {
+			max_cost = std::max(max_cost, costs[id]);
+			max_wait = std::max(max_wait, graph._nodes[id] -> _stats -> mean_wait_ns());
+		}
+
+		out << "digraph \"" << config._name << "\" {\n";
+		out << "\tnode [style=filled, fillcolor=white, fontname=\"Helvetica\"];\n";
+		out << "\tedge [fontname=\"Helvetica\", fontsize=10];\n";
+		out << std::fixed << std::setprecision(2);
+
+		for(size_t id = 0; id < n; id++) {
+			const Node& node = *graph._nodes[id];
+
+			out << "\tn" << id << " [shape=" <<
+				(node._type == SPLIT ? "triangle" : node._type == MERGE ? "invtriangle" : "box");
+			out << ", label=\"" << label(graph, id, costs[id]) << "\"";
+
+			if (id == (size_t) graph._input_node || id == (size_t) graph._output_node)
+				out << ", peripheries=2";
+
+			if (config._heat) {
+				out << ", fillcolor=\"" << color(max_cost > 0 ? costs[id] / max_cost : 0) << "\"";
+
+				if (max_wait > 0)
+					out << ", width=" << 0.75 + 1.5 * node._stats -> mean_wait_ns() / max_wait;
+			}
+
+			if (critical[id])
+				out << ", color=red, penwidth=3";
+
+			out << "];\n";
+		}
+
+		for(size_t id = 0; id < n; id++) {
+			const auto& outputs = *graph._nodes[id] -> _output_map;
+
+			for(size_t i = 0; i < outputs.size(); i++) {
+				size_t target = std::get<0>(outputs[i]);
+
+				out << "\tn" << id << " -> n" << target << " [label=\"" << i << ":" << std::get<1>(outputs[i]) << "\"";
+
+				if (next_on_path[id] == target)
+					out << ", color=red, penwidth=3";
+
+				out << "];\n";
+			}
+		}
+
+		out << "}\n";
+	}
+
+}
+
+#endif /* DOT_HPP */
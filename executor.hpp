@@ -9,30 +9,274 @@
 #include <condition_variable>
 #include <unordered_map>
 #include <atomic>
+#include <chrono>
+#include <optional>
+#include <utility>
 #include "graph.hpp"
 #include "mdf.hpp"
+#include "fusion.hpp"
+#include "pipeline.hpp"
+#include "allocation.hpp"
+#include "spill.hpp"
+#include "checkpoint.hpp"
+#include "recorder.hpp"
+#include "latency.hpp"
+#include "perf_counters.hpp"
+#include "worker_metrics.hpp"
 
 namespace mdf {
 	
+	/**
+	 * @struct TypedResult
+	 * @brief  Consegna il risultato di un'istanza come std::tuple<R...>,
+	 * 			spostando i valori restituiti dalla callable del nodo di output.
+	 */
+	template <typename ... R>
+	struct TypedResult : public ResultSink {
+		std::promise<std::tuple<R...>> _promise;
+		
+		/**
+		 * @brief Il risultato o l'errore ricevuto, consegnato da complete()
+		 */
+		std::optional<std::tuple<R...>> _value;
+		
+		std::exception_ptr _error;
+		
+		/**
+		 * @brief Ritorna un TypedResult preso dalla pool, con una nuova promise
+		 */
+		static TypedResult* create();
+		
+		void accept(void* result, const std::type_info& type);
+		
+		void accept(token_vector_t* tokens);
+		
+		void complete();
+		
+		void fail(std::exception_ptr error);
+		
+		void dispose();
+		
+	private:
+	
+		template <size_t ... I>
+		static std::tuple<R...> from_tokens(token_vector_t& tokens, std::index_sequence<I...>);
+	};
+	
+	template <typename ... R>
+	inline TypedResult<R...>* TypedResult<R...>::create() {
+		TypedResult* result = ObjectPool<TypedResult>::instance().acquire();
+		result -> _promise 	= std::promise<std::tuple<R...>>(std::allocator_arg, PoolAllocator<std::tuple<R...>>());
+		
+		return result;
+	}
+	
+	template <typename ... R>
+	inline void TypedResult<R...>::dispose() {
+		_value.reset();
+		_error = nullptr;
+		
+		ObjectPool<TypedResult>::instance().release(this);
+	}
+	
+	template <typename ... R>
+	inline void TypedResult<R...>::accept(void* result, const std::type_info& type) {
+		if (type != typeid(std::tuple<R...>)) {
+			_error = std::make_exception_ptr(
+				std::invalid_argument("Il tipo del risultato non corrisponde a quello richiesto"));
+			return;
+		}
+		
+		_value.emplace(std::move(*static_cast<std::tuple<R...>*>(result)));
+	}
+	
+	template <typename ... R>
+	inline void TypedResult<R...>::accept(token_vector_t* tokens) {
+		if (tokens -> size() != sizeof...(R)) {
+			_error = std::make_exception_ptr(
+				std::invalid_argument("Il numero dei risultati non corrisponde a quello richiesto"));
+		} else {
+			// i token possono essere condivisi: i valori vengono copiati
+			_value.emplace(from_tokens(*tokens, std::index_sequence_for<R...>{}));
+		}
+		
+		release_token_vector(tokens);
+	}
+	
+	template <typename ... R>
+	inline void TypedResult<R...>::fail(std::exception_ptr error) {
+		_promise.set_exception(error);
+	}
+	
+	template <typename ... R>
+	inline void TypedResult<R...>::complete() {
+		if (_error)
+			_promise.set_exception(_error);
+		else
+			_promise.set_value(std::move(*_value));
+	}
+	
+	template <typename ... R>
+	template <size_t ... I>
+	inline std::tuple<R...> TypedResult<R...>::from_tokens(token_vector_t& tokens, std::index_sequence<I...>) {
+		return std::tuple<R...>(TokenSlot<R>::from_token(tokens[I].get())...);
+	}
+	
+	/**
+	 * @struct GroupResult
+	 * @brief Consegna il risultato del grafo fuso di un MdfGroup, diviso
+	 * 			in un vettore di token per ogni grafo del gruppo
+	 */
+	struct GroupResult : public ResultSink {
+		std::promise<std::vector<token_vector_t*>> _promise;
+		
+		std::vector<size_t> _output_sizes;
+		
+		std::vector<token_vector_t*> _value;
+		
+		std::exception_ptr _error;
+		
+		GroupResult(const std::vector<size_t>& output_sizes) :
+			_output_sizes{output_sizes}
+		{}
+		
+		void accept(void* result, const std::type_info& type);
+		
+		void accept(token_vector_t* tokens);
+		
+		void complete();
+		
+		void fail(std::exception_ptr error) {
+			_promise.set_exception(error);
+		}
+	};
+	
+	inline void GroupResult::accept(void* result, const std::type_info& type) {
+		// il nodo di output del grafo fuso è il merge che raccoglie i risultati
+		if (type != typeid(std::tuple<token_vector_t>)) {
+			_error = std::make_exception_ptr(
+				std::invalid_argument("Il tipo del risultato non corrisponde a quello richiesto"));
+			return;
+		}
+		
+		_value = MdfGroup::split_result(std::get<0>(*static_cast<std::tuple<token_vector_t>*>(result)), _output_sizes);
+	}
+	
+	inline void GroupResult::accept(token_vector_t* tokens) {
+		_value = MdfGroup::split_result(*tokens, _output_sizes);
+		release_token_vector(tokens);
+	}
+	
+	inline void GroupResult::complete() {
+		if (_error)
+			_promise.set_exception(_error);
+		else
+			_promise.set_value(std::move(_value));
+	}
+	
 	/**
 	 * @struct GraphHandler
 	 * @brief  Struct rappresentante un grafo nella pool, mantiene i dati
 	 * 			relativi ad una certa istanza durante l'esecuzione.
+	 * 			Al completamento dell'istanza l'handler e il grafo vengono
+	 * 			restituiti alle rispettive pool.
 	 */
 	struct GraphHandler {
-		std::promise<token_vector_t*> _promise;
-		Graph* _graph;
+		std::optional<std::promise<token_vector_t*>> _promise;
+		ResultSink*	_result;
+		
+		/**
+		 * @brief Risorsa dei token intermedi dell'esecuzione, o nullptr
+		 * 			per usare quella del worker
+		 */
+		std::pmr::memory_resource* _resource;
+		
+		/**
+		 * @brief Arena monotona dell'esecuzione, se abilitata
+		 */
+		RunArena*	_arena;
+		
+		/**
+		 * @brief Checkpoint dell'istanza, se registrata
+		 */
+		Checkpoint*	_checkpoint;
+		
+		/**
+		 * @brief Registrazione dell'esecuzione, se campionata
+		 */
+		RunTrace*	_trace;
+		
+		/**
+		 * @brief Avvio dell'esecuzione in nanosecondi, con le metriche
+		 * 			abilitate; 0 altrimenti
+		 */
+		uint64_t	_started_ns;
+		
+		/**
+		 * @brief Vero se l'errore dell'esecuzione è già stato consegnato
+		 */
+		std::atomic_bool _failed{false};
+		
+		Graph*		_model;
+		Graph* 		_graph;
 		uintptr_t	_id;
-		bool	 	_deleted;
+		Pipeline*	_pipeline;
+		size_t		_stage;
 		
-		GraphHandler(Graph& graph) :
-			_graph{new Graph(graph)},
-			_deleted{false}
-		{_id = reinterpret_cast<uintptr_t>(_graph); }
+		/**
+		 * @brief Ritorna un handler preso dalla pool con una nuova istanza
+		 * 			del grafo
+		 * 
+		 * @param model il grafo da istanziare
+		 */
+		static GraphHandler* create(Graph& model) {
+			GraphHandler* handler = ObjectPool<GraphHandler>::instance().acquire();
+			
+			handler -> _result 	 = nullptr;
+			handler -> _resource = nullptr;
+			handler -> _arena 	 = nullptr;
+			handler -> _checkpoint = nullptr;
+			handler -> _trace 	 = nullptr;
+			handler -> _started_ns = 0;
+			handler -> _failed 	 = false;
+			handler -> _model 	 = &model;
+			handler -> _graph 	 = model.acquire_instance();
+			handler -> _id 		 = reinterpret_cast<uintptr_t>(handler -> _graph);
+			handler -> _pipeline = nullptr;
+			handler -> _stage 	 = 0;
+			
+			return handler;
+		}
+		
+		/**
+		 * @brief Restituisce l'handler, l'istanza e il sink alle loro pool
+		 * 			e libera in blocco l'arena dell'esecuzione
+		 */
+		static void release(GraphHandler* handler) {
+			handler -> _model -> release_instance(handler -> _graph);
+			handler -> _promise.reset();
+			
+			if (handler -> _result != nullptr)
+				handler -> _result -> dispose();
+				
+			if (handler -> _arena != nullptr) {
+				handler -> _arena -> release();
+				ObjectPool<RunArena>::instance().release(handler -> _arena);
+			}
+			
+			ObjectPool<GraphHandler>::instance().release(handler);
+		}
+		
+		/**
+		 * @brief Crea la promise del risultato non tipizzato, il cui stato
+		 * 			condiviso viene allocato dalla pool
+		 */
+		std::future<token_vector_t*> token_future() {
+			return _promise.emplace(std::allocator_arg, PoolAllocator<token_vector_t*>()).get_future();
+		}
 		
-		~GraphHandler() {
-			if (!_deleted)
-			delete _graph;
+		bool has_next_stage() const {
+			return _pipeline != nullptr && _stage + 1 < _pipeline -> size();
 		}
 	};
 
@@ -44,6 +288,12 @@ namespace mdf {
 	struct Job {
 		GraphHandler*	_handler;
 		size_t			_node_id;
+		
+		/**
+		 * @brief Istante di accodamento in nanosecondi, con il profiling
+		 * 			attivo; 0 altrimenti
+		 */
+		uint64_t		_enqueued_ns = 0;
 			
 		Job() = default;
 		
@@ -52,10 +302,139 @@ namespace mdf {
 			_node_id{node_id}
 		{}
 		
-		Job(const Job& other) :
-			_handler{other._handler},
-			_node_id{other._node_id}
+		Job(const Job& other) = default;
+		
+		Job& operator = (const Job& other) = default;
+	};
+	
+	/**
+	 * @class JobQueue
+	 * @brief Coda FIFO di Job su un buffer circolare. Il buffer raddoppia
+	 * 			quando è pieno e non viene mai ridotto, così che a regime
+	 * 			inserimenti ed estrazioni non allochino memoria.
+	 */
+	class JobQueue {
+	public:
+	
+		/**
+		 * @param resource la risorsa da cui allocare il buffer
+		 */
+		JobQueue(std::pmr::memory_resource* resource) :
+			_buffer(64, resource),
+			_head{0},
+			_size{0}
 		{}
+		
+		bool empty() const {
+			return _size == 0;
+		}
+		
+		size_t size() const {
+			return _size;
+		}
+		
+		size_t capacity() const {
+			return _buffer.size();
+		}
+		
+		/**
+		 * @brief Fa crescere il buffer finché non può contenere n job
+		 */
+		void reserve(size_t n) {
+			while (_buffer.size() < n) {
+				grow();
+			}
+		}
+		
+		void push(const Job& job) {
+			if (_size == _buffer.size())
+				grow();
+				
+			_buffer[(_head + _size) & (_buffer.size() - 1)] = job;
+			_size++;
+		}
+		
+		Job& front() {
+			return _buffer[_head];
+		}
+		
+		void pop() {
+			_head = (_head + 1) & (_buffer.size() - 1);
+			_size--;
+		}
+		
+	private:
+	
+		void grow() {
+			std::pmr::vector<Job> buffer(_buffer.size() * 2, _buffer.get_allocator());
+			
+			for(size_t i = 0; i < _size; i++) {
+				buffer[i] = _buffer[(_head + i) & (_buffer.size() - 1)];
+			}
+			
+			_buffer.swap(buffer);
+			_head = 0;
+		}
+	
+		std::pmr::vector<Job> _buffer;
+		
+		size_t _head;
+		
+		size_t _size;
+	};
+	
+	/**
+	 * @struct PoolReport
+	 * @brief Contatori delle pool degli oggetti interni del framework.
+	 * 			A regime i contatori _allocated non crescono più.
+	 */
+	struct PoolReport {
+		PoolCounters _handlers;
+		PoolCounters _instances;
+		PoolCounters _token_vectors;
+		PoolCounters _promise_states;
+		
+		/**
+		 * @brief Tutte le pool, compresi i risultati tipizzati
+		 */
+		PoolCounters _total;
+		
+		size_t		 _queue_capacity;
+	};
+
+	/**
+	 * @struct MemoryConfig
+	 * @brief Risorse di memoria usate dall'Executor. Le risorse devono
+	 * 			essere thread-safe e sopravvivere all'Executor.
+	 */
+	struct MemoryConfig {
+		
+		/**
+		 * @brief Risorsa della coda dei job e dei token creati fuori dai
+		 * 			worker, nullptr per la risorsa di default
+		 */
+		std::pmr::memory_resource* _global = nullptr;
+		
+		/**
+		 * @brief Risorsa dei token creati da ciascun worker, ad esempio
+		 * 			locale al nodo NUMA del worker. Se vuoto, o per i worker
+		 * 			oltre la dimensione del vettore, si usa _global.
+		 */
+		std::vector<std::pmr::memory_resource*> _workers;
+		
+		/**
+		 * @brief Se vero ogni esecuzione alloca i token intermedi da una
+		 * 			RunArena liberata in blocco al completamento
+		 */
+		bool _run_arena = false;
+		
+		/**
+		 * @brief Se vero e _global non è impostata, job e token vengono 
+		 * 			allocati da steady_state_resource(): dopo Executor::reserve
+		 * 			e qualche esecuzione di riscaldamento, eseguire un grafo
+		 * 			non richiede memoria al sistema
+		 */
+		bool _steady_state = false;
 	};
 
 	class Executor {
@@ -66,10 +445,22 @@ namespace mdf {
 		 * @param thread_n il numero dei thread
 		 */
 		Executor(unsigned thread_n);
+		
+		/**
+		 * @brief Costruisce un Executor con n thread e le risorse di memoria date
+		 * 
+		 * @param thread_n il numero dei thread
+		 * @param memory le risorse da cui allocare job e token
+		 */
+		Executor(unsigned thread_n, const MemoryConfig& memory);
+		
 		~Executor();
 		
 		/**
-		 * @brief Esegue un'istanza del grafo, passati gli argomenti di input
+		 * @brief Esegue un'istanza del grafo, passati gli argomenti di input.
+		 * Gli argomenti lvalue vengono copiati, gli rvalue spostati; quelli
+		 * passati con borrow() vengono letti dal nodo di input senza copia e
+		 * devono restare validi finché il future non è pronto.
 		 *
 		 * @tparam Args... il tipo dei parametri
 		 * @param graph il grafo da eseguire
@@ -80,114 +471,1128 @@ namespace mdf {
 		template <typename ... Args>
 		std::future<token_vector_t*> run(Mdf& graph, Args && ... input_args);
 		
+		/**
+		 * @brief Esegue un'istanza del grafo allocando i token intermedi
+		 * 			dalla risorsa data. I token di output vengono allocati 
+		 * 			dalla risorsa del worker, quindi la risorsa può essere
+		 * 			liberata appena il future è pronto.
+		 * La risorsa viene usata solo se il nodo di output è un nodo
+		 * standard: i nodi di split e merge inoltrano i token ricevuti, che
+		 * devono sopravvivere alla risorsa. Negli altri casi i token vengono
+		 * allocati dalla risorsa del worker, come in run().
+		 *
+		 * @param resource la risorsa dell'esecuzione
+		 * @param graph il grafo da eseguire
+		 * @param input_args gli argomenti di input del primo nodo
+		 * 
+		 * @return un future contenente il risultato dell'esecuzione
+		 */
 		template <typename ... Args>
-		std::future<token_vector_t*> run(Mdf& graph, Args & ... input_args);
-		
-	private:
-	
-		std::vector<std::thread> 			 							_workers;
-		std::queue<Job>			 			 							_job_queue;
-		std::mutex				 			 							_mutex;
-		std::condition_variable	 			 							_empty;
-		std::vector<GraphHandler*>										_graph_pool;
-		volatile bool					 	 							_stop;
-	};
-	
-	inline Executor::Executor(unsigned thread_n = std::thread::hardware_concurrency()) 
-	: _stop{false}
-	{
-		for(int i = 0; i < thread_n; i++) {
-			_workers.emplace_back([this] {
-				for(;;) {
-						
-					Job job;
-
-					{
-						std::unique_lock<std::mutex> lock(this->_mutex);
-						this->_empty.wait(lock,
-							[this]{ return this->_stop || !this->_job_queue.empty(); });
-								
-						if(this->_stop && this->_job_queue.empty())
-							return;
-								
-						job = std::move(this->_job_queue.front());
-						this->_job_queue.pop();
-					}			
-					
-					Graph*	graph 	= job._handler -> _graph;
-					Node* node 		= graph -> _nodes.at(job._node_id).get();
-					
-					auto output = node -> execute();		
-						
-					if (node -> _is_output) {
-						
-						job._handler -> _promise.set_value(output);
-						job._handler -> _deleted = true;
-						delete job._handler -> _graph;
-						
-					} else {
-						
-						graph -> transfer_tokens(output, *(node -> _output_map));
-						
-						for(const size_t & next : *(node -> _successors)) {
-							
-							if (graph -> _nodes.at(next) -> _tokens_count.load() == 0 &&
-								!graph -> _nodes.at(next) -> _processed.test_and_set()) {
-								{
-									std::unique_lock<std::mutex> lock(this->_mutex);	
-									this -> _job_queue.emplace(job._handler, next);
-								}
-								
-								this -> _empty.notify_one();
-							}
-						} 
-					
-					}
-			
-				}			
-					
-			});
-		}		
-	}
-	
-	inline Executor::~Executor() {
-		{
-			std::unique_lock<std::mutex> lock(_mutex);
-			_stop = true;
-		}
-			
-		_empty.notify_all();
-		for(std::thread &worker: _workers)
-			worker.join();		
-			
-		for(GraphHandler*& graphs : _graph_pool)
-			delete graphs;
-				
-	}
-	
-	template <typename ... Args>
-	inline std::future<token_vector_t*> Executor::run(Mdf& graph, Args && ... input_args) {
+		std::future<token_vector_t*> run_in(std::pmr::memory_resource* resource, Mdf& graph, Args && ... input_args);
 		
-		graph.validate();
+		/**
+		 * @brief Esegue un'istanza del grafo fuso di un gruppo: i prefissi
+		 * 			comuni sono calcolati una sola volta per tutti i grafi
+		 *
+		 * @tparam Args... il tipo dei parametri
+		 * @param group il gruppo di grafi da eseguire
+		 * @param input_args gli argomenti di input del nodo di input comune
+		 * 
+		 * @return un future contenente il risultato di ogni grafo, nell'ordine
+		 * 			in cui i grafi sono stati aggiunti al gruppo
+		 */
+		template <typename ... Args>
+		std::future<std::vector<token_vector_t*>> run(MdfGroup& group, Args && ... input_args);
 		
-		GraphHandler* handler = new GraphHandler(*graph._graph);
-		handler -> _graph -> send_input_tokens(std::forward<Args>(input_args)...);
+		/**
+		 * @brief Esegue un'istanza della pipeline. Ogni stadio viene avviato
+		 * 			dal worker che completa lo stadio precedente, spostando i
+		 * 			token di output nel nodo di input dello stadio successivo.
+		 *
+		 * @tparam Args... il tipo dei parametri
+		 * @param pipeline la pipeline da eseguire
+		 * @param input_args gli argomenti di input del primo stadio
+		 * 
+		 * @return un future contenente il risultato dell'ultimo stadio
+		 */
+		template <typename ... Args>
+		std::future<token_vector_t*> run(Pipeline& pipeline, Args && ... input_args);
 		
-		{
-			std::unique_lock<std::mutex> lock(_mutex);
-			_job_queue.emplace(handler, handler -> _graph -> _input_node);
-		}
-			
-		_empty.notify_one();
-		_graph_pool.push_back(handler);
+		/**
+		 * @brief Esegue un'istanza del grafo e restituisce il risultato come
+		 * 			tupla tipizzata. I valori vengono spostati dalla tupla 
+		 * 			restituita dal nodo di output, senza creare Token.
+		 *
+		 * @tparam R... il tipo dei valori restituiti dal nodo di output
+		 * @tparam Args... il tipo dei parametri
+		 * @param graph il grafo da eseguire
+		 * @param input_args gli argomenti di input del primo nodo
+		 * 
+		 * @return un future contenente la tupla dei risultati, o l'eccezione
+		 * 			std::invalid_argument se i tipi non corrispondono
+		 */
+		template <typename ... R, typename ... Args>
+		std::future<std::tuple<R...>> run_as(Mdf& graph, Args && ... input_args);
 		
-		return handler -> _promise.get_future();
+		/**
+		 * @brief Esegue un'istanza della pipeline e restituisce il risultato
+		 * 			dell'ultimo stadio come tupla tipizzata
+		 */
+		template <typename ... R, typename ... Args>
+		std::future<std::tuple<R...>> run_as(Pipeline& pipeline, Args && ... input_args);
+		
+		/**
+		 * @brief Abilita il controllo automatico della granularità.
+		 * L'Executor misura il costo di ogni nodo eseguito e, ogni 
+		 * check_period esecuzioni di un grafo, lo ri-clusterizza se il
+		 * profilo dei costi è cambiato oltre la soglia.
+		 * 
+		 * @param grain la durata minima desiderata di ogni task, zero per disabilitare
+		 * @param check_period ogni quante esecuzioni controllare il profilo
+		 * @param drift la variazione relativa di costo che causa un nuovo clustering
+		 */
+		void set_granularity(std::chrono::nanoseconds grain, size_t check_period = 64, double drift = 0.5);
+		
+		/**
+		 * @brief Abilita la misura del costo dei nodi eseguiti e della loro
+		 * 			attesa in coda senza ri-clusterizzare i grafi, ad esempio
+		 * 			per Mdf::analyze e Mdf::export_dot.
+		 * 			La misura resta attiva finché la granularità è abilitata.
+		 */
+		void set_profiling(bool enabled);
+		
+		/**
+		 * @brief Abilita la misura dei contatori hardware (cicli, istruzioni,
+		 * 			miss dell'ultimo livello di cache e dei salti) dei nodi 
+		 * 			eseguiti, vedi Mdf::hardware_counters. Ogni worker apre
+		 * 			i propri contatori al primo nodo e li legge prima e dopo
+		 * 			ogni esecuzione, al costo di due chiamate di sistema.
+		 *
+		 * @return falso se i contatori non sono disponibili nel thread
+		 * 			chiamante, ad esempio per kernel.perf_event_paranoid; in
+		 * 			tal caso la misura non viene abilitata
+		 */
+		bool set_hardware_counters(bool enabled);
+		
+		/**
+		 * @brief Abilita le metriche dei worker e della coda dei job, 
+		 * 			azzerandole, vedi ExecutorMetrics
+		 */
+		void set_metrics(bool enabled);
+		
+		/**
+		 * @brief Ritorna le metriche sommando i contatori dei worker, senza
+		 * 			prendere il lock della coda
+		 */
+		ExecutorMetrics metrics();
+		
+		/**
+		 * @brief Ritorna i contatori delle pool degli oggetti interni, per 
+		 * 			verificare che a regime l'esecuzione non allochi memoria
+		 */
+		PoolReport pool_report();
+		
+		/**
+		 * @brief Prepara le pool per n istanze concorrenti del grafo: 
+		 * 			istanze, handler, vettori di token, stati delle promise
+		 * 			e coda dei job. Le pool ricevono anche gli oggetti che 
+		 * 			ogni thread può trattenere nella propria lista. I risultati
+		 * 			tipizzati e i token vengono riciclati dalle prime esecuzioni.
+		 * 
+		 * @param graph il grafo da eseguire
+		 * @param instances il numero massimo di esecuzioni contemporanee
+		 */
+		void reserve(Mdf& graph, size_t instances);
+		
+		/**
+		 * @brief Ritorna le allocazioni avvenute nel percorso critico delle
+		 * 			esecuzioni, di tutti gli Executor del processo.
+		 * In modalità _steady_state, o definendo MDF_ALLOCATION_HOOKS, un
+		 * contatore che cresce dopo il riscaldamento indica un'allocazione
+		 * nel percorso critico.
+		 */
+		static AllocationReport allocation_report();
+		
+		/**
+		 * @brief Abilita lo scarico su disco dei token serializzabili, vedi
+		 * 			Serializer, in attesa di nodi non ancora pronti. Va 
+		 * 			chiamato quando non ci sono esecuzioni in corso.
+		 * 
+		 * @param config la directory e i limiti di memoria
+		 */
+		void set_spilling(const SpillConfig& config);
+		
+		/**
+		 * @brief Ritorna i contatori dello scarico dei token
+		 */
+		SpillStats spill_stats();
+		
+		/**
+		 * @brief Abilita i checkpoint delle istanze avviate con 
+		 * 			run_checkpointed. Va chiamato quando non ci sono 
+		 * 			esecuzioni in corso e non può essere usato insieme
+		 * 			allo scarico dei token.
+		 * 
+		 * @param config l'intervallo tra gli snapshot
+		 */
+		void set_checkpointing(const CheckpointConfig& config);
+		
+		/**
+		 * @brief Esegue un'istanza del grafo scrivendone periodicamente lo
+		 * 			snapshot nel file dato, che viene rimosso quando 
+		 * 			l'istanza termina. I nodi di un'istanza ripresa possono
+		 * 			essere eseguiti di nuovo, quindi i loro effetti esterni
+		 * 			devono essere ripetibili.
+		 * 
+		 * @param graph il grafo da eseguire
+		 * @param path il file dello snapshot
+		 * @param input_args gli argomenti di input del primo nodo
+		 * 
+		 * @return un future contenente il risultato dell'esecuzione
+		 */
+		template <typename ... Args>
+		std::future<token_vector_t*> run_checkpointed(Mdf& graph, const std::string& path, Args && ... input_args);
+		
+		/**
+		 * @brief Riprende un'istanza del grafo dallo snapshot scritto da
+		 * 			run_checkpointed, anche da un altro processo, eseguendo
+		 * 			solo i nodi non completati. L'istanza continua a 
+		 * 			scrivere i propri snapshot nello stesso file.
+		 * 
+		 * @param graph lo stesso grafo che ha scritto lo snapshot
+		 * @param path il file dello snapshot
+		 * 
+		 * @return un future contenente il risultato dell'esecuzione
+		 */
+		std::future<token_vector_t*> resume(Mdf& graph, const std::string& path);
+		
+		/**
+		 * @brief Ritorna i contatori dei checkpoint
+		 */
+		CheckpointStats checkpoint_stats();
+		
+		/**
+		 * @brief Abilita la registrazione delle esecuzioni campionate in un
+		 * 			log binario: durata, worker e memoria di input di ogni
+		 * 			nodo e quando è diventato pronto, vedi RunLog per 
+		 * 			rileggerlo. Va chiamato quando non ci sono esecuzioni 
+		 * 			in corso.
+		 * 
+		 * @param config il file del log e il periodo di campionamento
+		 * @throw std::runtime_error se il log non può essere creato
+		 */
+		void set_recording(const RecordConfig& config);
+		
+		/**
+		 * @brief Ritorna i contatori della registrazione
+		 */
+		RecordStats record_stats();
+		
+		/**
+		 * @brief Abilita la scomposizione della latenza di un'esecuzione
+		 * 			ogni period in invio, calcolo sul cammino critico, attesa
+		 * 			e consegna del risultato, vedi LatencyReport. Va
+		 * 			chiamato quando non ci sono esecuzioni in corso.
+		 *
+		 * @param period viene campionata un'esecuzione ogni period, 0 per disabilitare
+		 * @param capacity il numero delle ultime esecuzioni campionate conservate
+		 */
+		void set_latency_sampling(size_t period, size_t capacity = 4096);
+		
+		LatencyReport latency_report();
+		
+	private:
+	
+		void prepare(Mdf& graph);
+		
+		template <typename ... Args>
+		void start(GraphHandler* handler, Args && ... input_args);
+		
+		GraphHandler* new_handler(Pipeline& pipeline);
+		
+		GraphHandler* next_stage(GraphHandler* handler, token_vector_t* output);
+		
+		token_vector_t* execute(Node* node, ResultSink* sink);
+	
+		void process(Job job, std::pmr::vector<Job>& local, std::pmr::memory_resource* resource);
+		
+		void attach_arena(GraphHandler* handler);
+		
+		void fail(GraphHandler* handler, std::exception_ptr error);
+		
+		void enqueue(const Job& job);
+		
+		/**
+		 * @brief Ritorna i contatori del worker chiamante o, per gli altri
+		 * 			thread, quelli condivisi dei job esterni
+		 */
+		WorkerCounters& counters();
+		
+		/**
+		 * @brief Ritorna la registrazione dell'esecuzione se è campionata
+		 * 			per il log o per le latenze, nullptr altrimenti
+		 */
+		RunTrace* attach_trace(const Graph& model);
+		
+		/**
+		 * @brief Consegna la registrazione dell'esecuzione completata alle
+		 * 			sue destinazioni e la libera
+		 */
+		void finish_trace(const Graph& model, RunTrace* trace);
+		
+		/**
+		 * @brief Ritorna l'istante corrente dell'orologio monotono in nanosecondi
+		 */
+		static uint64_t now_ns() {
+			return std::chrono::duration_cast<std::chrono::nanoseconds>(
+				std::chrono::steady_clock::now().time_since_epoch()).count();
+		}
+	
+		std::vector<std::thread> 			 							_workers;
+		std::pmr::memory_resource*										_resource;
+		bool															_run_arena;
+		JobQueue			 			 								_job_queue;
+		std::mutex				 			 							_mutex;
+		std::condition_variable	 			 							_empty;
+		volatile bool					 	 							_stop;
+		std::atomic_bool												_profile;
+		std::atomic_bool												_counters;
+		std::chrono::nanoseconds										_grain;
+		size_t															_check_period;
+		double															_drift;
+		std::unique_ptr<SpillManager>									_spill;
+		std::unique_ptr<CheckpointManager>								_checkpoint;
+		std::unique_ptr<RunRecorder>									_recorder;
+		std::unique_ptr<LatencySampler>									_latency;
+		std::atomic_bool												_metrics;
+		
+		/**
+		 * @brief I contatori dei worker, seguiti da quelli dei job esterni
+		 */
+		std::unique_ptr<WorkerCounters[]>								_worker_counters;
+		size_t															_worker_count;
+		
+		/**
+		 * @brief Profondità della coda, aggiornate sotto il lock della coda
+		 * 			e lette senza, così che la lettura delle metriche non
+		 * 			fermi i worker
+		 */
+		std::atomic<uint64_t>											_queue_depth;
+		std::atomic<uint64_t>											_max_queue_depth;
+		std::atomic<uint64_t>											_metrics_start_ns;
+	};
+	
+	inline Executor::Executor(unsigned thread_n = std::thread::hardware_concurrency()) 
+	: Executor(thread_n, MemoryConfig())
+	{}
+	
+	inline Executor::Executor(unsigned thread_n, const MemoryConfig& memory) 
+	: _resource{memory._global != nullptr ? memory._global : 
+		memory._steady_state ? steady_state_resource() : std::pmr::get_default_resource()},
+	  _run_arena{memory._run_arena},
+	  _job_queue(_resource),
+	  _stop{false},
+	  _profile{false},
+	  _counters{false},
+	  _grain{0},
+	  _check_period{64},
+	  _drift{0.5},
+	  _metrics{false},
+	  _worker_counters{new WorkerCounters[thread_n + 1]},
+	  _worker_count{thread_n},
+	  _queue_depth{0},
+	  _max_queue_depth{0},
+	  _metrics_start_ns{0}
+	{
+		for(int i = 0; i < thread_n; i++) {
+			std::pmr::memory_resource* resource = 
+				(size_t) i < memory._workers.size() && memory._workers[i] != nullptr ? memory._workers[i] : _resource;
+				
+			_workers.emplace_back([this, resource, i] {
+				ResourceScope scope(resource);
+				worker_index() = i;
+				std::pmr::vector<Job> local(resource);
+				
+				for(;;) {
+						
+					Job job;
+					bool measure = this->_metrics.load(std::memory_order_relaxed);
+					WorkerCounters& counters = this->_worker_counters[i];
+					std::chrono::steady_clock::time_point start;
+					
+					if (measure)
+						start = std::chrono::steady_clock::now();
+
+					{
+						std::unique_lock<std::mutex> lock(this->_mutex);
+						
+						if (measure) {
+							auto locked = std::chrono::steady_clock::now();
+							
+							counters.add(counters._dequeue_wait_ns, 
+								std::chrono::duration_cast<std::chrono::nanoseconds>(locked - start).count());
+						}
+						
+						while (!this->_stop && this->_job_queue.empty()) {
+							// le metriche possono essere abilitate mentre il worker è fermo
+							uint64_t parked = now_ns();
+								
+							this->_empty.wait(lock);
+							
+							if (this->_metrics.load(std::memory_order_relaxed)) {
+								counters.add(counters._parked_ns, 
+									now_ns() - std::max(parked, this->_metrics_start_ns.load(std::memory_order_relaxed)));
+								
+								if (!this->_stop && this->_job_queue.empty())
+									counters.add(counters._empty_wakeups, 1);
+							}
+						}
+								
+						if(this->_stop && this->_job_queue.empty())
+							return;
+								
+						job = std::move(this->_job_queue.front());
+						this->_job_queue.pop();
+						this->_queue_depth.store(this->_job_queue.size(), std::memory_order_relaxed);
+						measure = this->_metrics.load(std::memory_order_relaxed);
+					}			
+					
+					if (job._enqueued_ns != 0) {
+						uint64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+							std::chrono::steady_clock::now().time_since_epoch()).count();
+						
+						job._handler -> _graph -> _nodes[job._node_id] -> _stats -> record_wait(
+							now > job._enqueued_ns ? now - job._enqueued_ns : 0);
+					}
+					
+					if (measure)
+						start = std::chrono::steady_clock::now();
+					
+					HotPathScope hot_path;
+					this -> process(job, local, resource);
+					
+					if (measure) {
+						counters.add(counters._jobs, 1);
+						counters.add(counters._busy_ns, std::chrono::duration_cast<std::chrono::nanoseconds>(
+							std::chrono::steady_clock::now() - start).count());
+					}
+			
+				}			
+					
+			});
+		}		
+	}
+	
+	inline void Executor::enqueue(const Job& job) {
+		Job queued = job;
+		bool measure = _metrics.load(std::memory_order_relaxed);
+		std::chrono::steady_clock::time_point start;
+		
+		if (_profile.load(std::memory_order_relaxed))
+			queued._enqueued_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+				std::chrono::steady_clock::now().time_since_epoch()).count();
+		
+		if (measure)
+			start = std::chrono::steady_clock::now();
+		
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			
+			if (measure) {
+				WorkerCounters& worker = counters();
+				
+				worker.add(worker._enqueue_wait_ns, std::chrono::duration_cast<std::chrono::nanoseconds>(
+					std::chrono::steady_clock::now() - start).count());
+				worker.add(worker._donated, 1);
+			}
+			
+			_job_queue.push(queued);
+			_queue_depth.store(_job_queue.size(), std::memory_order_relaxed);
+			
+			if (measure && _job_queue.size() > _max_queue_depth.load(std::memory_order_relaxed))
+				_max_queue_depth.store(_job_queue.size(), std::memory_order_relaxed);
+		}
+		
+		_empty.notify_one();
+	}
+	
+	/**
+	 * @brief Esegue un job e, sullo stesso worker, i nodi del suo cluster
+	 * 			che diventano pronti. Gli altri successori pronti vengono
+	 * 			accodati.
+	 * 
+	 * @param resource la risorsa del worker, da cui vengono allocati i
+	 * 			token di output dell'esecuzione
+	 */
+	inline void Executor::process(Job job, std::pmr::vector<Job>& local, std::pmr::memory_resource* resource) {
+		local.push_back(job);
+		
+		while (!local.empty()) {
+			
+			job = local.back();
+			local.pop_back();
+			
+			GraphHandler* handler = job._handler;
+			Graph*	graph 		  = handler -> _graph;
+			Node* node 			  = graph -> _nodes.at(job._node_id).get();
+			
+			bool is_result = node -> _is_output && !handler -> has_next_stage();
+			
+			// il risultato tipizzato dell'ultimo stadio non passa dai Token
+			ResultSink* sink = is_result ? handler -> _result : nullptr;
+			RunTrace* trace  = handler -> _trace;
+			token_vector_t* output;
+			std::chrono::steady_clock::time_point started;
+			
+			if (_spill) {
+				try {
+					_spill -> acquire(*node);
+				} catch (...) {
+					fail(handler, std::current_exception());
+					continue;
+				}
+			}
+			
+			// i nodi standard vengono eseguiti fuori dal guard: uno snapshot
+			// li trova non completati, con i token di input ancora al loro
+			// posto. I merge spostano i token di input, e sono istantanei.
+			bool guarded = handler -> _checkpoint != nullptr && node -> _type != STANDARD;
+			
+			if (guarded)
+				CheckpointManager::enter(handler -> _checkpoint);
+			
+			if (trace != nullptr) {
+				trace -> executing(*node);
+				started = std::chrono::steady_clock::now();
+			}
+			
+			{
+				// il risultato sopravvive all'esecuzione e alla sua risorsa
+				ResourceScope scope(is_result ? resource : handler -> _resource);
+				output = execute(node, sink);
+			}
+			
+			if (trace != nullptr)
+				trace -> executed(job._node_id, started, std::chrono::steady_clock::now());
+				
+			if (node -> _is_output) {
+				
+				if (handler -> _checkpoint != nullptr) {
+					if (guarded)
+						CheckpointManager::leave(handler -> _checkpoint, job._node_id);
+						
+					_checkpoint -> finish(handler -> _checkpoint);
+				}
+				
+				Graph* model = handler -> _model;
+				std::optional<std::promise<token_vector_t*>> promise;
+				handler -> _trace = nullptr;
+				
+				if (handler -> has_next_stage()) {
+					GraphHandler* next = next_stage(handler, output);
+					
+					if ((next -> _trace = attach_trace(*next -> _model)) != nullptr)
+						next -> _trace -> ready(next -> _graph -> _input_node, true);
+						
+					local.emplace_back(next, next -> _graph -> _input_node);
+				} else {
+					if (handler -> _started_ns != 0 && _metrics.load(std::memory_order_relaxed))
+						counters().record_latency(now_ns() - handler -> _started_ns);
+					
+					promise = std::move(handler -> _promise);
+					handler -> _result = nullptr;
+				}
+				
+				// la traccia e l'istanza vengono chiuse prima della consegna:
+				// il chiamante può distruggere il grafo non appena il future
+				// è pronto, e la latenza non include il suo risveglio
+				if (trace != nullptr)
+					finish_trace(*model, trace);
+				
+				GraphHandler::release(handler);
+				
+				if (sink != nullptr) {
+					sink -> complete();
+					sink -> dispose();
+				} else if (promise) {
+					promise -> set_value(output);
+				}
+				
+			} else {
+				
+				if (handler -> _checkpoint != nullptr && !guarded)
+					CheckpointManager::enter(handler -> _checkpoint);
+				
+				if (_spill)
+					graph -> transfer_tokens(output, *(node -> _output_map), *_spill);
+				else
+					graph -> transfer_tokens(output, *(node -> _output_map));
+				
+				if (handler -> _checkpoint != nullptr)
+					CheckpointManager::leave(handler -> _checkpoint, job._node_id);
+				
+				for(const size_t & next : *(node -> _successors)) {
+					
+					Node* next_node = graph -> _nodes.at(next).get();
+					int missing 	= next_node -> _tokens_count.load(std::memory_order_acquire);
+					
+					if (missing == 0 && !next_node -> _processed.test_and_set()) {
+						
+						if (trace != nullptr)
+							trace -> ready(next, next_node -> _cluster == node -> _cluster);
+						
+						if (next_node -> _cluster == node -> _cluster) {
+							local.emplace_back(job._handler, next);
+							
+							if (_metrics.load(std::memory_order_relaxed))
+								counters().add(counters()._inlined, 1);
+						} else
+							enqueue(Job(job._handler, next));
+							
+					} else if (missing == 1 && _spill) {
+						// il nodo sarà presto pronto: i suoi token tornano in memoria
+						_spill -> prefetch(*next_node);
+					}
+				} 
+			
+			}
+		}
 	}
 	
+	/**
+	 * @brief Consegna al chiamante l'errore di un'esecuzione che non può
+	 * 			proseguire, ad esempio perché un token scaricato non può
+	 * 			essere riletto. L'istanza viene abbandonata e non torna al
+	 * 			grafo, perché altri nodi dell'esecuzione possono essere
+	 * 			ancora in corso.
+	 */
+	inline void Executor::fail(GraphHandler* handler, std::exception_ptr error) {
+		if (handler -> _failed.exchange(true))
+			return;
+			
+		if (handler -> _result != nullptr)
+			handler -> _result -> fail(error);
+		else if (handler -> _promise)
+			handler -> _promise -> set_exception(error);
+	}
+	
+	/**
+	 * @brief Esegue il nodo, misurandone il costo se il profiling è attivo
+	 * 
+	 * @param node il nodo da eseguire
+	 * @param sink la destinazione del risultato tipizzato, o nullptr
+	 * @return i token di output, o nullptr se il risultato è stato consegnato al sink
+	 */
+	inline token_vector_t* Executor::execute(Node* node, ResultSink* sink) {
+		token_vector_t* output = nullptr;
+		std::chrono::steady_clock::time_point start;
+		bool profile = _profile.load(std::memory_order_relaxed);
+		bool count 	 = _counters.load(std::memory_order_relaxed);
+		CounterSample before;
+		
+		if (count)
+			count = PerfCounters::local().read(before);
+		
+		if (profile)
+			start = std::chrono::steady_clock::now();
+			
+		if (sink != nullptr)
+			node -> execute(*sink);
+		else
+			output = node -> execute();
+			
+		if (profile) {
+			node -> _stats -> record(std::chrono::duration_cast<std::chrono::nanoseconds>(
+				std::chrono::steady_clock::now() - start).count());
+		}
+		
+		CounterSample after;
+		
+		if (count && PerfCounters::local().read(after)) {
+			node -> _stats -> record_counters(after._cycles - before._cycles, after._instructions - before._instructions,
+				after._llc_misses - before._llc_misses, after._branch_misses - before._branch_misses);
+		}
+		
+		return output;
+	}
+	
+	/**
+	 * @brief Crea l'istanza dello stadio successivo della pipeline, le 
+	 * 			trasferisce la promise e sposta i token di output nel suo
+	 * 			nodo di input
+	 *
+	 * @param handler l'istanza dello stadio completato
+	 * @param output i token di output dello stadio completato, viene liberato
+	 * @return l'istanza dello stadio successivo
+	 */
+	inline GraphHandler* Executor::next_stage(GraphHandler* handler, token_vector_t* output) {
+		GraphHandler* next = GraphHandler::create(*handler -> _pipeline -> _stages[handler -> _stage + 1] -> _graph);
+		
+		next -> _pipeline 	= handler -> _pipeline;
+		next -> _stage 		= handler -> _stage + 1;
+		next -> _promise 	= std::move(handler -> _promise);
+		next -> _result 	= handler -> _result;
+		next -> _resource 	= handler -> _resource;
+		next -> _arena 		= handler -> _arena;
+		next -> _started_ns = handler -> _started_ns;
+		
+		handler -> _result 	= nullptr;
+		handler -> _arena 	= nullptr;
+		
+		token_vector_t& input = next -> _graph -> _nodes.at(next -> _graph -> _input_node) -> _input_tokens;
+		std::move(output -> begin(), output -> end(), input.begin());
+		
+		release_token_vector(output);
+		
+		return next;
+	}
+	
+	inline PoolReport Executor::pool_report() {
+		PoolReport report;
+		
+		report._handlers 		= ObjectPool<GraphHandler>::instance().counters();
+		report._instances 		= Graph::instance_tally().read();
+		report._token_vectors 	= ObjectPool<token_vector_t>::instance().counters();
+		report._promise_states 	= block_tally().read();
+		report._total 			= PoolTally::total().read();
+		
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			report._queue_capacity = _job_queue.capacity();
+		}
+		
+		return report;
+	}
+	
+	inline void Executor::reserve(Mdf& graph, size_t instances) {
+		
+		graph.validate();
+		
+		Graph& model 	= *graph._graph;
+		size_t capacity = 1;
+		
+		// oggetti che i worker e il thread chiamante possono trattenere
+		size_t spare 	= (_workers.size() + 1) * ObjectPool<GraphHandler>::CACHE_SIZE;
+		
+		for(auto& node : model._nodes) {
+			capacity = std::max(capacity, node -> _output_size);
+		}
+		
+		model.reserve_instances(instances);
+		ObjectPool<GraphHandler>::instance().reserve(instances + spare);
+		reserve_token_vectors(instances * model._nodes.size() + spare, capacity);
+		
+		{
+			// gli stati rilasciati restano nella pool dei blocchi
+			std::vector<std::promise<token_vector_t*>> promises;
+			promises.reserve(instances + spare);
+			
+			for(size_t i = 0; i < instances + spare; i++) {
+				promises.emplace_back(std::allocator_arg, PoolAllocator<token_vector_t*>());
+			}
+		}
+		
+		std::unique_lock<std::mutex> lock(_mutex);
+		_job_queue.reserve(instances * model._nodes.size());
+	}
+	
+	inline void Executor::set_spilling(const SpillConfig& config) {
+		if (_checkpoint)
+			throw std::logic_error("Lo scarico dei token non può essere usato con i checkpoint");
+			
+		_spill = std::make_unique<SpillManager>(config);
+	}
+	
+	inline void Executor::set_checkpointing(const CheckpointConfig& config) {
+		if (_spill)
+			throw std::logic_error("I checkpoint non possono essere usati con lo scarico dei token");
+			
+		_checkpoint = std::make_unique<CheckpointManager>(config);
+	}
+	
+	inline CheckpointStats Executor::checkpoint_stats() {
+		return _checkpoint ? _checkpoint -> stats() : CheckpointStats();
+	}
+	
+	inline std::future<token_vector_t*> Executor::resume(Mdf& graph, const std::string& path) {
+		
+		if (!_checkpoint)
+			throw std::logic_error("I checkpoint non sono abilitati");
+		
+		prepare(graph);
+		
+		GraphHandler* handler = GraphHandler::create(*graph._graph);
+		std::future<token_vector_t*> future = handler -> token_future();
+		std::vector<size_t> ready;
+		
+		attach_arena(handler);
+		
+		try {
+			ResourceScope scope(handler -> _resource != nullptr ? handler -> _resource : _resource);
+			handler -> _checkpoint = _checkpoint -> resume(*handler -> _graph, path, ready);
+		} catch (...) {
+			GraphHandler::release(handler);
+			throw;
+		}
+		
+		for(const size_t& id : ready) {
+			enqueue(Job(handler, id));
+		}
+		
+		return future;
+	}
+	
+	inline SpillStats Executor::spill_stats() {
+		return _spill ? _spill -> stats() : SpillStats();
+	}
+	
+	inline AllocationReport Executor::allocation_report() {
+		return AllocationTally::instance().read();
+	}
+	
+	inline void Executor::set_granularity(std::chrono::nanoseconds grain, size_t check_period, double drift) {
+		_grain 			= grain;
+		_check_period 	= check_period > 0 ? check_period : 1;
+		_drift 			= drift;
+		_profile 		= grain.count() > 0;
+	}
+	
+	inline void Executor::set_recording(const RecordConfig& config) {
+		_recorder = std::make_unique<RunRecorder>(config);
+	}
+	
+	inline RecordStats Executor::record_stats() {
+		return _recorder ? _recorder -> stats() : RecordStats();
+	}
+	
+	inline void Executor::set_latency_sampling(size_t period, size_t capacity) {
+		if (period == 0)
+			_latency.reset();
+		else
+			_latency = std::make_unique<LatencySampler>(period, capacity);
+	}
+	
+	inline LatencyReport Executor::latency_report() {
+		return _latency ? _latency -> report() : LatencyReport();
+	}
+	
+	inline RunTrace* Executor::attach_trace(const Graph& model) {
+		uint64_t run;
+		bool recorded = _recorder && _recorder -> sample(run);
+		bool sampled  = _latency && _latency -> sample();
+		
+		if (!recorded && !sampled)
+			return nullptr;
+			
+		RunTrace* trace = RunTrace::acquire(model);
+		trace -> _sampled = sampled;
+		
+		if (recorded)
+			_recorder -> attach(model, trace, run);
+			
+		return trace;
+	}
+	
+	inline void Executor::finish_trace(const Graph& model, RunTrace* trace) {
+		if (trace -> _sampled)
+			_latency -> record(model, *trace, std::chrono::steady_clock::now());
+		
+		if (trace -> _recorded)
+			_recorder -> finish(trace);
+			
+		RunTrace::release(trace);
+	}
+	
+	inline bool Executor::set_hardware_counters(bool enabled) {
+		if (enabled && !PerfCounters::local().available())
+			return false;
+			
+		_counters = enabled;
+		
+		return true;
+	}
+	
+	inline WorkerCounters& Executor::counters() {
+		uint32_t index = worker_index();
+		
+		return _worker_counters[index < _worker_count ? index : _worker_count];
+	}
+	
+	inline void Executor::set_metrics(bool enabled) {
+		std::unique_lock<std::mutex> lock(_mutex);
+		
+		if (enabled) {
+			for(size_t i = 0; i <= _worker_count; i++) {
+				_worker_counters[i].reset();
+			}
+			
+			_max_queue_depth.store(0, std::memory_order_relaxed);
+			_metrics_start_ns.store(now_ns(), std::memory_order_relaxed);
+		}
+		
+		_metrics = enabled;
+	}
+	
+	inline ExecutorMetrics Executor::metrics() {
+		ExecutorMetrics metrics;
+		auto counter = [](const std::atomic<uint64_t>& value) {
+			return value.load(std::memory_order_relaxed);
+		};
+		
+		metrics._queue_depth 	 = _queue_depth.load(std::memory_order_relaxed);
+		metrics._max_queue_depth = _max_queue_depth.load(std::memory_order_relaxed);
+		metrics._elapsed_ns 	 = _metrics_start_ns.load(std::memory_order_relaxed) > 0 ? 
+			now_ns() - _metrics_start_ns.load(std::memory_order_relaxed) : 0;
+		
+		for(size_t i = 0; i <= _worker_count; i++) {
+			const WorkerCounters& counters = _worker_counters[i];
+			
+			metrics._runs_started 	+= counter(counters._runs_started);
+			metrics._runs_completed += counter(counters._runs_completed);
+			metrics._latency_ns 	+= counter(counters._latency_ns);
+			
+			for(size_t bucket = 0; bucket < LATENCY_BUCKETS; bucket++) {
+				metrics._latency[bucket] += counter(counters._latency[bucket]);
+			}
+		}
+		
+		for(size_t i = 0; i < _worker_count; i++) {
+			const WorkerCounters& counters = _worker_counters[i];
+			WorkerMetrics worker;
+			
+			worker._busy_ns 		= counter(counters._busy_ns);
+			worker._parked_ns 		= counter(counters._parked_ns);
+			worker._jobs 			= counter(counters._jobs);
+			worker._inlined 		= counter(counters._inlined);
+			worker._donated 		= counter(counters._donated);
+			worker._dequeue_wait_ns = counter(counters._dequeue_wait_ns);
+			worker._enqueue_wait_ns = counter(counters._enqueue_wait_ns);
+			worker._empty_wakeups 	= counter(counters._empty_wakeups);
+			worker._idle_ns 		= metrics._elapsed_ns > worker._busy_ns + worker._parked_ns ?
+				metrics._elapsed_ns - worker._busy_ns - worker._parked_ns : 0;
+			
+			metrics._workers.push_back(worker);
+		}
+		
+		metrics._external_enqueues 		  = counter(_worker_counters[_worker_count]._donated);
+		metrics._external_enqueue_wait_ns = counter(_worker_counters[_worker_count]._enqueue_wait_ns);
+		
+		return metrics;
+	}
+	
+	inline void Executor::set_profiling(bool enabled) {
+		_profile = enabled || _grain.count() > 0;
+	}
+	
+	inline Executor::~Executor() {
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			_stop = true;
+		}
+			
+		_empty.notify_all();
+		for(std::thread &worker: _workers)
+			worker.join();		
+			
+	}
+	
+	/**
+	 * @brief Valida il grafo e, se il controllo della granularità è 
+	 * 			abilitato, lo ri-clusterizza quando il profilo è cambiato
+	 */
+	inline void Executor::prepare(Mdf& graph) {
+		
+		graph.validate();
+		
+		if (_grain.count() > 0 && graph._graph -> _runs.fetch_add(1, std::memory_order_relaxed) % _check_period == 0 &&
+			graph._graph -> cost_drifted(_drift)) {
+			graph._graph -> cluster(_grain);
+		}
+	}
+	
+	/**
+	 * @brief Invia gli argomenti al nodo di input dell'istanza e la accoda.
+	 * 			L'handler viene distrutto dal worker che completa l'istanza,
+	 * 			quindi il future va ottenuto prima.
+	 */
+	template <typename ... Args>
+	inline void Executor::start(GraphHandler* handler, Args && ... input_args) {
+		
+		if (handler -> _resource == nullptr)
+			attach_arena(handler);
+		
+		try {
+			ResourceScope scope(handler -> _resource != nullptr ? handler -> _resource : _resource);
+			handler -> _graph -> send_input_tokens(std::forward<Args>(input_args)...);
+		} catch (...) {
+			if (handler -> _checkpoint != nullptr)
+				_checkpoint -> finish(handler -> _checkpoint);
+				
+			GraphHandler::release(handler);
+			throw;
+		}
+		
+		// nessuno snapshot finché gli argomenti non sono nel nodo di input
+		if (handler -> _checkpoint != nullptr)
+			_checkpoint -> publish(handler -> _checkpoint);
+		
+		if ((handler -> _trace = attach_trace(*handler -> _model)) != nullptr)
+			handler -> _trace -> ready(handler -> _graph -> _input_node, false);
+		
+		if (_metrics.load(std::memory_order_relaxed)) {
+			handler -> _started_ns = now_ns();
+			counters().add(counters()._runs_started, 1);
+		}
+		
+		enqueue(Job(handler, handler -> _graph -> _input_node));
+	}
+	
+	/**
+	 * @brief Assegna all'esecuzione una RunArena, se abilitate.
+	 * L'arena viene usata solo se il nodo di output finale è un nodo 
+	 * standard: i nodi di split e merge inoltrano i token ricevuti, che
+	 * devono sopravvivere all'arena.
+	 */
+	inline void Executor::attach_arena(GraphHandler* handler) {
+		
+		if (!_run_arena)
+			return;
+			
+		const Graph& last = handler -> _pipeline != nullptr ? 
+			*handler -> _pipeline -> _stages.back() -> _graph : *handler -> _model;
+		
+		if (last._nodes[last._output_node] -> _type != STANDARD)
+			return;
+		
+		handler -> _arena = ObjectPool<RunArena>::instance().acquire();
+		handler -> _arena -> reset(_resource);
+		handler -> _resource = handler -> _arena;
+	}
+	
+	/**
+	 * @brief Valida la pipeline e crea l'istanza del suo primo stadio
+	 */
+	inline GraphHandler* Executor::new_handler(Pipeline& pipeline) {
+		
+		pipeline.validate();
+		
+		for(Mdf*& stage : pipeline._stages) {
+			prepare(*stage);
+		}
+		
+		HotPathScope hot_path;
+		GraphHandler* handler = GraphHandler::create(*pipeline._stages.front() -> _graph);
+		handler -> _pipeline = &pipeline;
+		
+		return handler;
+	}
+	
+	template <typename ... Args>
+	inline std::future<token_vector_t*> Executor::run(Mdf& graph, Args && ... input_args) {
+		
+		prepare(graph);
+		
+		HotPathScope hot_path;
+		GraphHandler* handler = GraphHandler::create(*graph._graph);
+		std::future<token_vector_t*> future = handler -> token_future();
+		
+		start(handler, std::forward<Args>(input_args)...);
+		
+		return future;
+	}
+	
+	template <typename ... Args>
+	inline std::future<token_vector_t*> Executor::run_in(std::pmr::memory_resource* resource, Mdf& graph, Args && ... input_args) {
+		
+		prepare(graph);
+		
+		HotPathScope hot_path;
+		GraphHandler* handler = GraphHandler::create(*graph._graph);
+		std::future<token_vector_t*> future = handler -> token_future();
+		const Graph& model 	  = *graph._graph;
+		
+		if (model._nodes[model._output_node] -> _type == STANDARD)
+			handler -> _resource = resource;
+			
+		start(handler, std::forward<Args>(input_args)...);
+		
+		return future;
+	}
+	
+	template <typename ... Args>
+	inline std::future<token_vector_t*> Executor::run_checkpointed(Mdf& graph, const std::string& path, Args && ... input_args) {
+		
+		if (!_checkpoint)
+			throw std::logic_error("I checkpoint non sono abilitati");
+		
+		prepare(graph);
+		
+		GraphHandler* handler = GraphHandler::create(*graph._graph);
+		std::future<token_vector_t*> future = handler -> token_future();
+		
+		handler -> _checkpoint = _checkpoint -> attach(*handler -> _graph, path);
+		start(handler, std::forward<Args>(input_args)...);
+		
+		return future;
+	}
+	
+	template <typename ... R, typename ... Args>
+	inline std::future<std::tuple<R...>> Executor::run_as(Mdf& graph, Args && ... input_args) {
+		
+		prepare(graph);
+		
+		HotPathScope hot_path;
+		GraphHandler* handler 	= GraphHandler::create(*graph._graph);
+		TypedResult<R...>* result = TypedResult<R...>::create();
+		std::future<std::tuple<R...>> future = result -> _promise.get_future();
+		
+		handler -> _result = result;
+		start(handler, std::forward<Args>(input_args)...);
+		
+		return future;
+	}
+	
+	template <typename ... Args>
+	inline std::future<token_vector_t*> Executor::run(Pipeline& pipeline, Args && ... input_args) {
+		
+		GraphHandler* handler = new_handler(pipeline);
+		HotPathScope hot_path;
+		std::future<token_vector_t*> future = handler -> token_future();
+		
+		start(handler, std::forward<Args>(input_args)...);
+		
+		return future;
+	}
+	
+	template <typename ... R, typename ... Args>
+	inline std::future<std::tuple<R...>> Executor::run_as(Pipeline& pipeline, Args && ... input_args) {
+		
+		GraphHandler* handler 	= new_handler(pipeline);
+		HotPathScope hot_path;
+		TypedResult<R...>* result = TypedResult<R...>::create();
+		std::future<std::tuple<R...>> future = result -> _promise.get_future();
+		
+		handler -> _result = result;
+		start(handler, std::forward<Args>(input_args)...);
+		
+		return future;
+	}
 	
 	template <typename ... Args>
-	inline std::future<token_vector_t*> Executor::run(Mdf& graph, Args & ... input_args) {
-		return run(graph, std::move(input_args)...);
+	inline std::future<std::vector<token_vector_t*>> Executor::run(MdfGroup& group, Args && ... input_args) {
+		
+		group.validate();
+		prepare(group._fused);
+		
+		HotPathScope hot_path;
+		GraphHandler* handler 	= GraphHandler::create(*group._fused._graph);
+		GroupResult* result 	= new GroupResult(group._output_sizes);
+		std::future<std::vector<token_vector_t*>> future = result -> _promise.get_future();
+		
+		handler -> _result = result;
+		start(handler, std::forward<Args>(input_args)...);
+		
+		return future;
 	}
 	
 	
@@ -0,0 +1,569 @@
+#ifndef FILE_SINK_HPP
+#define FILE_SINK_HPP
+
+#include <string>
+#include <string_view>
+#include <sstream>
+#include <map>
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <stdexcept>
+#include <type_traits>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include "mdf.hpp"
+#include "serialization.hpp"
+#include "mapped_file.hpp"
+
+namespace mdf {
+
+	/**
+	 * @struct FileSinkConfig
+	 * @brief Parametri di un FileSink
+	 */
+	struct FileSinkConfig {
+
+		/**
+		 * @brief Il file di destinazione, viene creato o troncato
+		 */
+		std::string _path;
+
+		/**
+		 * @brief Dimensione di ciascun buffer, multiplo di ALIGNMENT
+		 */
+		size_t _buffer_size = 4 << 20;
+
+		/**
+		 * @brief Numero dei buffer: finché ce n'è uno libero i nodi non
+		 * 			attendono il disco
+		 */
+		size_t _buffers = 4;
+
+		/**
+		 * @brief Scrive con O_DIRECT, senza passare dalla page cache.
+		 * Se il file system non lo supporta si usa la scrittura normale.
+		 */
+		bool _direct = false;
+
+		/**
+		 * @brief Scrive i record in ordine di indice invece che di arrivo
+		 */
+		bool _ordered = false;
+	};
+
+	/**
+	 * @class FileSink
+	 * @brief Accoda record a un file attraverso grandi buffer allineati,
+	 * 			scritti da un thread dedicato mentre i nodi proseguono.
+	 * In modalità ordinata ogni record ha un indice, a partire da 0, e i
+	 * record arrivati prima dei precedenti restano in memoria finché la
+	 * sequenza non è completa.
+	 */
+	class FileSink {
+	public:
+
+		static constexpr size_t ALIGNMENT = 4096;
+
+		FileSink(const FileSinkConfig& config);
+
+		FileSink(const FileSink &) = delete;
+
+		/**
+		 * @brief Chiude il file, ignorando gli errori: per riceverli va
+		 * 			chiamato close()
+		 */
+		~FileSink();
+
+		/**
+		 * @brief Accoda un record, solo in modalità non ordinata
+		 *
+		 * @throw std::runtime_error se una scrittura è fallita: da quel
+		 * 			momento nessun record viene più accodato
+		 */
+		void write(const char* data, size_t size);
+
+		/**
+		 * @brief Accoda il record con l'indice dato, solo in modalità ordinata
+		 *
+		 * @throw std::runtime_error se una scrittura è fallita, come write()
+		 */
+		void write(size_t index, const char* data, size_t size);
+
+		/**
+		 * @brief Scrive i dati rimasti nei buffer e chiude il file
+		 *
+		 * @throw std::runtime_error se una scrittura è fallita o, in
+		 * 			modalità ordinata, se mancano dei record
+		 */
+		void close();
+
+		bool is_ordered() const {
+			return _config._ordered;
+		}
+
+		/**
+		 * @brief Vero se il file è stato aperto con O_DIRECT
+		 */
+		bool is_direct() const {
+			return _direct;
+		}
+
+		/**
+		 * @brief Ritorna il numero di byte accodati
+		 */
+		size_t size();
+
+	private:
+
+		struct Buffer {
+			char*	_data;
+			size_t	_size;
+		};
+
+		void append(const char* data, size_t size);
+
+		void submit();
+
+		void check_error();
+
+		void flush_loop();
+
+		FileSinkConfig	_config;
+
+		int 			_fd;
+
+		bool 			_direct;
+
+		/**
+		 * @brief Serializza i record, protegge il buffer corrente e l'ordine
+		 */
+		std::mutex		_write_mutex;
+
+		/**
+		 * @brief Protegge le code dei buffer, condivise con il thread di scrittura
+		 */
+		std::mutex		_mutex;
+
+		/**
+		 * @brief Segnala un buffer pieno al thread di scrittura
+		 */
+		std::condition_variable _full_changed;
+
+		/**
+		 * @brief Segnala un buffer tornato libero
+		 */
+		std::condition_variable _free_changed;
+
+		std::vector<char*>	_blocks;
+
+		std::vector<char*>	_free;
+
+		std::deque<Buffer>	_full;
+
+		/**
+		 * @brief Il buffer in riempimento, nullptr se non ancora preso
+		 */
+		char*			_current;
+
+		size_t			_filled;
+
+		size_t			_size;
+
+		/**
+		 * @brief L'indice del prossimo record da scrivere in modalità ordinata
+		 */
+		size_t			_next;
+
+		std::map<size_t, std::string> _pending;
+
+		/**
+		 * @brief Il primo errore di scrittura, 0 se nessuno
+		 */
+		int				_error;
+
+		bool			_stop;
+
+		bool			_closed;
+
+		std::thread		_flush;
+
+	};
+
+	inline FileSink::FileSink(const FileSinkConfig& config) :
+		_config{config},
+		_fd{-1},
+		_direct{false},
+		_current{nullptr},
+		_filled{0},
+		_size{0},
+		_next{0},
+		_error{0},
+		_stop{false},
+		_closed{false}
+	{
+		if (_config._buffer_size < ALIGNMENT || _config._buffer_size % ALIGNMENT != 0)
+			throw std::invalid_argument("La dimensione dei buffer deve essere un multiplo di 4096");
+
+		if (_config._buffers < 2)
+			throw std::invalid_argument("Servono almeno 2 buffer");
+
+		int flags = O_WRONLY | O_CREAT | O_TRUNC;
+
+#if defined(O_DIRECT)
+		if (_config._direct) {
+			_fd = open(_config._path.c_str(), flags | O_DIRECT, 0644);
+			_direct = _fd >= 0;
+		}
+#endif
+
+		if (_fd < 0)
+			_fd = open(_config._path.c_str(), flags, 0644);
+
+		if (_fd < 0)
+			throw std::runtime_error("Impossibile aprire " + _config._path + ": " + std::strerror(errno));
+
+		for(size_t i = 0; i < _config._buffers; i++) {
+			char* block = static_cast<char*>(std::aligned_alloc(ALIGNMENT, _config._buffer_size));
+
+			if (block == nullptr) {
+				for(char* allocated : _blocks)
+					std::free(allocated);
+
+				::close(_fd);
+				throw std::bad_alloc();
+			}
+
+			_blocks.push_back(block);
+			_free.push_back(block);
+		}
+
+		_flush = std::thread([this] { flush_loop(); });
+	}
+
+	inline FileSink::~FileSink() {
+		try {
+			close();
+		} catch (...) {}
+
+		for(char* block : _blocks)
+			std::free(block);
+	}
+
+	/**
+	 * @brief Solleva il primo errore di scrittura o segnala il file già
+	 * 			chiuso. Prende il lock delle code dei buffer.
+	 */
+	inline void FileSink::check_error() {
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		if (_error != 0)
+			throw std::runtime_error("Scrittura su " + _config._path + " fallita: " + std::strerror(_error));
+
+		if (_closed)
+			throw std::logic_error("Il file è già stato chiuso");
+	}
+
+	inline void FileSink::write(const char* data, size_t size) {
+		if (_config._ordered)
+			throw std::logic_error("In modalità ordinata ogni record deve avere un indice");
+
+		std::lock_guard<std::mutex> lock(_write_mutex);
+		check_error();
+
+		append(data, size);
+	}
+
+	inline void FileSink::write(size_t index, const char* data, size_t size) {
+		if (!_config._ordered)
+			throw std::logic_error("L'indice è ammesso solo in modalità ordinata");
+
+		std::lock_guard<std::mutex> lock(_write_mutex);
+		check_error();
+
+		if (index < _next || _pending.count(index) != 0)
+			throw std::invalid_argument("Il record " + std::to_string(index) + " è già stato scritto");
+
+		if (index != _next) {
+			_pending.emplace(index, std::string(data, size));
+			return;
+		}
+
+		append(data, size);
+		_next++;
+
+		for(auto it = _pending.begin(); it != _pending.end() && it -> first == _next; it = _pending.erase(it)) {
+			append(it -> second.data(), it -> second.size());
+			_next++;
+		}
+	}
+
+	/**
+	 * @brief Copia i dati nei buffer, consegnando al thread di scrittura
+	 * 			quelli riempiti. Richiede il lock dei record.
+	 *
+	 * @throw std::runtime_error se il thread di scrittura fallisce mentre
+	 * 			si attende un buffer libero
+	 */
+	inline void FileSink::append(const char* data, size_t size) {
+		while (size > 0) {
+			if (_current == nullptr) {
+				std::unique_lock<std::mutex> lock(_mutex);
+				_free_changed.wait(lock, [this] { return !_free.empty() || _error != 0; });
+
+				if (_error != 0)
+					throw std::runtime_error("Scrittura su " + _config._path + " fallita: " + std::strerror(_error));
+
+				_current = _free.back();
+				_free.pop_back();
+			}
+
+			size_t count = std::min(size, _config._buffer_size - _filled);
+
+			std::memcpy(_current + _filled, data, count);
+			_filled += count;
+			_size 	+= count;
+			data 	+= count;
+			size 	-= count;
+
+			if (_filled == _config._buffer_size)
+				submit();
+		}
+	}
+
+	/**
+	 * @brief Consegna il buffer corrente al thread di scrittura. Richiede
+	 * 			il lock dei record.
+	 */
+	inline void FileSink::submit() {
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_full.push_back(Buffer{_current, _filled});
+		}
+
+		_current = nullptr;
+		_filled  = 0;
+
+		_full_changed.notify_one();
+	}
+
+	inline void FileSink::flush_loop() {
+		for(;;) {
+			Buffer buffer;
+
+			{
+				std::unique_lock<std::mutex> lock(_mutex);
+				_full_changed.wait(lock, [this] { return _stop || !_full.empty(); });
+
+				if (_full.empty())
+					return;
+
+				buffer = _full.front();
+				_full.pop_front();
+			}
+
+			// con O_DIRECT la lunghezza deve essere allineata: l'ultimo buffer
+			// viene completato con zeri, poi il file viene troncato da close()
+			size_t length = _direct ? (buffer._size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT : buffer._size;
+			size_t written = 0;
+			int error = 0;
+
+			if (length != buffer._size)
+				std::memset(buffer._data + buffer._size, 0, length - buffer._size);
+
+			while (written < length) {
+				ssize_t count = ::write(_fd, buffer._data + written, length - written);
+
+				if (count < 0 && errno == EINTR)
+					continue;
+
+				if (count <= 0) {
+					error = count < 0 ? errno : EIO;
+					break;
+				}
+
+				written += count;
+			}
+
+			std::lock_guard<std::mutex> lock(_mutex);
+
+			if (error != 0 && _error == 0)
+				_error = error;
+
+			_free.push_back(buffer._data);
+			_free_changed.notify_all();
+		}
+	}
+
+	inline void FileSink::close() {
+		std::lock_guard<std::mutex> write_lock(_write_mutex);
+
+		if (_closed)
+			return;
+
+		if (_current != nullptr && _filled > 0)
+			submit();
+
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_stop = true;
+		}
+
+		_closed = true;
+
+		_full_changed.notify_all();
+		_flush.join();
+
+		if (_direct && ftruncate(_fd, _size) != 0 && _error == 0)
+			_error = errno;
+
+		if (::close(_fd) != 0 && _error == 0)
+			_error = errno;
+
+		if (_error != 0)
+			throw std::runtime_error("Scrittura su " + _config._path + " fallita: " + std::strerror(_error));
+
+		if (!_pending.empty())
+			throw std::runtime_error("Mancano dei record prima dell'indice " + std::to_string(_pending.begin() -> first));
+	}
+
+	inline size_t FileSink::size() {
+		std::lock_guard<std::mutex> lock(_write_mutex);
+		return _size;
+	}
+
+	/**
+	 * @struct SinkRecord
+	 * @brief I byte scritti da un FileSink per un token di tipo T: le
+	 * 			stringhe e i Chunk così come sono, i tipi con un Serializer
+	 * 			nella loro forma serializzata, gli altri tipi banalmente
+	 * 			copiabili con la loro rappresentazione in memoria.
+	 * Può essere specializzata per altri tipi.
+	 */
+	template <typename T>
+	struct SinkRecord {
+
+		static_assert(is_serializable<T>::value || std::is_trivially_copyable<T>::value,
+			"Il tipo deve avere un Serializer o essere banalmente copiabile");
+
+		template <typename W>
+		static void write(const T& value, W&& write) {
+			if constexpr (is_serializable<T>::value) {
+				thread_local IoVector segments;
+				thread_local std::string bytes;
+
+				segments.clear();
+				gather(value, segments);
+
+				// un solo segmento viene scritto senza copiarlo
+				if (segments.segments().size() == 1) {
+					write(static_cast<const char*>(segments.segments()[0].iov_base), segments.size());
+					return;
+				}
+
+				bytes.clear();
+				segments.append_to(bytes);
+				write(bytes.data(), bytes.size());
+			} else {
+				write(reinterpret_cast<const char*>(&value), sizeof(T));
+			}
+		}
+	};
+
+	template <>
+	struct SinkRecord<std::string> {
+		template <typename W>
+		static void write(const std::string& value, W&& write) {
+			write(value.data(), value.size());
+		}
+	};
+
+	template <>
+	struct SinkRecord<Chunk> {
+		template <typename W>
+		static void write(const Chunk& value, W&& write) {
+			write(value._data, value._size);
+		}
+	};
+
+	/**
+	 * @class FileSinkFunction
+	 * @brief Nodo che scrive il token ricevuto su un FileSink e produce il
+	 * 			numero di byte scritti. In modalità ordinata il nodo ha un
+	 * 			primo input in più, l'indice del record (size_t).
+	 */
+	template <typename T>
+	class FileSinkFunction : public Function {
+	public:
+
+		FileSinkFunction(std::shared_ptr<FileSink> sink) :
+			_sink{std::move(sink)}
+		{}
+
+		size_t get_arity() const { return _sink -> is_ordered() ? 2 : 1; }
+
+		size_t get_output_size() const { return 1; }
+
+		token_vector_t* execute(token_vector_t& input) const;
+
+		void execute(token_vector_t& input, ResultSink& sink) const;
+
+	private:
+
+		std::shared_ptr<FileSink> _sink;
+
+	};
+
+	template <typename T>
+	inline token_vector_t* FileSinkFunction<T>::execute(token_vector_t& input) const {
+		const T& value = TokenSlot<T>::from_token(input.at(input.size() - 1).get());
+		size_t bytes = 0;
+
+		if (_sink -> is_ordered()) {
+			size_t index = TokenSlot<size_t>::from_token(input.at(0).get());
+
+			SinkRecord<T>::write(value, [&](const char* data, size_t size) {
+				_sink -> write(index, data, size);
+				bytes = size;
+			});
+		} else {
+			SinkRecord<T>::write(value, [&](const char* data, size_t size) {
+				_sink -> write(data, size);
+				bytes = size;
+			});
+		}
+
+		token_vector_t* output = acquire_token_vector(1);
+		output -> push_back(make_token<size_t>(bytes));
+
+		return output;
+	}
+
+	template <typename T>
+	inline void FileSinkFunction<T>::execute(token_vector_t& input, ResultSink& sink) const {
+		sink.accept(execute(input));
+	}
+
+	/**
+	 * @brief Aggiunge al grafo un nodo che scrive i token di tipo T sul
+	 * 			FileSink. Il sink può essere condiviso da più nodi e da più
+	 * 			esecuzioni, e va chiuso dopo l'ultima.
+	 *
+	 * @tparam T il tipo dei token scritti
+	 * @param graph il grafo
+	 * @param sink il file di destinazione
+	 * @return l'istruzione che incapsula il nodo creato
+	 */
+	template <typename T>
+	inline Instruction file_sink(Mdf& graph, std::shared_ptr<FileSink> sink) {
+		return graph.emplace_function(std::make_shared<FileSinkFunction<T>>(std::move(sink)));
+	}
+
+}
+
+#endif /* FILE_SINK_HPP */
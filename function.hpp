@@ -2,14 +2,56 @@
 #define FUNCTION_HPP
 
 #include "token.hpp"
+#include "pool.hpp"
+#include "memory.hpp"
+#include "serialization.hpp"
 #include <memory>
 #include <vector>
 #include <type_traits>
+#include <typeinfo>
+#include <exception>
+#include <array>
 
 namespace mdf {
 	
 	//Alias
-	typedef std::vector<std::shared_ptr<Token>> token_vector_t;
+	typedef std::pmr::vector<std::shared_ptr<Token>> token_vector_t;
+	
+	/**
+	 * @brief Ritorna un vettore di token vuoto preso dalla pool
+	 * 
+	 * @param capacity la capacità minima del vettore
+	 */
+	inline token_vector_t* acquire_token_vector(size_t capacity) {
+		token_vector_t* tokens = ObjectPool<token_vector_t>::instance().acquire();
+		tokens -> reserve(capacity);
+		
+		return tokens;
+	}
+	
+	/**
+	 * @brief Svuota il vettore di token e lo restituisce alla pool
+	 */
+	inline void release_token_vector(token_vector_t* tokens) {
+		tokens -> clear();
+		ObjectPool<token_vector_t>::instance().release(tokens);
+	}
+	
+	/**
+	 * @brief Porta nella pool almeno count vettori di token con la capacità data
+	 */
+	inline void reserve_token_vectors(size_t count, size_t capacity) {
+		std::vector<token_vector_t*> tokens;
+		tokens.reserve(count);
+		
+		for(size_t i = 0; i < count; i++) {
+			tokens.push_back(acquire_token_vector(capacity));
+		}
+		
+		for(token_vector_t*& vector : tokens) {
+			release_token_vector(vector);
+		}
+	}
 	
 	/**
 	 * @struct CallTuple
@@ -49,7 +91,7 @@ namespace mdf {
 		inline void operator() 
 		(std::tuple<Ts...>& t, token_vector_t* output) 
 		{ 
-			output -> insert(output -> begin(), std::make_shared<TokenSlot<typename std::tuple_element<index, std::tuple<Ts...>>::type>>(std::get<index>(t)));
+			output -> insert(output -> begin(), make_token<typename std::tuple_element<index, std::tuple<Ts...>>::type>(std::get<index>(t)));
 			TransferOutputTokens<index - 1, Ts...>{}(t, output);	 
 		}
 	};
@@ -59,7 +101,7 @@ namespace mdf {
 		inline void operator() 
 		(std::tuple<Ts...>& t, token_vector_t* output) 
 		{
-			output -> insert(output -> begin(), std::make_shared<TokenSlot<typename std::tuple_element<0, std::tuple<Ts...>>::type>>(std::get<0>(t)));	 
+			output -> insert(output -> begin(), make_token<typename std::tuple_element<0, std::tuple<Ts...>>::type>(std::get<0>(t)));	 
 		}
 	};	
 	
@@ -73,6 +115,53 @@ namespace mdf {
 		using Type = T;
 	};
 	
+	/**
+	 * @class ResultSink
+	 * @brief Destinazione del risultato di un nodo di output che evita la
+	 * 			conversione dei valori in Token.
+	 */
+	class ResultSink {
+	public:
+	
+		virtual ~ResultSink() = default;
+		
+		/**
+		 * @brief Rilascia il sink al termine dell'esecuzione
+		 */
+		virtual void dispose() {
+			delete this;
+		}
+		
+		/**
+		 * @brief Riceve la tupla restituita dalla callable
+		 * 
+		 * @param result puntatore alla tupla, il suo contenuto può essere spostato
+		 * @param type il tipo della tupla
+		 */
+		virtual void accept(void* result, const std::type_info& type) = 0;
+		
+		/**
+		 * @brief Riceve il risultato di un nodo che produce solo Token
+		 * 
+		 * @param tokens il vettore di Token, viene liberato
+		 */
+		virtual void accept(token_vector_t* tokens) = 0;
+		
+		/**
+		 * @brief Consegna il risultato ricevuto al chiamante. Viene invocato
+		 * 			dopo la restituzione dell'istanza al grafo, che il chiamante
+		 * 			può distruggere non appena il risultato è pronto.
+		 */
+		virtual void complete() {}
+		
+		/**
+		 * @brief Consegna al chiamante l'errore di un'esecuzione che non
+		 * 			può essere completata
+		 */
+		virtual void fail(std::exception_ptr error) = 0;
+		
+	};
+	
 	/**
 	 * @class Function
 	 * @brief La classe Function è una classe astratta per implementare
@@ -101,6 +190,32 @@ namespace mdf {
 		 */
 		virtual token_vector_t* execute(token_vector_t& input) const = 0;
 		
+		/**
+		 * @brief Esegue la Function consegnando la tupla restituita dalla
+		 * 			callable direttamente al sink
+		 * 
+		 * @param input Il vettore di token contenente gli argomenti di input
+		 * @param sink La destinazione del risultato
+		 */
+		virtual void execute(token_vector_t& input, ResultSink& sink) const = 0;
+		
+		/**
+		 * @brief Ritorna il codec del token di input di indice dato, o
+		 * 			nullptr se il suo tipo non è serializzabile
+		 */
+		virtual const TokenCodec* input_codec(size_t) const {
+			return nullptr;
+		}
+		
+		/**
+		 * @brief Ritorna il tipo della Function se la sua callable non ha
+		 * 			stato, così che due Function dello stesso tipo calcolino
+		 * 			lo stesso valore; nullptr se conta l'istanza
+		 */
+		virtual const std::type_info* stateless_type() const {
+			return nullptr;
+		}
+		
 		/**
 		* @brief Crea una nuova Function
 		* 
@@ -132,6 +247,12 @@ namespace mdf {
 		size_t get_output_size() const;
 		
 		token_vector_t* execute(token_vector_t& input) const;
+		
+		void execute(token_vector_t& input, ResultSink& sink) const;
+		
+		const TokenCodec* input_codec(size_t index) const;
+		
+		const std::type_info* stateless_type() const;
 	
 	private:
 	
@@ -151,11 +272,12 @@ namespace mdf {
 		size_t get_arity() const { return 0; }
 		size_t get_output_size() const { return 0; }
 		token_vector_t* execute(token_vector_t& input) const { return nullptr; }
+		void execute(token_vector_t&, ResultSink&) const {}
 	};
 
 	template <typename C, typename ... Args>
 	std::shared_ptr<Function> Function::function_create(C && callable, Param<Args> && ... params) {
-		return std::make_shared<FunctionImp<C, Args...>>(std::forward<C>(callable), std::forward<Param<Args>>(params)...);
+		return make_resource_shared<FunctionImp<C, Args...>>(std::forward<C>(callable), std::forward<Param<Args>>(params)...);
 	}
 	
 	template <typename C, typename ... Args>
@@ -176,6 +298,28 @@ namespace mdf {
 		return _output_size;
 	}
 	
+	template <typename C, typename ... Args>
+	const TokenCodec* FunctionImp<C, Args...>::input_codec(size_t index) const {
+		static const std::array<const TokenCodec*, sizeof...(Args)> codecs{token_codec<Args>()...};
+		
+		return index < codecs.size() ? codecs[index] : nullptr;
+	}
+	
+	/**
+	 * Una callable vuota, come una lambda senza catture, è identificata
+	 * dal suo tipo e da quello degli argomenti, qualunque sia il modo in
+	 * cui è stata passata.
+	 */
+	template <typename C, typename ... Args>
+	const std::type_info* FunctionImp<C, Args...>::stateless_type() const {
+		using callable_t = typename std::decay<C>::type;
+		
+		if constexpr (std::is_empty<callable_t>::value)
+			return &typeid(FunctionImp<callable_t, Args...>);
+		else
+			return nullptr;
+	}
+	
 	/**
 	 * @brief Trasferisce gli elementi di una tupla in un vettore di Token
 	 * 
@@ -191,14 +335,19 @@ namespace mdf {
 	
 	template <typename C, typename ... Args>
 	token_vector_t* FunctionImp<C, Args...>::execute(token_vector_t& input) const {
-		token_vector_t* output_vector = new token_vector_t();
-		output_vector -> reserve(_output_size);
+		token_vector_t* output_vector = acquire_token_vector(_output_size);
 		
 		auto ret_tuple = call(_callable, _args_tuple, input);
 		send_output(ret_tuple, output_vector);
 		
 		return output_vector;
 	}
+	
+	template <typename C, typename ... Args>
+	void FunctionImp<C, Args...>::execute(token_vector_t& input, ResultSink& sink) const {
+		auto ret_tuple = call(_callable, _args_tuple, input);
+		sink.accept(&ret_tuple, typeid(ret_tuple));
+	}
 	  
     /**
      * @brief Invoca la callable su una lista di argomenti
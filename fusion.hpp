@@ -0,0 +1,318 @@
+#ifndef FUSION_HPP
+#define FUSION_HPP
+
+#include <unordered_map>
+#include "mdf.hpp"
+
+namespace mdf {
+
+	/**
+	 * @class MdfGroup
+	 * @brief Raggruppa più grafi che ricevono lo stesso input.
+	 * I nodi strutturalmente identici (stessa callable e stessi produttori,
+	 * riconosciuti tramite impronta) vengono fusi in un unico grafo, così
+	 * che i prefissi comuni siano calcolati una sola volta per esecuzione.
+	 * I token condivisi da più grafi vengono replicati con nodi di split e
+	 * un nodo di merge finale raccoglie gli output di tutti i grafi.
+	 *
+	 * @note Le callable senza stato, come le lambda senza catture, sono
+	 * 		riconosciute dal tipo: grafi costruiti con chiamate separate di
+	 * 		emplace_back con la stessa callable vengono fusi. Le callable
+	 * 		con stato vengono fuse solo se i nodi condividono la stessa
+	 * 		Function, ad esempio perché uno è stato clonato dall'altro con
+	 * 		Mdf::emplace_back(Instruction&).
+	 */
+	class MdfGroup {
+
+		friend class Executor;
+		friend struct GroupResult;
+
+	public:
+
+		/**
+		 * @param resource la risorsa da cui allocare il grafo fuso, nullptr
+		 * 			per la risorsa di default
+		 */
+		MdfGroup(std::pmr::memory_resource* resource = nullptr);
+
+		MdfGroup(const MdfGroup &) = delete;
+
+		/**
+		 * @brief Aggiunge un grafo al gruppo
+		 *
+		 * @param graph il grafo, deve restare valido finché il gruppo è in uso
+		 * @return la posizione del risultato del grafo nel vettore dei risultati
+		 */
+		size_t add(Mdf& graph);
+
+		/**
+		 * @brief Ritorna il numero di grafi del gruppo
+		 */
+		size_t size() const;
+
+		/**
+		 * @brief Ritorna il numero di nodi risparmiati dalla fusione
+		 */
+		size_t shared_nodes() const;
+
+		/**
+		 * @brief Costruisce e controlla il grafo fuso.
+		 * Dopo la validazione non è più possibile aggiungere grafi.
+		 */
+		void validate();
+
+	private:
+
+		/**
+		 * @struct FusedKey
+		 * @brief Descrive un nodo del grafo fuso per il confronto esatto
+		 * 			dei nodi con la stessa impronta
+		 */
+		struct FusedKey {
+			node_type 		_type;
+
+			/**
+			 * @brief La Function del nodo, se la callable ha stato
+			 */
+			const Function* _function;
+
+			/**
+			 * @brief Il tipo della Function, se la callable non ha stato
+			 */
+			const std::type_info* _stateless;
+			size_t			_input_size;
+			size_t			_output_size;
+			token_map_t		_inputs;
+
+			bool operator == (const FusedKey& other) const;
+		};
+
+		size_t fuse_node(Graph& graph, size_t node_id, uint64_t fingerprint, const token_map_t& inputs);
+
+		void connect(std::vector<std::vector<token_map_t>>& consumers);
+
+		static std::vector<token_vector_t*> split_result(token_vector_t& tokens, const std::vector<size_t>& output_sizes);
+
+		std::vector<Mdf*> 	_graphs;
+
+		Mdf					_fused;
+
+		std::vector<FusedKey>						_keys;
+
+		std::unordered_multimap<uint64_t, size_t>	_fingerprints;
+
+		std::vector<size_t>	_output_sizes;
+
+		size_t				_original_nodes;
+
+		bool				_valid;
+
+	};
+
+	inline MdfGroup::MdfGroup(std::pmr::memory_resource* resource) :
+		_fused(resource),
+		_original_nodes{0},
+		_valid{false}
+	{}
+
+	inline bool MdfGroup::FusedKey::operator == (const FusedKey& other) const {
+		return _type == other._type &&
+			(_stateless != nullptr && other._stateless != nullptr ?
+				*_stateless == *other._stateless : _function == other._function) &&
+			_input_size == other._input_size &&
+			_output_size == other._output_size &&
+			_inputs == other._inputs;
+	}
+
+	inline size_t MdfGroup::add(Mdf& graph) {
+		if (_valid)
+			throw std::invalid_argument("Il gruppo non può più essere modificato");
+
+		_graphs.push_back(&graph);
+
+		return _graphs.size() - 1;
+	}
+
+	inline size_t MdfGroup::size() const {
+		return _graphs.size();
+	}
+
+	inline size_t MdfGroup::shared_nodes() const {
+		return _original_nodes - _keys.size();
+	}
+
+	/**
+	 * @brief Ritorna il nodo del grafo fuso equivalente al nodo dato,
+	 * 			creandolo se non esiste
+	 *
+	 * @param graph il grafo del nodo
+	 * @param node_id l'id del nodo
+	 * @param fingerprint l'impronta del nodo
+	 * @param inputs i produttori dei token di input, già tradotti in id del grafo fuso
+	 */
+	inline size_t MdfGroup::fuse_node(Graph& graph, size_t node_id, uint64_t fingerprint, const token_map_t& inputs) {
+		Node& node = *graph._nodes[node_id];
+
+		const std::type_info* stateless = node._type == STANDARD ? node._function -> stateless_type() : nullptr;
+
+		FusedKey key{node._type,
+			node._type == STANDARD && stateless == nullptr ? node._function.get() : nullptr,
+			stateless,
+			node._input_size,
+			node._output_size,
+			inputs};
+
+		auto range = _fingerprints.equal_range(fingerprint);
+
+		for(auto it = range.first; it != range.second; ++it) {
+			if (_keys[it -> second] == key)
+				return it -> second;
+		}
+
+		Instruction source(node, reinterpret_cast<uintptr_t>(&graph));
+		size_t fused_id = _fused.emplace_back(source)();
+
+		_keys.push_back(std::move(key));
+		_fingerprints.emplace(fingerprint, fused_id);
+
+		return fused_id;
+	}
+
+	/**
+	 * @brief Collega i nodi del grafo fuso. Un output destinato a più
+	 * 			consumatori passa da un nodo di split.
+	 *
+	 * @param consumers per ogni nodo e ogni suo output, i token di destinazione
+	 */
+	inline void MdfGroup::connect(std::vector<std::vector<token_map_t>>& consumers) {
+		Graph& fused = *_fused._graph;
+
+		for(size_t id = 0; id < consumers.size(); id++) {
+			Instruction producer(*fused._nodes[id], _fused._graph_id);
+
+			for(token_map_t& targets : consumers[id]) {
+				std::sort(targets.begin(), targets.end());
+				targets.erase(std::unique(targets.begin(), targets.end()), targets.end());
+
+				if (targets.size() == 1) {
+					_fused.add_output(producer, std::move(targets.front()));
+					continue;
+				}
+
+				Instruction split = _fused.split_node(targets.size());
+				_fused.add_output(producer, {split(), 0});
+
+				for(auto& target : targets) {
+					_fused.add_output(split, std::move(target));
+				}
+			}
+		}
+	}
+
+	inline void MdfGroup::validate() {
+		if (_valid)
+			return;
+
+		if (_graphs.empty())
+			throw std::invalid_argument("Il gruppo non contiene grafi");
+
+		std::vector<std::vector<size_t>> fused_ids(_graphs.size());
+		token_map_t outputs;
+		int input_node = -1;
+
+		for(size_t g = 0; g < _graphs.size(); g++) {
+			_graphs[g] -> validate();
+
+			Graph& graph = *_graphs[g] -> _graph;
+			std::vector<uint64_t> fingerprints = graph.node_fingerprints();
+			std::vector<token_map_t> sources   = graph.sources();
+
+			fused_ids[g].resize(graph._nodes.size());
+			_original_nodes += graph._nodes.size();
+
+			for(const size_t& id : graph.topological_order()) {
+				token_map_t inputs;
+				inputs.reserve(sources[id].size());
+
+				for(const auto& source : sources[id]) {
+					inputs.emplace_back(fused_ids[g][std::get<0>(source)], std::get<1>(source));
+				}
+
+				fused_ids[g][id] = fuse_node(graph, id, fingerprints[id], inputs);
+			}
+
+			int fused_input = fused_ids[g][graph._input_node];
+
+			if (input_node != -1 && input_node != fused_input)
+				throw std::invalid_argument("I grafi devono condividere il nodo di input");
+
+			input_node = fused_input;
+
+			size_t output = fused_ids[g][graph._output_node];
+			size_t output_size = graph._nodes[graph._output_node] -> _output_size;
+
+			outputs.emplace_back(output, output_size);
+			_output_sizes.push_back(output_size);
+		}
+
+		std::vector<std::vector<token_map_t>> consumers(_keys.size());
+
+		for(size_t id = 0; id < _keys.size(); id++) {
+			consumers[id].resize(_keys[id]._output_size);
+
+			for(size_t slot = 0; slot < _keys[id]._inputs.size(); slot++) {
+				const auto& source = _keys[id]._inputs[slot];
+				consumers[std::get<0>(source)][std::get<1>(source)].emplace_back(id, slot);
+			}
+		}
+
+		size_t collector_size = 0;
+
+		for(const size_t& size : _output_sizes) {
+			collector_size += size;
+		}
+
+		Instruction collector = _fused.merge_node(collector_size);
+		size_t slot = 0;
+
+		for(const auto& output : outputs) {
+			for(size_t i = 0; i < std::get<1>(output); i++) {
+				consumers[std::get<0>(output)][i].emplace_back(collector(), slot++);
+			}
+		}
+
+		connect(consumers);
+
+		Instruction input(*_fused._graph -> _nodes[input_node], _fused._graph_id);
+
+		_fused.mark_as_input(input);
+		_fused.mark_as_output(collector);
+		_fused.validate();
+
+		_valid = true;
+	}
+
+	/**
+	 * @brief Divide il risultato del grafo fuso in un vettore di token per
+	 * 			ogni grafo del gruppo
+	 *
+	 * @param tokens i token raccolti dal nodo di merge finale
+	 * @param output_sizes la dimensione dell'output di ogni grafo
+	 */
+	inline std::vector<token_vector_t*> MdfGroup::split_result(token_vector_t& tokens, const std::vector<size_t>& output_sizes) {
+		std::vector<token_vector_t*> results;
+		auto first = tokens.begin();
+
+		results.reserve(output_sizes.size());
+
+		for(const size_t& size : output_sizes) {
+			results.push_back(new token_vector_t(first, first + size));
+			first += size;
+		}
+
+		return results;
+	}
+
+}
+
+#endif /* FUSION_HPP */
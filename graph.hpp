@@ -11,17 +11,38 @@
 #include <list> 
 #include <limits.h> 
 #include <math.h>
+#include <chrono>
+#include <queue>
+#include <mutex>
 
 namespace mdf {
 	
 	//Forward Declaration
 	class Instruction;
 	class Mdf;
+	class MdfGroup;
+	class Pipeline;
+	struct GraphHandler;
+	class SpillManager;
+	class CheckpointManager;
+	class ProcessExecutor;
+	class DistributedExecutor;
+	class Partition;
+	class GraphAnalysis;
+	class Simulator;
+	class RunRecorder;
+	struct RunTrace;
+	class RunLog;
+	class GraphDot;
+	struct CounterReport;
+	class MetricsExporter;
+	class LatencySampler;
+	struct MicroBench;
 	
 	//Alias
-	typedef std::vector<std::pair<size_t, size_t>> token_map_t;
+	typedef std::pmr::vector<std::pair<size_t, size_t>> token_map_t;
 	
-	typedef std::vector<size_t> node_vector_t;
+	typedef std::pmr::vector<size_t> node_vector_t;
 
 	struct Bitmask {
 	public:
@@ -30,13 +51,14 @@ namespace mdf {
 		
 		uint32_t _n;
 		unsigned _array_size;
-		std::vector<uint32_t> _array;
+		std::pmr::vector<uint32_t> _array;
 		
-		Bitmask(uint32_t n)
+		Bitmask(uint32_t n) :
+			_array(current_resource())
 		{
 			_n = n;
 			_array_size = (int) ceil((double) n / 32.0);
-			_array = std::vector<uint32_t>(_array_size, 0x0);
+			_array.assign(_array_size, 0x0);
 			if (n % 32 != 0)
 				LAST_MASK = ((1 << (n % 32)) - 1);
 		}
@@ -54,7 +76,7 @@ namespace mdf {
 		}
 		
 		bool all_set() {
-			for(int i = 0; i < (int) _array_size - 2; i++) {
+			for(int i = 0; i < (int) _array_size - 1; i++) {
 				if (_array[i] != MASK) 
 					return false;
 			}
@@ -73,13 +95,131 @@ namespace mdf {
 
 	};
 		
+	/**
+	 * @struct NodeStats
+	 * @brief Statistiche sul costo di esecuzione di un nodo.
+	 * Sono condivise tra il nodo del grafo modello e le sue copie nelle
+	 * istanze, così che ogni esecuzione aggiorni il profilo del modello.
+	 */
+	struct NodeStats {
+		
+		/**
+		 * @brief Numero minimo di campioni perché il costo sia considerato noto
+		 */
+		static const uint64_t MIN_SAMPLES = 8;
+		
+		std::atomic<uint64_t> _count{0};
+		
+		std::atomic<uint64_t> _total_ns{0};
+		
+		/**
+		 * @brief Media mobile esponenziale (peso 1/8) del tempo di esecuzione
+		 */
+		std::atomic<uint64_t> _ewma_ns{0};
+		
+		/**
+		 * @brief Costo dichiarato con Mdf::set_cost, 0 se assente
+		 */
+		std::atomic<uint64_t> _annotated_ns{0};
+		
+		/**
+		 * @brief Numero e tempo totale delle attese in coda del nodo,
+		 * 			dall'accodamento all'avvio. I nodi eseguiti dallo stesso
+		 * 			worker del predecessore non passano dalla coda.
+		 */
+		std::atomic<uint64_t> _waits{0};
+		
+		std::atomic<uint64_t> _wait_ns{0};
+		
+		/**
+		 * @brief Esecuzioni misurate con i contatori hardware e i loro
+		 * 			totali, vedi Executor::set_hardware_counters
+		 */
+		std::atomic<uint64_t> _counted{0};
+		
+		std::atomic<uint64_t> _cycles{0};
+		
+		std::atomic<uint64_t> _instructions{0};
+		
+		std::atomic<uint64_t> _llc_misses{0};
+		
+		std::atomic<uint64_t> _branch_misses{0};
+		
+		/**
+		 * @brief Costo usato dall'ultimo clustering, negativo se ignoto
+		 */
+		double _clustered_cost{-1};
+		
+		void record(uint64_t ns) {
+			uint64_t n 	  = _count.fetch_add(1, std::memory_order_relaxed);
+			uint64_t ewma = _ewma_ns.load(std::memory_order_relaxed);
+			
+			_total_ns.fetch_add(ns, std::memory_order_relaxed);
+			
+			// aggiornamento non atomico: un campione perso non altera la stima
+			_ewma_ns.store(n == 0 ? ns : ewma - (ewma >> 3) + (ns >> 3), std::memory_order_relaxed);
+		}
+		
+		bool known() const {
+			return _count.load(std::memory_order_relaxed) >= MIN_SAMPLES;
+		}
+		
+		/**
+		 * @brief Ritorna il costo stimato in nanosecondi, negativo se ignoto
+		 */
+		double cost() const {
+			return known() ? (double) _ewma_ns.load(std::memory_order_relaxed) : -1;
+		}
+		
+		/**
+		 * @brief Ritorna il costo dichiarato in nanosecondi, negativo se assente
+		 */
+		double annotated_cost() const {
+			uint64_t ns = _annotated_ns.load(std::memory_order_relaxed);
+			return ns > 0 ? (double) ns : -1;
+		}
+		
+		double mean_ns() const {
+			uint64_t n = _count.load(std::memory_order_relaxed);
+			return n == 0 ? 0 : (double) _total_ns.load(std::memory_order_relaxed) / n;
+		}
+		
+		void record_wait(uint64_t ns) {
+			_waits.fetch_add(1, std::memory_order_relaxed);
+			_wait_ns.fetch_add(ns, std::memory_order_relaxed);
+		}
+		
+		double mean_wait_ns() const {
+			uint64_t n = _waits.load(std::memory_order_relaxed);
+			return n == 0 ? 0 : (double) _wait_ns.load(std::memory_order_relaxed) / n;
+		}
+		
+		void record_counters(uint64_t cycles, uint64_t instructions, uint64_t llc_misses, uint64_t branch_misses) {
+			_counted.fetch_add(1, std::memory_order_relaxed);
+			_cycles.fetch_add(cycles, std::memory_order_relaxed);
+			_instructions.fetch_add(instructions, std::memory_order_relaxed);
+			_llc_misses.fetch_add(llc_misses, std::memory_order_relaxed);
+			_branch_misses.fetch_add(branch_misses, std::memory_order_relaxed);
+		}
+		
+	};
+		
+	/**
+	 * @struct NullTracker
+	 * @brief Osservatore dei token consegnati che non fa nulla
+	 */
+	struct NullTracker {
+		template <typename N>
+		void track(N&, size_t) {}
+	};
+		
 	enum node_type {
 		STANDARD,
 		SPLIT,
 		MERGE
 	};
 	
-	class Node {
+	class Node : public ResourceAllocated {
 		
 		friend class Instruction;
 		
@@ -87,8 +227,42 @@ namespace mdf {
 		
 		friend class Mdf;		
 		
+		friend class MdfGroup;
+		
+		friend class Pipeline;
+		
 		friend class Executor;
 		
+		friend class SpillManager;
+		
+		friend class CheckpointManager;
+		
+		friend class ProcessExecutor;
+		
+		friend class DistributedExecutor;
+		
+		friend class Partition;
+		
+		friend class GraphAnalysis;
+		
+		friend class Simulator;
+		
+		friend class RunRecorder;
+		
+		friend struct RunTrace;
+		
+		friend class RunLog;
+		
+		friend class GraphDot;
+		
+		friend struct CounterReport;
+		
+		friend class MetricsExporter;
+		
+		friend class LatencySampler;
+		
+		friend struct MicroBench;
+		
 	public:
 	
 		Node(Node& node);
@@ -103,6 +277,10 @@ namespace mdf {
 		
 		token_vector_t* execute();
 		
+		void execute(ResultSink& sink);
+		
+		void reset();
+		
 		size_t	successors_count() const;
 			
 		size_t	dependents_count() const;
@@ -129,6 +307,22 @@ namespace mdf {
 			
 		std::shared_ptr<Function> _function;
 		
+		std::shared_ptr<NodeStats> _stats;
+		
+		/**
+		 * @brief Id del nodo radice del cluster a cui appartiene il nodo.
+		 * I nodi dello stesso cluster vengono eseguiti dallo stesso worker
+		 * senza passare dalla coda dei job.
+		 */
+		size_t _cluster;
+		
+		/**
+		 * @brief Il gruppo di processi che esegue il nodo con il 
+		 * 			ProcessExecutor, o la partizione con il 
+		 * 			DistributedExecutor; 0 per il processo principale
+		 */
+		size_t _process;
+		
 		size_t _input_size;
 		
 		size_t _output_size;
@@ -141,29 +335,68 @@ namespace mdf {
 		
 	};	
 	
-	class Graph {
+	class Graph : public ResourceAllocated {
 		
 		friend class Mdf;
+		friend class MdfGroup;
+		friend class Pipeline;
 		friend class Executor;
+		friend struct GraphHandler;
+		friend class CheckpointManager;
+		friend class ProcessExecutor;
+		friend class DistributedExecutor;
+		friend class Partition;
+		friend class GraphAnalysis;
+		friend class Simulator;
+		friend class RunRecorder;
+		friend struct RunTrace;
+		friend class RunLog;
+		friend class GraphDot;
+		friend struct CounterReport;
+		friend class MetricsExporter;
+		friend class LatencySampler;
+		friend struct MicroBench;
 		
 	public:
 	
-		Graph() :
+		/**
+		 * @param resource la risorsa da cui allocare nodi, archi e istanze
+		 */
+		Graph(std::pmr::memory_resource* resource = std::pmr::get_default_resource()) :
+			_nodes(resource),
 			_input_node{-1},
 			_output_node{-1},
-			_counter{0}
+			_counter{0},
+			_free_instances(resource),
+			_resource{resource}
 		{};
 		
 		Graph(const Graph& other);
 		
 		Graph(Graph&& other);
 		
+		~Graph();
+		
 	private:
 	
+		Graph* acquire_instance();
+		
+		void reserve_instances(size_t n);
+		
+		void release_instance(Graph* instance);
+		
+		/**
+		 * @brief Rilascia un riferimento al modello, distruggendolo con
+		 * 			l'ultimo
+		 */
+		static void drop(Graph* model);
+		
+		static PoolTally& instance_tally();
+	
 		template <typename ... Args>
 		void send_input_tokens(Args && ... args);
 
-		std::vector<std::unique_ptr<Node>> _nodes;
+		std::pmr::vector<std::unique_ptr<Node>> _nodes;
 		
 		int _output_node;
 		
@@ -176,6 +409,8 @@ namespace mdf {
 		
 		Node& emplace_back(Node& instruction);
 		
+		Node& emplace_function(std::shared_ptr<Function>& function);
+		
 		Node& merge_node(size_t input);
 		
 		Node& split_node(size_t output);
@@ -184,25 +419,69 @@ namespace mdf {
 		
 		void mark_as_output(Node& node);
 		
-		void transfer_tokens(token_vector_t* output, token_map_t& output_map);
+		template <typename Tracker = NullTracker>
+		void transfer_tokens(token_vector_t* output, token_map_t& output_map, Tracker&& tracker = Tracker());
 		
 		void check_node(size_t id, bool* visited, bool* stack);
 		
 		void check_graph();
 		
+		std::vector<node_vector_t> predecessors() const;
+		
+		std::vector<token_map_t> sources() const;
+		
+		std::vector<uint64_t> node_fingerprints() const;
+		
+		std::vector<size_t> topological_order() const;
+		
+		size_t cluster(std::chrono::nanoseconds grain);
+		
+		const TokenCodec* slot_codec(size_t node_id, size_t slot) const;
+		
+		bool cost_drifted(double threshold);
+		
+		std::atomic<size_t> _runs{0};
+		
+		/**
+		 * @brief Istanze libere del grafo, pronte per essere riutilizzate
+		 */
+		std::pmr::vector<Graph*> _free_instances;
+		
+		/**
+		 * @brief Protegge le istanze libere e il clustering dei nodi del
+		 * 			modello, che viene copiato nelle istanze acquisite
+		 */
+		std::mutex _instances_mutex;
+		
+		/**
+		 * @brief Riferimenti al modello: quello del Mdf e uno per ogni
+		 * 			istanza acquisita, così che il Mdf possa essere distrutto
+		 * 			mentre le sue esecuzioni sono in corso
+		 */
+		std::atomic<size_t> _references{1};
+		
+		std::pmr::memory_resource* _resource;
+		
 	};
 	
-	inline Node::Node(Node& node) {
-		_input_tokens	= token_vector_t(node._input_size);
+	inline Node::Node(Node& node) :
+		_input_tokens(node._input_size, current_resource())
+	{
 		_node_id 		= node._node_id;
 		_tokens_count 	= node._input_size;
 		_successors		= node._successors;
 		_dependents		= node._dependents;	
 		_output_map		= node._output_map;	
+		_input_size		= node._input_size;
 		_output_size	= node._output_size;
 		_function		= node._function;
+		_stats			= node._stats;
+		_cluster		= node._cluster;
+		_process		= node._process;
 		_is_output		= node._is_output;
+		_is_complete	= false;
 		_type			= node._type;
+		_processed.clear();
 	}
 	
 	inline Node::Node(size_t node_id, Node& node) {
@@ -213,10 +492,14 @@ namespace mdf {
 		_tokens_count 	= _input_size;
 		_output_size	= node._output_size;
 		_function		= node._function;		
-		_output_map 	= std::make_shared<token_map_t>();
-		_dependents		= std::make_shared<Bitmask>(_input_size);
-		_successors		= std::make_shared<node_vector_t>();
+		_output_map 	= make_resource_shared<token_map_t>();
+		_dependents		= make_resource_shared<Bitmask>(_input_size);
+		_successors		= make_resource_shared<node_vector_t>();
 		_type			= node._type;
+		_stats			= make_resource_shared<NodeStats>();
+		_cluster		= node_id;
+		_process		= 0;
+		_processed.clear();
 	}
 	
 	inline Node::Node(size_t node_id, std::shared_ptr<Function>& function) {
@@ -227,17 +510,21 @@ namespace mdf {
 		_output_size	= function -> get_output_size();
 		_tokens_count 	= _input_size;
 		_function		= function;
-		_output_map 	= std::make_shared<token_map_t>();
-		_dependents		= std::make_shared<Bitmask>(_input_size);
-		_successors		= std::make_shared<node_vector_t>();
+		_output_map 	= make_resource_shared<token_map_t>();
+		_dependents		= make_resource_shared<Bitmask>(_input_size);
+		_successors		= make_resource_shared<node_vector_t>();
 		_type 			= STANDARD;
+		_stats			= make_resource_shared<NodeStats>();
+		_cluster		= node_id;
+		_process		= 0;
+		_processed.clear();
 	}
 	
 	inline Node::Node(size_t node_id, node_type type, size_t size) {
 		_is_complete 	= false;
 		_is_output		= false;
 		_node_id 		= node_id;
-		_function		= std::make_shared<mdf::FunctionPlaceHolder>();
+		_function		= make_resource_shared<mdf::FunctionPlaceHolder>();
 		_type 			= type;	
 		
 		if (type == MERGE) {
@@ -249,9 +536,13 @@ namespace mdf {
 		}
 		
 		_tokens_count 	= _input_size;
-		_output_map 	= std::make_shared<token_map_t>();
-		_dependents		= std::make_shared<Bitmask>(_input_size);
-		_successors		= std::make_shared<node_vector_t>();
+		_output_map 	= make_resource_shared<token_map_t>();
+		_dependents		= make_resource_shared<Bitmask>(_input_size);
+		_successors		= make_resource_shared<node_vector_t>();
+		_stats			= make_resource_shared<NodeStats>();
+		_cluster		= node_id;
+		_process		= 0;
+		_processed.clear();
 	}
 			
 	inline token_vector_t*	Node::execute() {
@@ -263,16 +554,16 @@ namespace mdf {
 				return _function -> execute(_input_tokens);
 				
 			case MERGE:
-				vec = new token_vector_t();
-				vec -> push_back(std::make_shared<TokenSlot<token_vector_t>>(_input_tokens));
+				vec = acquire_token_vector(1);
+				// il vettore del token viene allocato dalla risorsa corrente
+				vec -> push_back(make_token<token_vector_t>(token_vector_t(
+					std::make_move_iterator(_input_tokens.begin()), std::make_move_iterator(_input_tokens.end()), current_resource())));
 				
 				return vec;
 				
 			case SPLIT:
-				vec = new token_vector_t(_output_size);
-				for(int i = 0; i < _output_size; i++) {
-					vec -> at(i) = _input_tokens[0];
-				}
+				vec = acquire_token_vector(_output_size);
+				vec -> assign(_output_size, _input_tokens[0]);
 				
 				return vec;
 			
@@ -282,6 +573,47 @@ namespace mdf {
 		
 		return nullptr;
 	}
+	
+	/**
+	 * @brief Riporta il nodo di un'istanza allo stato iniziale, liberando
+	 * 			i token ricevuti
+	 */
+	inline void Node::reset() {
+		if (_input_tokens.size() != _input_size)
+			_input_tokens.resize(_input_size);
+			
+		for(auto& token : _input_tokens) {
+			token.reset();
+		}
+		
+		_tokens_count = _input_size;
+		_processed.clear();
+	}
+	
+	/**
+	 * @brief Esegue il nodo consegnando il risultato al sink. I nodi 
+	 * 			standard consegnano la tupla della callable e i nodi di
+	 * 			merge spostano i loro token di input, senza creare Token.
+	 */
+	inline void Node::execute(ResultSink& sink) {
+		
+		std::tuple<token_vector_t> tokens{token_vector_t(current_resource())};
+		
+		switch(_type) {
+			case STANDARD:
+				_function -> execute(_input_tokens, sink);
+				break;
+				
+			case MERGE:
+				std::get<0>(tokens).assign(std::make_move_iterator(_input_tokens.begin()), std::make_move_iterator(_input_tokens.end()));
+				sink.accept(&tokens, typeid(tokens));
+				break;
+				
+			default:
+				sink.accept(execute());
+				break;
+		}
+	}
 		
 	inline size_t	Node::successors_count() const {
 		return _successors -> size();
@@ -303,7 +635,13 @@ namespace mdf {
 		return _is_output;
 	}
 	
-	inline Graph::Graph(const Graph& other) {
+	inline Graph::Graph(const Graph& other) :
+		_nodes(other._resource),
+		_free_instances(other._resource),
+		_resource{other._resource}
+	{
+		ResourceScope scope(_resource);
+		
 		_output_node = other._output_node;
 		_input_node = other._input_node;	
 		
@@ -312,36 +650,160 @@ namespace mdf {
 		}	
 	}
 		
-	inline Graph::Graph(Graph&& other) {
-		_nodes = std::move(other._nodes);
+	inline Graph::Graph(Graph&& other) :
+		_nodes(std::move(other._nodes)),
+		_free_instances(std::move(other._free_instances)),
+		_resource{other._resource}
+	{
 		_output_node = other._output_node;
 		_input_node = other._input_node;
 	}
 	
+	inline Graph::~Graph() {
+		for(Graph*& instance : _free_instances) {
+			delete instance;
+		}
+	}
 	
-	template<int index, typename... Ts>
-	struct transfer_input_tokens {
-		inline void operator() (std::tuple<Ts...>&& tuple, token_vector_t& vec) {
-			vec[index] = std::make_shared<TokenSlot<typename std::tuple_element<index, std::tuple<Ts...>>::type>>(std::get<index>(tuple));
-			transfer_input_tokens<index - 1, Ts...>{}(std::forward<std::tuple<Ts...>>(tuple), vec);
+	inline PoolTally& Graph::instance_tally() {
+		static PoolTally* tally = new PoolTally();
+		return *tally;
+	}
+	
+	/**
+	 * @brief Ritorna un'istanza del grafo pronta per l'esecuzione, 
+	 * 			riciclando un'istanza completata se disponibile. L'istanza
+	 * 			tiene un riferimento al modello fino a release_instance.
+	 */
+	inline Graph* Graph::acquire_instance() {
+		Graph* instance = nullptr;
+		
+		_references.fetch_add(1, std::memory_order_relaxed);
+		
+		// il clustering viene letto sotto il lock, vedi cluster()
+		std::lock_guard<std::mutex> lock(_instances_mutex);
+		
+		if (!_free_instances.empty()) {
+			instance = _free_instances.back();
+			_free_instances.pop_back();
 		}
-	};
-
-	template<typename... Ts>
-	struct transfer_input_tokens<0, Ts...> {
-		inline void operator() (std::tuple<Ts...>&& tuple, token_vector_t& vec) {
-			vec[0] = std::make_shared<TokenSlot<typename std::tuple_element<0, std::tuple<Ts...>>::type>>(std::get<0>(tuple));
+		
+		instance_tally().count(instance != nullptr);
+		PoolTally::total().count(instance != nullptr);
+		
+		if (instance == nullptr) {
+			ResourceScope scope(_resource);
+			return new Graph(*this);
 		}
+			
+		// il clustering del modello può essere cambiato
+		for(size_t i = 0; i < _nodes.size(); i++) {
+			instance -> _nodes[i] -> _cluster = _nodes[i] -> _cluster;
+		}
+		
+		return instance;
+	}
+	
+	/**
+	 * @brief Crea istanze finché quelle libere non sono almeno n
+	 */
+	inline void Graph::reserve_instances(size_t n) {
+		ResourceScope scope(_resource);
+		std::lock_guard<std::mutex> lock(_instances_mutex);
+		
+		_free_instances.reserve(n);
+		
+		while (_free_instances.size() < n) {
+			_free_instances.push_back(new Graph(*this));
+			
+			instance_tally().count(false);
+			PoolTally::total().count(false);
+		}
+	}
+	
+	/**
+	 * @brief Restituisce un'istanza completata, liberandone i token, e
+	 * 			rilascia il suo riferimento al modello
+	 */
+	inline void Graph::release_instance(Graph* instance) {
+		for(auto& node : instance -> _nodes) {
+			node -> reset();
+		}
+		
+		{
+			std::lock_guard<std::mutex> lock(_instances_mutex);
+			_free_instances.push_back(instance);
+		}
+		
+		drop(this);
+	}
+	
+	inline void Graph::drop(Graph* model) {
+		if (model -> _references.fetch_sub(1, std::memory_order_acq_rel) == 1)
+			delete model;
+	}
+	
+	/**
+	 * @struct Borrowed
+	 * @brief Argomento di input passato per riferimento, vedi borrow()
+	 */
+	template <typename T>
+	struct Borrowed {
+		T* _data;
 	};
+	
+	template <typename T>
+	struct is_borrowed : std::false_type {};
+	
+	template <typename T>
+	struct is_borrowed<Borrowed<T>> : std::true_type {};
+	
+	/**
+	 * @brief Passa un argomento di input per riferimento, senza copiarlo.
+	 * L'oggetto deve restare valido e non deve essere modificato dal
+	 * chiamante finché il future dell'esecuzione non è pronto.
+	 * Gli oggetti const non possono essere prestati: il nodo di input
+	 * legge il token come TokenSlot del tipo non qualificato.
+	 * 
+	 * @param data l'oggetto da passare al nodo di input
+	 */
+	template <typename T>
+	inline Borrowed<T> borrow(T& data) {
+		static_assert(!std::is_const<T>::value, "borrow() richiede un oggetto non const");
+		return Borrowed<T>{&data};
+	}
+	
+	/**
+	 * @brief Crea il token di un argomento di input: gli lvalue vengono
+	 * 			copiati, gli rvalue spostati e gli argomenti Borrowed 
+	 * 			referenziati senza copia
+	 */
+	template <typename T>
+	inline std::shared_ptr<Token> make_input_token(T&& data) {
+		using Type = typename std::decay<T>::type;
+		
+		if constexpr (is_borrowed<Type>::value) {
+			using Data = typename std::remove_pointer<decltype(data._data)>::type;
+			return make_token<Data>(typename TokenSlot<Data>::Borrow{}, *data._data);
+		} else {
+			return make_token<Type>(std::forward<T>(data));
+		}
+	}
 		 
 	template <typename ... Args>
 	inline void Graph::send_input_tokens(Args && ... args) {
-		const auto size = sizeof...(Args);
-		transfer_input_tokens<size - 1, Args...>{}(std::forward_as_tuple(args...), _nodes.at(_input_node) -> _input_tokens);
+		token_vector_t& tokens = _nodes.at(_input_node) -> _input_tokens;
+		size_t i = 0;
+		
+		if (tokens.size() != sizeof...(Args))
+			throw std::invalid_argument("Il numero degli argomenti non corrisponde all'input del grafo");
+		
+		((tokens[i++] = make_input_token(std::forward<Args>(args))), ...);
 	}
 	
 	template <typename C, typename ... Args>
 	inline Node& Graph::emplace_back(C && callable, Param<Args> && ... params) {
+		ResourceScope scope(_resource);
 		size_t id = _nodes.size();
 		std::shared_ptr<Function> foo = Function::function_create(std::forward<C>(callable), std::forward<Param<Args>>(params)...);
 		
@@ -350,13 +812,23 @@ namespace mdf {
 	}
 		
 	inline Node& Graph::emplace_back(Node& node) {
+		ResourceScope scope(_resource);
 		size_t id = _nodes.size();
 		
 		_nodes.push_back(std::make_unique<Node>(id, node));
 		return (*_nodes.back());		
 	}
 	
+	inline Node& Graph::emplace_function(std::shared_ptr<Function>& function) {
+		ResourceScope scope(_resource);
+		size_t id = _nodes.size();
+		
+		_nodes.push_back(std::make_unique<Node>(id, function));
+		return (*_nodes.back());
+	}
+	
 	inline Node& Graph::merge_node(size_t input) {
+		ResourceScope scope(_resource);
 		size_t id = _nodes.size();
 		
 		_nodes.push_back(std::make_unique<Node>(id, MERGE, input));
@@ -364,26 +836,42 @@ namespace mdf {
 	}
 	
 	inline Node& Graph::split_node(size_t output) {
+		ResourceScope scope(_resource);
 		size_t id = _nodes.size();
 		
 		_nodes.push_back(std::make_unique<Node>(id, SPLIT, output));
 		return (*_nodes.back());		
 	}
 	
-	inline void Graph::transfer_tokens(token_vector_t* output, token_map_t& output_map) {
+	/**
+	 * @brief Sposta i token di output nei nodi destinatari
+	 * 
+	 * @param output i token di output, il vettore viene liberato
+	 * @param output_map i destinatari di ogni token
+	 * @param tracker riceve track(node, slot) per ogni token consegnato ad
+	 * 			un nodo a cui ne mancano altri, prima del decremento del
+	 * 			suo contatore
+	 */
+	template <typename Tracker>
+	inline void Graph::transfer_tokens(token_vector_t* output, token_map_t& output_map, Tracker&& tracker) {
 		int i = 0;
 			
 		for(const auto & token_info : output_map) {
 			size_t node_id 	= std::get<0>(token_info);
 			size_t token_id = std::get<1>(token_info);
 				
-			token_vector_t & vec = _nodes.at(node_id) -> _input_tokens;
-			_nodes.at(node_id) -> _tokens_count.fetch_sub(1, std::memory_order_relaxed);
+			Node& node = *_nodes.at(node_id);
+			
+			// il token deve essere visibile prima che il contatore raggiunga zero
+			node._input_tokens[token_id] = std::move(output -> at(i++));
 			
-			vec[token_id] = output -> at(i++); 
+			if (node._tokens_count.load(std::memory_order_relaxed) > 1)
+				tracker.track(node, token_id);
+				
+			node._tokens_count.fetch_sub(1, std::memory_order_acq_rel);
 		}
 		
-		delete output;
+		release_token_vector(output);
 	}
 	
 	inline void Graph::check_node(size_t id, bool* visited, bool* stack) {
@@ -424,13 +912,220 @@ namespace mdf {
 		
 		check_node(_input_node, visited, stack);
 		
-		delete visited;
-		delete stack;
+		delete[] visited;
+		delete[] stack;
 		
 		if (_counter != _nodes.size()) 
 			throw std::invalid_argument("Non sono raggiungibili tutti i nodi"); 
 			
 	}
+	
+	inline std::vector<node_vector_t> Graph::predecessors() const {
+		std::vector<node_vector_t> preds(_nodes.size());
+		
+		for(const auto& node : _nodes) {
+			for(const size_t& next : *(node -> _successors)) {
+				preds[next].push_back(node -> _node_id);
+			}
+		}
+		
+		return preds;
+	}
+	
+	/**
+	 * @brief Ritorna, per ogni nodo, il produttore di ciascun token di input
+	 * 			come coppia (nodo, indice dell'output). Il nodo di input non
+	 * 			ha produttori.
+	 */
+	inline std::vector<token_map_t> Graph::sources() const {
+		std::vector<token_map_t> sources(_nodes.size());
+		
+		for(const auto& node : _nodes) {
+			if (node -> _node_id != (size_t) _input_node)
+				sources[node -> _node_id].resize(node -> _input_size);
+		}
+		
+		for(const auto& node : _nodes) {
+			size_t output_id = 0;
+			
+			for(const auto& token_info : *(node -> _output_map)) {
+				sources[std::get<0>(token_info)][std::get<1>(token_info)] = {node -> _node_id, output_id++};
+			}
+		}
+		
+		return sources;
+	}
+	
+	inline void hash_combine(uint64_t& seed, uint64_t value) {
+		seed ^= value + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2);
+	}
+	
+	/**
+	 * @brief Calcola l'impronta strutturale di ogni nodo.
+	 * L'impronta dipende dal tipo del nodo, dalla callable che incapsula e,
+	 * ricorsivamente, dalle impronte dei produttori dei suoi token di input:
+	 * due nodi con la stessa impronta calcolano lo stesso valore a parità
+	 * di input del grafo. Una callable senza stato è identificata dal suo
+	 * tipo, vedi Function::stateless_type, le altre dalla Function.
+	 */
+	inline std::vector<uint64_t> Graph::node_fingerprints() const {
+		std::vector<uint64_t> fingerprints(_nodes.size(), 0);
+		std::vector<token_map_t> inputs = sources();
+		
+		for(const size_t& id : topological_order()) {
+			const Node& node = *_nodes[id];
+			uint64_t seed 	 = node._type;
+			
+			hash_combine(seed, node._input_size);
+			hash_combine(seed, node._output_size);
+			
+			if (node._type == STANDARD) {
+				const std::type_info* type = node._function -> stateless_type();
+				
+				hash_combine(seed, type != nullptr ? type -> hash_code() : reinterpret_cast<uintptr_t>(node._function.get()));
+			}
+			
+			for(const auto& source : inputs[id]) {
+				hash_combine(seed, fingerprints[std::get<0>(source)]);
+				hash_combine(seed, std::get<1>(source));
+			}
+			
+			fingerprints[id] = seed;
+		}
+		
+		return fingerprints;
+	}
+	
+	inline std::vector<size_t> Graph::topological_order() const {
+		std::vector<size_t> order;
+		std::vector<size_t> missing(_nodes.size());
+		std::queue<size_t> ready;
+		
+		order.reserve(_nodes.size());
+		
+		for(const auto& node : _nodes) {
+			for(const size_t& next : *(node -> _successors)) {
+				missing[next]++;
+			}
+		}
+		
+		for(size_t i = 0; i < _nodes.size(); i++) {
+			if (missing[i] == 0)
+				ready.push(i);
+		}
+		
+		while (!ready.empty()) {
+			size_t id = ready.front();
+			ready.pop();
+			order.push_back(id);
+			
+			for(const size_t& next : *(_nodes[id] -> _successors)) {
+				if (--missing[next] == 0)
+					ready.push(next);
+			}
+		}
+		
+		return order;
+	}
+	
+	/**
+	 * @brief Raggruppa i nodi economici adiacenti in cluster più grossi.
+	 * Scorre i nodi in ordine topologico e aggiunge un nodo più economico 
+	 * della grana al cluster dei suoi predecessori quando questi appartengono
+	 * tutti allo stesso cluster e il costo accumulato del cluster è ancora 
+	 * sotto la grana. In questo 
+	 * modo ogni nodo del cluster diventa pronto solo dopo il completamento 
+	 * di altri nodi del cluster e può essere eseguito dallo stesso worker
+	 * senza alterare le dipendenze. I nodi di costo ignoto non vengono
+	 * raggruppati.
+	 * Prende il lock delle istanze, così che il clustering possa essere
+	 * rifatto mentre altri thread acquisiscono istanze del modello.
+	 * 
+	 * @param grain la grana minima desiderata per ogni task
+	 * @return il numero di task risultanti
+	 */
+	inline size_t Graph::cluster(std::chrono::nanoseconds grain) {
+		const double target = (double) grain.count();
+		std::lock_guard<std::mutex> lock(_instances_mutex);
+		
+		std::vector<node_vector_t> preds = predecessors();
+		std::vector<double> cluster_cost(_nodes.size(), -1);
+		size_t tasks = 0;
+		
+		for(const size_t& id : topological_order()) {
+			Node& node 	= *_nodes[id];
+			double cost = node._stats -> cost();
+			
+			node._stats -> _clustered_cost = cost;
+			node._cluster = id;
+			
+			if (cost >= 0 && cost < target && !preds[id].empty()) {
+				size_t root = _nodes[preds[id].front()] -> _cluster;
+				
+				bool same_cluster = std::all_of(preds[id].begin(), preds[id].end(), [&](size_t pred) {
+					return _nodes[pred] -> _cluster == root;
+				});
+				
+				if (same_cluster && cluster_cost[root] >= 0 && cluster_cost[root] < target) {
+					node._cluster = root;
+					cluster_cost[root] += cost;
+					continue;
+				}
+			}
+			
+			cluster_cost[id] = cost;
+			tasks++;
+		}
+		
+		return tasks;
+	}
+	
+	/**
+	 * @brief Ritorna il codec del token di input del nodo, o nullptr se il
+	 * 			tipo non è serializzabile. Un nodo di split inoltra il 
+	 * 			token, quindi il tipo è quello atteso dai suoi successori.
+	 */
+	inline const TokenCodec* Graph::slot_codec(size_t node_id, size_t slot) const {
+		const Node& node = *_nodes[node_id];
+		
+		if (node._type == STANDARD)
+			return node._function -> input_codec(slot);
+		
+		if (node._type == SPLIT) {
+			for(const auto& target : *node._output_map) {
+				const TokenCodec* codec = slot_codec(std::get<0>(target), std::get<1>(target));
+				
+				if (codec != nullptr)
+					return codec;
+			}
+		}
+		
+		return nullptr;
+	}
+	
+	/**
+	 * @brief Controlla se il profilo dei costi si è discostato da quello
+	 * 			usato per l'ultimo clustering
+	 * 
+	 * @param threshold la variazione relativa oltre la quale un costo 
+	 * 			è considerato cambiato
+	 */
+	inline bool Graph::cost_drifted(double threshold) {
+		std::lock_guard<std::mutex> lock(_instances_mutex);
+		
+		for(const auto& node : _nodes) {
+			double before = node -> _stats -> _clustered_cost;
+			double now 	  = node -> _stats -> cost();
+			
+			if ((before < 0) != (now < 0))
+				return true;
+				
+			if (before > 0 && fabs(now - before) / before > threshold)
+				return true;
+		}
+		
+		return false;
+	}
 		
 }
 	
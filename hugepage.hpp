@@ -0,0 +1,207 @@
+#ifndef HUGEPAGE_HPP
+#define HUGEPAGE_HPP
+
+#include <memory_resource>
+#include <mutex>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+namespace mdf {
+
+	/**
+	 * @class HugePageResource
+	 * @brief Risorsa che alloca da regioni di pagine da 2MB, pensata per lo
+	 * 			stato delle istanze di grafi grandi: nodi e token map di
+	 * 			un'istanza finiscono in poche pagine, riducendo i TLB miss
+	 * 			degli accessi sparsi di transfer_tokens.
+	 * Ogni regione viene chiesta prima con MAP_HUGETLB, poi come memoria
+	 * anonima allineata a 2MB con madvise(MADV_HUGEPAGE) e, se anche questo
+	 * fallisce o il sistema non è Linux, dalla risorsa di riserva.
+	 * Le allocazioni sono sequenziali e la memoria viene restituita al
+	 * sistema solo alla distruzione della risorsa, che deve quindi
+	 * sopravvivere ai grafi che la usano.
+	 */
+	class HugePageResource : public std::pmr::memory_resource {
+	public:
+
+		static constexpr size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+		/**
+		 * @brief Come sono state ottenute le pagine di una regione
+		 */
+		enum backing {
+			HUGETLB,
+			TRANSPARENT,
+			FALLBACK
+		};
+
+		/**
+		 * @param use_hugetlb se falso non tenta MAP_HUGETLB, che richiede
+		 * 			pagine riservate dall'amministratore (vm.nr_hugepages)
+		 * @param fallback la risorsa usata se le huge page non sono
+		 * 			disponibili, nullptr per la risorsa di default
+		 */
+		HugePageResource(bool use_hugetlb = true, std::pmr::memory_resource* fallback = nullptr);
+
+		HugePageResource(const HugePageResource &) = delete;
+
+		~HugePageResource();
+
+		/**
+		 * @brief Ritorna il numero di byte riservati con il tipo di pagine dato
+		 */
+		size_t reserved(backing type) const;
+
+		/**
+		 * @brief Ritorna il numero di byte allocati
+		 */
+		size_t used() const;
+
+	private:
+
+		struct Region {
+			char*	_begin;
+			size_t	_size;
+			backing	_backing;
+		};
+
+		void* do_allocate(size_t bytes, size_t alignment);
+
+		void do_deallocate(void*, size_t, size_t) {}
+
+		bool do_is_equal(const std::pmr::memory_resource& other) const noexcept {
+			return this == &other;
+		}
+
+		void map_region(size_t size);
+
+		mutable std::mutex 			_mutex;
+
+		std::vector<Region>			_regions;
+
+		std::pmr::memory_resource*	_fallback;
+
+		char* 	_cursor;
+
+		char* 	_end;
+
+		size_t 	_used;
+
+		bool	_use_hugetlb;
+
+	};
+
+	inline HugePageResource::HugePageResource(bool use_hugetlb, std::pmr::memory_resource* fallback) :
+		_fallback{fallback != nullptr ? fallback : std::pmr::get_default_resource()},
+		_cursor{nullptr},
+		_end{nullptr},
+		_used{0},
+		_use_hugetlb{use_hugetlb}
+	{}
+
+	inline HugePageResource::~HugePageResource() {
+		for(Region& region : _regions) {
+#if defined(__linux__)
+			if (region._backing != FALLBACK) {
+				munmap(region._begin, region._size);
+				continue;
+			}
+#endif
+			_fallback -> deallocate(region._begin, region._size, HUGE_PAGE_SIZE);
+		}
+	}
+
+	inline size_t HugePageResource::reserved(backing type) const {
+		std::lock_guard<std::mutex> lock(_mutex);
+		size_t total = 0;
+
+		for(const Region& region : _regions) {
+			if (region._backing == type)
+				total += region._size;
+		}
+
+		return total;
+	}
+
+	inline size_t HugePageResource::used() const {
+		std::lock_guard<std::mutex> lock(_mutex);
+		return _used;
+	}
+
+	inline void* HugePageResource::do_allocate(size_t bytes, size_t alignment) {
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		uintptr_t aligned = (reinterpret_cast<uintptr_t>(_cursor) + alignment - 1) & ~(uintptr_t) (alignment - 1);
+
+		if (_cursor == nullptr || aligned + bytes > reinterpret_cast<uintptr_t>(_end)) {
+			size_t size = (bytes + alignment + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+
+			map_region(size);
+			aligned = (reinterpret_cast<uintptr_t>(_cursor) + alignment - 1) & ~(uintptr_t) (alignment - 1);
+		}
+
+		_cursor = reinterpret_cast<char*>(aligned + bytes);
+		_used  += bytes;
+
+		return reinterpret_cast<void*>(aligned);
+	}
+
+	/**
+	 * @brief Riserva una nuova regione, multipla di HUGE_PAGE_SIZE, e la
+	 * 			rende la regione corrente
+	 */
+	inline void HugePageResource::map_region(size_t size) {
+		void* region = nullptr;
+		backing type = FALLBACK;
+
+#if defined(__linux__) && defined(MAP_HUGETLB)
+		if (_use_hugetlb) {
+			region = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+			type   = HUGETLB;
+
+			if (region == MAP_FAILED)
+				region = nullptr;
+		}
+#endif
+
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+		if (region == nullptr) {
+			// si riserva una pagina in più per allineare la regione a 2MB
+			char* raw = static_cast<char*>(mmap(nullptr, size + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+
+			if (raw != MAP_FAILED) {
+				char* begin = reinterpret_cast<char*>((reinterpret_cast<uintptr_t>(raw) + HUGE_PAGE_SIZE - 1) & ~(uintptr_t) (HUGE_PAGE_SIZE - 1));
+
+				if (begin != raw)
+					munmap(raw, begin - raw);
+
+				munmap(begin + size, raw + HUGE_PAGE_SIZE - begin);
+
+				if (madvise(begin, size, MADV_HUGEPAGE) == 0) {
+					region = begin;
+					type   = TRANSPARENT;
+				} else {
+					munmap(begin, size);
+				}
+			}
+		}
+#endif
+
+		if (region == nullptr) {
+			region = _fallback -> allocate(size, HUGE_PAGE_SIZE);
+			type   = FALLBACK;
+		}
+
+		_regions.push_back(Region{static_cast<char*>(region), size, type});
+		_cursor = static_cast<char*>(region);
+		_end 	= _cursor + size;
+	}
+
+}
+
+#endif /* HUGEPAGE_HPP */
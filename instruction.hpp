@@ -21,6 +21,7 @@ namespace mdf {
 		
 		friend class Graph;
 		friend class Mdf;
+		friend class MdfGroup;
 		
 	public:
 	
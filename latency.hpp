@@ -0,0 +1,296 @@
+#ifndef LATENCY_HPP
+#define LATENCY_HPP
+
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include "recorder.hpp"
+
+namespace mdf {
+
+	/**
+	 * @struct LatencySample
+	 * @brief La scomposizione della latenza di un'esecuzione, in nanosecondi.
+	 * Le componenti seguono il cammino critico osservato, risalendo dal nodo
+	 * di output attraverso il predecessore terminato per ultimo, e la loro
+	 * somma è la latenza totale.
+	 */
+	struct LatencySample {
+		uint64_t _total_ns = 0;
+
+		/**
+		 * @brief Dall'avvio dell'esecuzione all'avvio del nodo di input
+		 */
+		uint64_t _submission_ns = 0;
+
+		/**
+		 * @brief Esecuzione dei nodi del cammino critico
+		 */
+		uint64_t _compute_ns = 0;
+
+		/**
+		 * @brief Tra la fine di un nodo del cammino critico e l'avvio del
+		 * 			successivo: consegna dei token e attesa in coda
+		 */
+		uint64_t _scheduling_ns = 0;
+
+		/**
+		 * @brief Dalla fine del nodo di output a subito prima della consegna
+		 * 			del risultato, che non è inclusa
+		 */
+		uint64_t _handoff_ns = 0;
+	};
+
+	struct LatencyPercentiles {
+		uint64_t _p50 = 0;
+		uint64_t _p90 = 0;
+		uint64_t _p99 = 0;
+		uint64_t _max = 0;
+	};
+
+	/**
+	 * @struct LatencyReport
+	 * @brief I percentili delle componenti della latenza delle esecuzioni
+	 * 			campionate, vedi Executor::set_latency_sampling
+	 */
+	struct LatencyReport {
+
+		uint64_t 			_samples = 0;
+
+		LatencyPercentiles 	_total;
+
+		LatencyPercentiles 	_submission;
+
+		LatencyPercentiles 	_compute;
+
+		LatencyPercentiles 	_scheduling;
+
+		LatencyPercentiles 	_handoff;
+
+		/**
+		 * @brief La scomposizione media delle esecuzioni con latenza almeno
+		 * 			pari al 99° percentile: indica la componente che causa
+		 * 			i picchi
+		 */
+		LatencySample 		_tail;
+
+		std::string to_string() const;
+
+	};
+
+	inline std::string LatencyReport::to_string() const {
+		std::ostringstream out;
+
+		out << std::fixed << std::setprecision(1);
+		out << "esecuzioni campionate: " << _samples << "\n";
+		out << "us\tp50\tp90\tp99\tmax\tcoda p99\n";
+
+		auto row = [&out](const char* name, const LatencyPercentiles& value, uint64_t tail) {
+			out << name << "\t" << value._p50 / 1e3 << "\t" << value._p90 / 1e3 << "\t" << value._p99 / 1e3
+				<< "\t" << value._max / 1e3 << "\t" << tail / 1e3 << "\n";
+		};
+
+		row("totale", _total, _tail._total_ns);
+		row("invio", _submission, _tail._submission_ns);
+		row("calcolo", _compute, _tail._compute_ns);
+		row("attesa", _scheduling, _tail._scheduling_ns);
+		row("consegna", _handoff, _tail._handoff_ns);
+
+		return out.str();
+	}
+
+	/**
+	 * @class LatencySampler
+	 * @brief Scompone la latenza di un'esecuzione ogni _period, a partire
+	 * 			dalla sua RunTrace, e conserva le ultime scomposizioni per
+	 * 			calcolarne i percentili.
+	 * Con le pipeline ogni stadio è un'esecuzione a sé, la cui consegna
+	 * comprende l'avvio dello stadio successivo.
+	 */
+	class LatencySampler {
+	public:
+
+		/**
+		 * @param period viene campionata un'esecuzione ogni period
+		 * @param capacity il numero di scomposizioni conservate
+		 */
+		LatencySampler(size_t period, size_t capacity);
+
+		/**
+		 * @brief Conta un'esecuzione e ritorna vero se va campionata
+		 */
+		bool sample() {
+			return _runs.fetch_add(1, std::memory_order_relaxed) % _period == 0;
+		}
+
+		/**
+		 * @brief Aggiunge la scomposizione dell'esecuzione completata
+		 *
+		 * @param complete l'istante in cui il risultato sta per essere
+		 * 			consegnato
+		 */
+		void record(const Graph& model, const RunTrace& trace, std::chrono::steady_clock::time_point complete);
+
+		LatencyReport report();
+
+		static LatencySample breakdown(const Graph& model, const RunTrace& trace, uint64_t complete_ns);
+
+	private:
+
+		size_t 						_period;
+
+		std::atomic<uint64_t> 		_runs;
+
+		std::mutex 					_mutex;
+
+		/**
+		 * @brief Buffer circolare delle ultime scomposizioni
+		 */
+		std::vector<LatencySample> 	_samples;
+
+		size_t 						_capacity;
+
+		size_t 						_next;
+
+	};
+
+	inline LatencySampler::LatencySampler(size_t period, size_t capacity) :
+		_period{period > 0 ? period : 1},
+		_runs{0},
+		_capacity{capacity > 0 ? capacity : 1},
+		_next{0}
+	{
+		_samples.reserve(_capacity);
+	}
+
+	inline LatencySample LatencySampler::breakdown(const Graph& model, const RunTrace& trace, uint64_t complete_ns) {
+		size_t n = trace._nodes.size();
+		std::vector<size_t> last(n, n);
+		LatencySample sample;
+
+		auto end = [&trace](size_t id) {
+			return trace._nodes[id]._start_ns + trace._nodes[id]._duration_ns;
+		};
+
+		auto gap = [](uint64_t from, uint64_t to) -> uint64_t {
+			return to > from ? to - from : 0;
+		};
+
+		// il predecessore terminato per ultimo ha reso pronto il nodo
+		for(size_t id = 0; id < n; id++) {
+			if (!(trace._nodes[id]._flags & NodeTrace::EXECUTED))
+				continue;
+
+			for(const size_t& next : *model._nodes[id] -> _successors) {
+				if (last[next] == n || end(id) > end(last[next]))
+					last[next] = id;
+			}
+		}
+
+		size_t id = model._output_node;
+
+		sample._total_ns 	= complete_ns;
+		sample._handoff_ns 	= gap(end(id), complete_ns);
+
+		while (id != n) {
+			size_t previous = last[id];
+
+			sample._compute_ns += trace._nodes[id]._duration_ns;
+
+			if (previous == n)
+				sample._submission_ns = trace._nodes[id]._start_ns;
+			else
+				sample._scheduling_ns += gap(end(previous), trace._nodes[id]._start_ns);
+
+			id = previous;
+		}
+
+		return sample;
+	}
+
+	inline void LatencySampler::record(const Graph& model, const RunTrace& trace,
+		std::chrono::steady_clock::time_point complete) {
+		LatencySample sample = breakdown(model, trace, trace.elapsed(complete));
+
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		if (_samples.size() < _capacity)
+			_samples.push_back(sample);
+		else
+			_samples[_next] = sample;
+
+		_next = (_next + 1) % _capacity;
+	}
+
+	inline LatencyReport LatencySampler::report() {
+		std::vector<LatencySample> samples;
+		LatencyReport report;
+
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			samples = _samples;
+		}
+
+		report._samples = samples.size();
+
+		if (samples.empty())
+			return report;
+
+		auto percentiles = [&samples](uint64_t LatencySample::* field) {
+			std::vector<uint64_t> values;
+			LatencyPercentiles result;
+
+			for(const LatencySample& sample : samples) {
+				values.push_back(sample.*field);
+			}
+
+			std::sort(values.begin(), values.end());
+
+			auto rank = [&values](double p) {
+				return values[std::min(values.size() - 1, (size_t) (p * values.size()))];
+			};
+
+			result._p50 = rank(0.50);
+			result._p90 = rank(0.90);
+			result._p99 = rank(0.99);
+			result._max = values.back();
+
+			return result;
+		};
+
+		report._total 		= percentiles(&LatencySample::_total_ns);
+		report._submission 	= percentiles(&LatencySample::_submission_ns);
+		report._compute 	= percentiles(&LatencySample::_compute_ns);
+		report._scheduling 	= percentiles(&LatencySample::_scheduling_ns);
+		report._handoff 	= percentiles(&LatencySample::_handoff_ns);
+
+		size_t tail = 0;
+
+		for(const LatencySample& sample : samples) {
+			if (sample._total_ns < report._total._p99)
+				continue;
+
+			report._tail._total_ns 		+= sample._total_ns;
+			report._tail._submission_ns += sample._submission_ns;
+			report._tail._compute_ns 	+= sample._compute_ns;
+			report._tail._scheduling_ns += sample._scheduling_ns;
+			report._tail._handoff_ns 	+= sample._handoff_ns;
+			tail++;
+		}
+
+		report._tail._total_ns 		/= tail;
+		report._tail._submission_ns /= tail;
+		report._tail._compute_ns 	/= tail;
+		report._tail._scheduling_ns /= tail;
+		report._tail._handoff_ns 	/= tail;
+
+		return report;
+	}
+
+}
+
+#endif /* LATENCY_HPP */
@@ -0,0 +1,193 @@
+#ifndef MAPPED_FILE_HPP
+#define MAPPED_FILE_HPP
+
+#include <string>
+#include <string_view>
+#include <stdexcept>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "mdf.hpp"
+
+namespace mdf {
+
+	/**
+	 * @class MappedFile
+	 * @brief Un file mappato in memoria in sola lettura. La mappatura
+	 * 			viene rimossa alla distruzione dell'oggetto.
+	 */
+	class MappedFile {
+	public:
+
+		/**
+		 * @param path il percorso del file
+		 */
+		explicit MappedFile(const std::string& path);
+
+		MappedFile(const MappedFile &) = delete;
+
+		~MappedFile();
+
+		const char* data() const {
+			return _data;
+		}
+
+		size_t size() const {
+			return _size;
+		}
+
+	private:
+
+		const char*	_data;
+
+		size_t		_size;
+
+	};
+
+	inline MappedFile::MappedFile(const std::string& path) :
+		_data{nullptr},
+		_size{0}
+	{
+		int fd = open(path.c_str(), O_RDONLY);
+
+		if (fd < 0)
+			throw std::runtime_error("Impossibile aprire " + path + ": " + std::strerror(errno));
+
+		struct stat info;
+
+		if (fstat(fd, &info) != 0) {
+			close(fd);
+			throw std::runtime_error("Impossibile leggere la dimensione di " + path);
+		}
+
+		_size = info.st_size;
+
+		if (_size > 0) {
+			void* data = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+			if (data == MAP_FAILED) {
+				close(fd);
+				throw std::runtime_error("Impossibile mappare " + path + ": " + std::strerror(errno));
+			}
+
+			_data = static_cast<const char*>(data);
+			madvise(data, _size, MADV_SEQUENTIAL);
+		}
+
+		// la mappatura resta valida anche dopo la chiusura del descrittore
+		close(fd);
+	}
+
+	inline MappedFile::~MappedFile() {
+		if (_data != nullptr)
+			munmap(const_cast<char*>(_data), _size);
+	}
+
+	/**
+	 * @struct Chunk
+	 * @brief Una porzione di un file mappato. Finché esiste un Chunk, e
+	 * 			quindi un token che lo contiene, la mappatura resta valida.
+	 */
+	struct Chunk {
+		std::shared_ptr<const MappedFile> _file;
+
+		const char*	_data;
+
+		size_t		_size;
+
+		/**
+		 * @brief La posizione della porzione nel file
+		 */
+		size_t		_offset;
+
+		std::string_view view() const {
+			return std::string_view(_data, _size);
+		}
+	};
+
+	/**
+	 * @class MappedFileSource
+	 * @brief Nodo sorgente che riceve il percorso di un file, lo mappa in
+	 * 			memoria e produce un token Chunk per ciascuna delle n porzioni
+	 * 			in cui viene diviso, senza copiarne il contenuto.
+	 * Le porzioni sono allineate alla pagina, tranne la fine dell'ultima;
+	 * se il file è piccolo le ultime porzioni possono essere vuote.
+	 * Su ogni porzione viene chiesta la lettura anticipata con
+	 * MADV_WILLNEED, così che il disco lavori mentre i consumatori partono.
+	 */
+	class MappedFileSource : public Function {
+	public:
+
+		/**
+		 * @param chunks il numero di porzioni, cioè la dimensione dell'output
+		 */
+		explicit MappedFileSource(size_t chunks);
+
+		size_t get_arity() const { return 1; }
+
+		size_t get_output_size() const { return _chunks; }
+
+		token_vector_t* execute(token_vector_t& input) const;
+
+		void execute(token_vector_t& input, ResultSink& sink) const;
+
+	private:
+
+		size_t _chunks;
+
+	};
+
+	inline MappedFileSource::MappedFileSource(size_t chunks) :
+		_chunks{chunks}
+	{
+		if (chunks < 1)
+			throw std::invalid_argument("Il numero delle porzioni deve essere almeno 1");
+	}
+
+	inline token_vector_t* MappedFileSource::execute(token_vector_t& input) const {
+		const std::string& path = TokenSlot<std::string>::from_token(input.at(0).get());
+		std::shared_ptr<const MappedFile> file = std::make_shared<MappedFile>(path);
+
+		size_t page 	= sysconf(_SC_PAGESIZE);
+		// per eccesso: le porzioni coprono sempre tutto il file
+		size_t step 	= ((file -> size() + _chunks - 1) / _chunks + page - 1) / page * page;
+		size_t offset 	= 0;
+
+		token_vector_t* output = acquire_token_vector(_chunks);
+
+		for(size_t i = 0; i < _chunks; i++) {
+			size_t size = std::min(step, file -> size() - offset);
+			const char* data = file -> data() == nullptr ? nullptr : file -> data() + offset;
+
+			if (size > 0)
+				madvise(const_cast<char*>(data), size, MADV_WILLNEED);
+
+			output -> push_back(make_token<Chunk>(Chunk{file, data, size, offset}));
+			offset += size;
+		}
+
+		return output;
+	}
+
+	inline void MappedFileSource::execute(token_vector_t& input, ResultSink& sink) const {
+		sink.accept(execute(input));
+	}
+
+	/**
+	 * @brief Aggiunge al grafo un nodo MappedFileSource. Il nodo riceve un
+	 * 			token std::string con il percorso del file.
+	 *
+	 * @param graph il grafo
+	 * @param chunks il numero di porzioni prodotte
+	 * @return l'istruzione che incapsula il nodo creato
+	 */
+	inline Instruction mmap_source(Mdf& graph, size_t chunks) {
+		return graph.emplace_function(std::make_shared<MappedFileSource>(chunks));
+	}
+
+}
+
+#endif /* MAPPED_FILE_HPP */
@@ -1,7 +1,11 @@
 #ifndef MDF_HPP
 #define MDF_HPP
 
+#include <fstream>
 #include "instruction.hpp"
+#include "analysis.hpp"
+#include "dot.hpp"
+#include "perf_counters.hpp"
 
 namespace mdf {
 	
@@ -18,10 +22,39 @@ namespace mdf {
 		
 		friend class Executor;
 		
+		friend class MdfGroup;
+		
+		friend class Pipeline;
+		
+		friend class ProcessExecutor;
+		
+		friend class DistributedExecutor;
+		
+		friend class RemoteAgent;
+		
+		friend class Simulator;
+		
+		friend class RunLog;
+		
+		friend class MetricsExporter;
+		
+		friend struct MicroBench;
+		
 	public:	
 	
-		Mdf();
+		/**
+		 * @brief Costruisce un grafo vuoto
+		 * 
+		 * @param resource la risorsa da cui allocare nodi, archi e istanze
+		 * 			del grafo, nullptr per la risorsa di default
+		 */
+		Mdf(std::pmr::memory_resource* resource = nullptr);
 		
+		/**
+		 * @brief Le esecuzioni in corso tengono in vita il modello del
+		 * 			grafo fino al loro completamento; la risorsa passata al
+		 * 			costruttore deve sopravvivere anche a loro
+		 */
 		~Mdf(); 
 		
 		Mdf(const Mdf &) = delete;
@@ -41,6 +74,15 @@ namespace mdf {
 		template <typename C, typename ... Args>
 		Instruction emplace_back(C && callable, Param<Args> && ... params);
 		
+		/**
+		 * @brief Aggiunge un nodo che esegue una Function già costruita, 
+		 * 			ad esempio uno dei nodi predefiniti come MappedFileSource
+		 * 
+		 * @param function la Function del nodo
+		 * @return l'istruzione che incapsula il nodo creato
+		 */
+		Instruction emplace_function(std::shared_ptr<Function> function);
+		
 		/**
 		 * @brief Aggiunge un nodo di merge
 		 * 
@@ -147,10 +189,68 @@ namespace mdf {
 		 */
 		void mark_as_output(Instruction& instruction);
 		
+		/**
+		 * @brief Assegna l'istruzione a un gruppo di processi del 
+		 * 			ProcessExecutor o a una partizione del DistributedExecutor.
+		 * 			I token scambiati tra nodi di gruppi diversi devono 
+		 * 			essere serializzabili, vedi Serializer.
+		 * 
+		 * @param instruction l'istruzione da assegnare
+		 * @param process il gruppo, 0 per il processo principale
+		 */
+		void set_process(Instruction& instruction, size_t process);
+		
 		/**
 		 * @brief Esegue il controllo di correttezza del grafo
 		 */
 		void validate();
+		
+		/**
+		 * @brief Raggruppa i nodi adiacenti di costo inferiore alla grana in
+		 * 		task più grossi, usando i costi misurati dall'Executor.
+		 * 		Le istanze già in esecuzione non sono influenzate.
+		 * 
+		 * @param grain la durata minima desiderata di ogni task
+		 * @return il numero di task risultanti
+		 */
+		size_t cluster(std::chrono::nanoseconds grain);
+		
+		/**
+		 * @brief Dichiara il costo di esecuzione del nodo, usato da analyze()
+		 * 		al posto di quello misurato dall'Executor. Può essere 
+		 * 		chiamato anche dopo la validazione.
+		 * 
+		 * @param instruction il nodo
+		 * @param cost il costo di un'esecuzione, 0 per tornare al costo misurato
+		 */
+		void set_cost(Instruction& instruction, std::chrono::nanoseconds cost);
+		
+		/**
+		 * @brief Analizza la struttura del grafo: livelli, cammino critico,
+		 * 		lavoro totale e numero di thread consigliato per l'Executor,
+		 * 		usando i costi dichiarati o misurati dei nodi
+		 * 
+		 * @param max_threads il numero massimo di thread considerati
+		 */
+		GraphReport analyze(size_t max_threads = 256);
+		
+		/**
+		 * @brief Scrive il grafo nel formato DOT di Graphviz, con i nodi 
+		 * 		colorati in base al costo e il cammino critico evidenziato,
+		 * 		vedi GraphDot
+		 */
+		void export_dot(std::ostream& out, const DotConfig& config = DotConfig());
+		
+		/**
+		 * @throw std::runtime_error se il file non può essere scritto
+		 */
+		void export_dot(const std::string& path, const DotConfig& config = DotConfig());
+		
+		/**
+		 * @brief Ritorna i contatori hardware accumulati dai nodi, con IPC
+		 * 		e MPKI, vedi Executor::set_hardware_counters
+		 */
+		CounterReport hardware_counters() const;
 
 	private:
 	
@@ -166,15 +266,17 @@ namespace mdf {
 		
 	};
 	
-	inline Mdf::Mdf() :
-		_graph{new Graph()},
+	inline Mdf::Mdf(std::pmr::memory_resource* resource) :
 		_valid{false}
 	{
-		_graph_id = reinterpret_cast<uintptr_t>(_graph);
+		ResourceScope scope(resource);
+		
+		_graph 		= new Graph(current_resource());
+		_graph_id 	= reinterpret_cast<uintptr_t>(_graph);
 	}
 	
 	inline Mdf::~Mdf() {
-		delete _graph;
+		Graph::drop(_graph);
 	}
 	
 	template <typename C, typename ... Args>
@@ -193,6 +295,15 @@ namespace mdf {
 		return Instruction(node,_graph_id);
 	}
 	
+	inline Instruction Mdf::emplace_function(std::shared_ptr<Function> function) {
+		if (function == nullptr)
+			throw std::invalid_argument("La funzione non deve essere vuota");
+			
+		Node& node = (*_graph).emplace_function(function);
+		
+		return Instruction(node, _graph_id);
+	}
+	
 	inline Instruction Mdf::merge_node(size_t input_size) {
 		if (input_size < 1)
 			throw std::invalid_argument("La dimensione dell'input deve essere almeno 1");
@@ -229,6 +340,12 @@ namespace mdf {
 		}
 	}
 	
+	inline size_t Mdf::cluster(std::chrono::nanoseconds grain) {
+		validate();
+		
+		return _graph -> cluster(grain);
+	}
+	
 	inline void Mdf::set_output(Instruction& instruction, token_map_t&& output_map) {
 		
 		if (_valid)
@@ -260,7 +377,8 @@ namespace mdf {
 			}
 		}
 		
-		instruction._node -> _output_map = std::make_shared<token_map_t>(std::forward<token_map_t>(output_map));
+		ResourceScope scope(_graph -> _resource);
+		instruction._node -> _output_map = make_resource_shared<token_map_t>(std::forward<token_map_t>(output_map));
 	}
 	
 	inline void Mdf::add_output(Instruction& instruction, std::pair<size_t, size_t> && inst_coord) {
@@ -369,6 +487,50 @@ namespace mdf {
 		_graph -> _input_node = instruction();
 	}
 	
+	inline void Mdf::set_process(Instruction& instruction, size_t process) {
+		
+		if (_valid)
+			throw std::invalid_argument("Il grafo non può più essere modificato");
+		
+		if (_graph_id != instruction._graph_id)
+			throw std::invalid_argument("Il nodo non appartiene a questo grafo");
+			
+		instruction._node -> _process = process;
+	}
+	
+	inline void Mdf::set_cost(Instruction& instruction, std::chrono::nanoseconds cost) {
+		
+		if (_graph_id != instruction._graph_id)
+			throw std::invalid_argument("Il nodo non appartiene a questo grafo");
+		
+		instruction._node -> _stats -> _annotated_ns.store(std::max<int64_t>(cost.count(), 0), std::memory_order_relaxed);
+	}
+	
+	inline GraphReport Mdf::analyze(size_t max_threads) {
+		validate();
+		
+		return GraphAnalysis::analyze(*_graph, max_threads);
+	}
+	
+	inline void Mdf::export_dot(std::ostream& out, const DotConfig& config) {
+		validate();
+		
+		GraphDot::write(*_graph, out, config);
+	}
+	
+	inline CounterReport Mdf::hardware_counters() const {
+		return CounterReport::collect(*_graph);
+	}
+	
+	inline void Mdf::export_dot(const std::string& path, const DotConfig& config) {
+		std::ofstream out(path);
+		
+		if (!out)
+			throw std::runtime_error("Impossibile scrivere il file " + path);
+			
+		export_dot(out, config);
+	}
+	
 	inline void Mdf::mark_as_output(Instruction& instruction) {
 		
 		if (_valid)
@@ -0,0 +1,165 @@
+#ifndef MEMORY_HPP
+#define MEMORY_HPP
+
+#include <memory_resource>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <cstddef>
+#include "token.hpp"
+
+namespace mdf {
+
+	/**
+	 * @brief Risorsa di memoria del thread corrente, usata per tutte le
+	 * 			allocazioni interne del framework: nodi, archi, istanze e
+	 * 			token. Se non impostata è std::pmr::get_default_resource().
+	 */
+	inline std::pmr::memory_resource*& current_resource_slot() {
+		thread_local std::pmr::memory_resource* resource = nullptr;
+		return resource;
+	}
+
+	inline std::pmr::memory_resource* current_resource() {
+		std::pmr::memory_resource* resource = current_resource_slot();
+		return resource != nullptr ? resource : std::pmr::get_default_resource();
+	}
+
+	/**
+	 * @class ResourceScope
+	 * @brief Imposta la risorsa corrente del thread per la durata dello
+	 * 			scope, ripristinando la precedente alla distruzione
+	 */
+	class ResourceScope {
+	public:
+
+		/**
+		 * @param resource la risorsa da usare, nullptr per lasciare invariata la corrente
+		 */
+		explicit ResourceScope(std::pmr::memory_resource* resource) :
+			_previous{current_resource_slot()}
+		{
+			if (resource != nullptr)
+				current_resource_slot() = resource;
+		}
+
+		ResourceScope(const ResourceScope &) = delete;
+
+		~ResourceScope() {
+			current_resource_slot() = _previous;
+		}
+
+	private:
+
+		std::pmr::memory_resource* _previous;
+
+	};
+
+	/**
+	 * @brief Come std::make_shared, ma blocco di controllo e oggetto sono
+	 * 			allocati dalla risorsa corrente. I container pmr costruiti
+	 * 			così usano la stessa risorsa.
+	 */
+	template <typename T, typename ... Args>
+	inline std::shared_ptr<T> make_resource_shared(Args && ... args) {
+		return std::allocate_shared<T>(
+			std::pmr::polymorphic_allocator<T>(current_resource()), std::forward<Args>(args)...);
+	}
+
+	/**
+	 * @brief Crea un token allocato dalla risorsa corrente
+	 */
+	template <typename T, typename ... Args>
+	inline std::shared_ptr<TokenSlot<T>> make_token(Args && ... args) {
+		return make_resource_shared<TokenSlot<T>>(std::forward<Args>(args)...);
+	}
+
+	/**
+	 * @struct ResourceAllocated
+	 * @brief Base delle classi interne allocate con new. Gli oggetti vengono
+	 * 			allocati dalla risorsa corrente, che viene memorizzata in
+	 * 			testa al blocco così che delete la ritrovi da qualsiasi thread.
+	 */
+	struct ResourceAllocated {
+
+		static void* operator new(size_t size) {
+			std::pmr::memory_resource* resource = current_resource();
+			void* block = resource -> allocate(size + HEADER, alignof(std::max_align_t));
+
+			*static_cast<std::pmr::memory_resource**>(block) = resource;
+
+			return static_cast<char*>(block) + HEADER;
+		}
+
+		static void operator delete(void* object, size_t size) {
+			if (object == nullptr)
+				return;
+
+			void* block = static_cast<char*>(object) - HEADER;
+			(*static_cast<std::pmr::memory_resource**>(block)) -> deallocate(block, size + HEADER, alignof(std::max_align_t));
+		}
+
+	private:
+
+		static constexpr size_t HEADER = alignof(std::max_align_t);
+
+	};
+
+	/**
+	 * @class RunArena
+	 * @brief Risorsa monotona di una singola esecuzione. Le allocazioni
+	 * 			vengono servite da un buffer interno e poi da blocchi di
+	 * 			dimensione crescente presi dalla risorsa a monte; tutto viene
+	 * 			liberato in blocco al completamento dell'esecuzione.
+	 * 			L'accesso è sincronizzato perché i nodi di un'istanza sono
+	 * 			eseguiti da worker diversi.
+	 */
+	class RunArena : public std::pmr::memory_resource {
+	public:
+
+		static constexpr size_t BUFFER_SIZE = 4096;
+
+		RunArena() = default;
+
+		RunArena(const RunArena &) = delete;
+
+		/**
+		 * @brief Prepara l'arena per una nuova esecuzione
+		 *
+		 * @param upstream la risorsa da cui prendere i blocchi oltre il buffer interno
+		 */
+		void reset(std::pmr::memory_resource* upstream) {
+			_monotonic.emplace(_buffer, BUFFER_SIZE, upstream);
+		}
+
+		/**
+		 * @brief Libera in blocco tutta la memoria dell'esecuzione
+		 */
+		void release() {
+			_monotonic.reset();
+		}
+
+	private:
+
+		void* do_allocate(size_t bytes, size_t alignment) {
+			std::lock_guard<std::mutex> lock(_mutex);
+			return _monotonic -> allocate(bytes, alignment);
+		}
+
+		void do_deallocate(void*, size_t, size_t) {}
+
+		bool do_is_equal(const std::pmr::memory_resource& other) const noexcept {
+			return this == &other;
+		}
+
+		alignas(std::max_align_t) unsigned char _buffer[BUFFER_SIZE];
+
+		std::optional<std::pmr::monotonic_buffer_resource> _monotonic;
+
+		std::mutex _mutex;
+
+	};
+
+}
+
+#endif /* MEMORY_HPP */
@@ -0,0 +1,394 @@
+#ifndef METRICS_EXPORTER_HPP
+#define METRICS_EXPORTER_HPP
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <iomanip>
+#include <chrono>
+#include <cstdio>
+#include <poll.h>
+#include "executor.hpp"
+#include "socket.hpp"
+
+namespace mdf {
+
+	/**
+	 * @class MetricsExporter
+	 * @brief Espone le metriche di un Executor e le statistiche dei nodi dei
+	 * 			grafi registrati nel formato testuale di Prometheus (0.0.4).
+	 * Le metriche possono essere servite in HTTP su un socket Unix o su una
+	 * porta di localhost, con un thread per listener, oppure scritte
+	 * periodicamente su un file. La lettura somma i contatori dei worker
+	 * senza prendere il lock della coda, quindi non ferma mai i worker.
+	 * L'exporter abilita le metriche dell'Executor, che deve sopravvivergli,
+	 * come i grafi registrati.
+	 */
+	class MetricsExporter {
+	public:
+
+		MetricsExporter(Executor& executor);
+
+		MetricsExporter(const MetricsExporter &) = delete;
+
+		/**
+		 * @brief Ferma i listener e la scrittura periodica
+		 */
+		~MetricsExporter();
+
+		/**
+		 * @brief Esporta le statistiche dei nodi del grafo con l'etichetta
+		 * 			graph="name"
+		 */
+		void add_graph(const std::string& name, Mdf& graph);
+
+		/**
+		 * @brief Ritorna le metriche nel formato testuale di Prometheus
+		 */
+		std::string render();
+
+		/**
+		 * @brief Serve le metriche sul socket Unix dato
+		 *
+		 * @throw std::runtime_error se il socket non può essere aperto
+		 */
+		void serve_unix(const std::string& path);
+
+		/**
+		 * @brief Serve le metriche su 127.0.0.1
+		 *
+		 * @param port la porta, 0 per sceglierne una libera
+		 * @return la porta effettiva
+		 * @throw std::runtime_error se il socket non può essere aperto
+		 */
+		uint16_t serve_tcp(uint16_t port = 0);
+
+		/**
+		 * @brief Scrive le metriche sul file ogni period, sostituendolo
+		 * 			atomicamente, ad esempio per il textfile collector di
+		 * 			node_exporter
+		 */
+		void write_periodically(const std::string& path, std::chrono::milliseconds period);
+
+	private:
+
+		void start(int listener);
+
+		void accept_loop(int listener);
+
+		/**
+		 * @brief Legge la richiesta HTTP, qualunque sia, e risponde con
+		 * 			le metriche
+		 */
+		void respond(int fd);
+
+		Executor& 						_executor;
+
+		std::mutex 						_mutex;
+
+		std::condition_variable 		_stopped;
+
+		std::vector<std::pair<std::string, Graph*>> _graphs;
+
+		std::vector<int> 				_listeners;
+
+		std::vector<std::string> 		_unix_paths;
+
+		std::vector<std::thread> 		_threads;
+
+		/**
+		 * @brief La pipe scritta alla distruzione per svegliare i listener
+		 */
+		int 							_wake[2];
+
+		bool 							_stop;
+
+	};
+
+	inline MetricsExporter::MetricsExporter(Executor& executor) :
+		_executor{executor},
+		_stop{false}
+	{
+		if (pipe(_wake) != 0)
+			throw std::runtime_error(std::string("Impossibile creare la pipe: ") + std::strerror(errno));
+
+		_executor.set_metrics(true);
+	}
+
+	inline MetricsExporter::~MetricsExporter() {
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_stop = true;
+		}
+
+		_stopped.notify_all();
+
+		char wake = 0;
+		[[maybe_unused]] ssize_t written = write(_wake[1], &wake, 1);
+
+		for(std::thread& thread : _threads) {
+			thread.join();
+		}
+
+		for(int fd : _listeners) {
+			close(fd);
+		}
+
+		for(const std::string& path : _unix_paths) {
+			unlink(path.c_str());
+		}
+
+		close(_wake[0]);
+		close(_wake[1]);
+	}
+
+	inline void MetricsExporter::add_graph(const std::string& name, Mdf& graph) {
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		_graphs.emplace_back(name, graph._graph);
+	}
+
+	inline void MetricsExporter::serve_unix(const std::string& path) {
+		int listener = unix_listen(path);
+
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		_unix_paths.push_back(path);
+		start(listener);
+	}
+
+	inline uint16_t MetricsExporter::serve_tcp(uint16_t port) {
+		std::pair<int, uint16_t> listener = tcp_listen("127.0.0.1", port);
+
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		start(listener.first);
+
+		return listener.second;
+	}
+
+	/**
+	 * @brief Avvia il thread del listener. Richiede il lock.
+	 */
+	inline void MetricsExporter::start(int listener) {
+		_listeners.push_back(listener);
+		_threads.emplace_back([this, listener] { accept_loop(listener); });
+	}
+
+	inline void MetricsExporter::write_periodically(const std::string& path, std::chrono::milliseconds period) {
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		_threads.emplace_back([this, path, period] {
+			std::unique_lock<std::mutex> lock(_mutex);
+
+			while (!_stop) {
+				lock.unlock();
+
+				std::string text = render();
+				std::string temporary = path + ".tmp";
+
+				{
+					std::ofstream out(temporary, std::ios::trunc);
+					out << text;
+				}
+
+				std::rename(temporary.c_str(), path.c_str());
+
+				lock.lock();
+				_stopped.wait_for(lock, period, [this] { return _stop; });
+			}
+		});
+	}
+
+	inline void MetricsExporter::accept_loop(int listener) {
+		pollfd fds[2] = {{listener, POLLIN, 0}, {_wake[0], POLLIN, 0}};
+
+		for(;;) {
+			if (poll(fds, 2, -1) < 0) {
+				if (errno == EINTR)
+					continue;
+
+				return;
+			}
+
+			// la pipe resta leggibile, quindi sveglia tutti i listener
+			if (fds[1].revents != 0)
+				return;
+
+			int fd = accept(listener, nullptr, nullptr);
+
+			if (fd >= 0) {
+				respond(fd);
+				close(fd);
+			}
+		}
+	}
+
+	inline void MetricsExporter::respond(int fd) {
+		timeval timeout{1, 0};
+		std::string request;
+		char buffer[1024];
+
+		setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+		while (request.find("\r\n\r\n") == std::string::npos && request.size() < 8192) {
+			ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+
+			if (n <= 0)
+				break;
+
+			request.append(buffer, n);
+		}
+
+		std::string body = render();
+		std::string response = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: " +
+			std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+
+		for(size_t sent = 0; sent < response.size(); ) {
+			ssize_t n = send(fd, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+
+			if (n <= 0)
+				return;
+
+			sent += n;
+		}
+	}
+
+	inline std::string MetricsExporter::render() {
+		ExecutorMetrics metrics = _executor.metrics();
+		std::vector<std::pair<std::string, Graph*>> graphs;
+		std::ostringstream out;
+
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			graphs = _graphs;
+		}
+
+		out << std::setprecision(12);
+
+		auto family = [&out](const char* name, const char* type, const char* help) {
+			out << "# HELP " << name << " " << help << "\n# TYPE " << name << " " << type << "\n";
+		};
+
+		auto seconds = [](uint64_t ns) {
+			return ns / 1e9;
+		};
+
+		family("mdf_runs_started_total", "counter", "Esecuzioni avviate");
+		out << "mdf_runs_started_total " << metrics._runs_started << "\n";
+
+		family("mdf_runs_completed_total", "counter", "Esecuzioni completate");
+		out << "mdf_runs_completed_total " << metrics._runs_completed << "\n";
+
+		family("mdf_run_latency_seconds", "histogram", "Latenza delle esecuzioni, dall'avvio al risultato");
+		uint64_t cumulative = 0;
+
+		for(size_t bucket = 0; bucket < LATENCY_BUCKETS; bucket++) {
+			cumulative += metrics._latency[bucket];
+			out << "mdf_run_latency_seconds_bucket{le=\"";
+
+			if (bucket < LATENCY_BUCKETS - 1)
+				out << seconds(LATENCY_BOUNDS_NS[bucket]);
+			else
+				out << "+Inf";
+
+			out << "\"} " << cumulative << "\n";
+		}
+
+		out << "mdf_run_latency_seconds_sum " << seconds(metrics._latency_ns) << "\n";
+		out << "mdf_run_latency_seconds_count " << cumulative << "\n";
+
+		family("mdf_queue_depth", "gauge", "Job in coda");
+		out << "mdf_queue_depth " << metrics._queue_depth << "\n";
+
+		family("mdf_queue_depth_max", "gauge", "Massimo dei job in coda");
+		out << "mdf_queue_depth_max " << metrics._max_queue_depth << "\n";
+
+		family("mdf_external_enqueue_wait_seconds_total", "counter", "Attesa del lock della coda dei thread esterni");
+		out << "mdf_external_enqueue_wait_seconds_total " << seconds(metrics._external_enqueue_wait_ns) << "\n";
+
+		auto workers = [&](const char* name, const char* type, const char* help, auto value) {
+			family(name, type, help);
+
+			for(size_t i = 0; i < metrics._workers.size(); i++) {
+				out << name << "{worker=\"" << i << "\"} " << value(metrics._workers[i]) << "\n";
+			}
+		};
+
+		workers("mdf_worker_busy_seconds_total", "counter", "Tempo speso eseguendo job",
+			[&](const WorkerMetrics& w) { return seconds(w._busy_ns); });
+		// ricavato per differenza dal tempo trascorso, può diminuire
+		workers("mdf_worker_idle_seconds", "gauge", "Tempo né occupato né fermo",
+			[&](const WorkerMetrics& w) { return seconds(w._idle_ns); });
+		workers("mdf_worker_parked_seconds_total", "counter", "Tempo fermo sulla coda vuota",
+			[&](const WorkerMetrics& w) { return seconds(w._parked_ns); });
+		workers("mdf_worker_jobs_total", "counter", "Job presi dalla coda",
+			[](const WorkerMetrics& w) { return w._jobs; });
+		workers("mdf_worker_inlined_total", "counter", "Nodi eseguiti senza passare dalla coda",
+			[](const WorkerMetrics& w) { return w._inlined; });
+		workers("mdf_worker_donated_total", "counter", "Job messi in coda",
+			[](const WorkerMetrics& w) { return w._donated; });
+		workers("mdf_worker_dequeue_wait_seconds_total", "counter", "Attesa del lock della coda per estrarre",
+			[&](const WorkerMetrics& w) { return seconds(w._dequeue_wait_ns); });
+		workers("mdf_worker_enqueue_wait_seconds_total", "counter", "Attesa del lock della coda per inserire",
+			[&](const WorkerMetrics& w) { return seconds(w._enqueue_wait_ns); });
+		workers("mdf_worker_empty_wakeups_total", "counter", "Risvegli che hanno trovato la coda vuota",
+			[](const WorkerMetrics& w) { return w._empty_wakeups; });
+
+		// i valori delle etichette non possono contenere \\, " e a capo
+		auto escape = [](const std::string& value) {
+			std::string escaped;
+
+			for(const char& c : value) {
+				if (c == '\\' || c == '"')
+					escaped += '\\';
+
+				escaped += c == '\n' ? std::string("\\n") : std::string(1, c);
+			}
+
+			return escaped;
+		};
+
+		auto nodes = [&](const char* name, const char* help, auto value) {
+			family(name, "counter", help);
+
+			for(const auto& graph : graphs) {
+				for(size_t id = 0; id < graph.second -> _nodes.size(); id++) {
+					out << name << "{graph=\"" << escape(graph.first) << "\",node=\"" << id << "\"} "
+						<< value(*graph.second -> _nodes[id] -> _stats) << "\n";
+				}
+			}
+		};
+
+		auto load = [](const std::atomic<uint64_t>& value) {
+			return value.load(std::memory_order_relaxed);
+		};
+
+		nodes("mdf_node_executions_total", "Esecuzioni misurate del nodo",
+			[&](const NodeStats& stats) { return load(stats._count); });
+		nodes("mdf_node_execution_seconds_total", "Tempo di esecuzione del nodo",
+			[&](const NodeStats& stats) { return seconds(load(stats._total_ns)); });
+		nodes("mdf_node_queue_waits_total", "Attese in coda del nodo",
+			[&](const NodeStats& stats) { return load(stats._waits); });
+		nodes("mdf_node_queue_wait_seconds_total", "Tempo di attesa in coda del nodo",
+			[&](const NodeStats& stats) { return seconds(load(stats._wait_ns)); });
+		nodes("mdf_node_cycles_total", "Cicli del nodo, vedi Executor::set_hardware_counters",
+			[&](const NodeStats& stats) { return load(stats._cycles); });
+		nodes("mdf_node_instructions_total", "Istruzioni del nodo",
+			[&](const NodeStats& stats) { return load(stats._instructions); });
+		nodes("mdf_node_llc_misses_total", "Miss dell'ultimo livello di cache del nodo",
+			[&](const NodeStats& stats) { return load(stats._llc_misses); });
+		nodes("mdf_node_branch_misses_total", "Salti previsti male del nodo",
+			[&](const NodeStats& stats) { return load(stats._branch_misses); });
+
+		return out.str();
+	}
+
+}
+
+#endif /* METRICS_EXPORTER_HPP */
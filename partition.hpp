@@ -0,0 +1,244 @@
+#ifndef PARTITION_HPP
+#define PARTITION_HPP
+
+#include <unordered_map>
+#include <vector>
+#include <streambuf>
+#include <stdexcept>
+#include "mdf.hpp"
+
+namespace mdf {
+
+	/**
+	 * @brief Buffer di lettura su una zona di memoria, senza copiarla
+	 */
+	struct MemoryBuffer : public std::streambuf {
+		MemoryBuffer(char* data, size_t size) {
+			setg(data, data, data + size);
+		}
+	};
+
+	/**
+	 * @class Partition
+	 * @brief I nodi di un grafo assegnati a uno stesso gruppo, vedi
+	 * 			Mdf::set_process, e le istanze in esecuzione su di essi.
+	 * È la parte locale degli executor che ripartiscono il grafo tra
+	 * processi o macchine: riceve i token, esegue i nodi pronti e
+	 * consegna al trasporto i token destinati alle altre partizioni.
+	 * Non è thread-safe: ogni partizione viene servita da un solo thread.
+	 */
+	class Partition {
+	public:
+
+		/**
+		 * @param model il grafo validato
+		 * @param partition l'indice della partizione
+		 */
+		Partition(Graph& model, size_t partition);
+
+		Partition(const Partition &) = delete;
+
+		~Partition();
+
+		/**
+		 * @brief Controlla che il grafo possa essere ripartito: il nodo di
+		 * 			output deve essere nella partizione 0 e i token che
+		 * 			passano tra partizioni devono essere serializzabili
+		 *
+		 * @param model il grafo validato
+		 * @param partitions il numero delle partizioni
+		 * @throw std::invalid_argument se la ripartizione non è eseguibile
+		 */
+		static void check(Graph& model, size_t partitions);
+
+		/**
+		 * @brief Serializza il token destinato all'input del nodo
+		 *
+		 * @return i segmenti del token, validi fino alla prossima chiamata
+		 * 			dallo stesso thread e finché il token non viene rilasciato
+		 */
+		static const IoVector& serialize(Graph& model, size_t node_id, size_t slot, Token* token);
+
+		/**
+		 * @brief Consegna gli argomenti al nodo di input di una nuova istanza
+		 * 			e la esegue
+		 */
+		template <typename Forward, typename Complete>
+		void input(uint64_t id, token_vector_t* tokens, Forward&& forward, Complete&& complete);
+
+		/**
+		 * @brief Consegna un token serializzato al nodo ed esegue i nodi
+		 * 			che diventano pronti
+		 *
+		 * @param forward chiamata con (partizione, istanza, nodo, slot, Token*)
+		 * 			per i token destinati alle altre partizioni
+		 * @param complete chiamata con (istanza, token di output) quando il
+		 * 			nodo di output viene eseguito
+		 */
+		template <typename Forward, typename Complete>
+		void receive(uint64_t id, size_t node_id, size_t slot, std::istream& in, Forward&& forward, Complete&& complete);
+
+	private:
+
+		struct LocalInstance {
+			Graph* 	_graph;
+
+			/**
+			 * @brief I nodi della partizione non ancora eseguiti
+			 */
+			size_t 	_remaining;
+		};
+
+		LocalInstance& instance(uint64_t id);
+
+		template <typename Forward, typename Complete>
+		void execute(uint64_t id, LocalInstance& instance, std::vector<size_t>& ready, Forward&& forward, Complete&& complete);
+
+		Graph& 	_model;
+
+		size_t 	_partition;
+
+		size_t 	_nodes;
+
+		std::unordered_map<uint64_t, LocalInstance> _instances;
+
+	};
+
+	inline Partition::Partition(Graph& model, size_t partition) :
+		_model{model},
+		_partition{partition},
+		_nodes{0}
+	{
+		for(auto& node : _model._nodes) {
+			if (node -> _process == partition)
+				_nodes++;
+		}
+	}
+
+	inline Partition::~Partition() {
+		for(auto& instance : _instances) {
+			_model.release_instance(instance.second._graph);
+		}
+	}
+
+	inline void Partition::check(Graph& model, size_t partitions) {
+		Node& input  = *model._nodes[model._input_node];
+		Node& output = *model._nodes[model._output_node];
+
+		if (output._process != 0)
+			throw std::invalid_argument("Il nodo di output deve essere eseguito dal processo principale");
+
+		for(size_t slot = 0; slot < input._input_size && input._process != 0; slot++) {
+			if (model.slot_codec(input._node_id, slot) == nullptr)
+				throw std::invalid_argument("Gli argomenti di input inviati a un altro processo devono essere serializzabili");
+		}
+
+		for(auto& node : model._nodes) {
+			if (node -> _process >= partitions)
+				throw std::invalid_argument("Il nodo " + std::to_string(node -> _node_id) + " è assegnato a un gruppo inesistente");
+
+			for(const auto& target : *node -> _output_map) {
+				if (model._nodes[std::get<0>(target)] -> _process != node -> _process &&
+					model.slot_codec(std::get<0>(target), std::get<1>(target)) == nullptr) {
+					throw std::invalid_argument("Il token dal nodo " + std::to_string(node -> _node_id) + " al nodo " +
+						std::to_string(std::get<0>(target)) + " passa tra processi e deve essere serializzabile");
+				}
+			}
+		}
+	}
+
+	inline const IoVector& Partition::serialize(Graph& model, size_t node_id, size_t slot, Token* token) {
+		thread_local IoVector bytes;
+
+		bytes.clear();
+		model.slot_codec(node_id, slot) -> _gather(token, bytes);
+
+		return bytes;
+	}
+
+	inline Partition::LocalInstance& Partition::instance(uint64_t id) {
+		auto it = _instances.find(id);
+
+		if (it == _instances.end())
+			it = _instances.emplace(id, LocalInstance{_model.acquire_instance(), _nodes}).first;
+
+		return it -> second;
+	}
+
+	template <typename Forward, typename Complete>
+	inline void Partition::input(uint64_t id, token_vector_t* tokens, Forward&& forward, Complete&& complete) {
+		LocalInstance& local = instance(id);
+		Node& node = *local._graph -> _nodes[_model._input_node];
+		std::vector<size_t> ready{node._node_id};
+
+		std::move(tokens -> begin(), tokens -> end(), node._input_tokens.begin());
+		release_token_vector(tokens);
+
+		node._tokens_count = 0;
+		execute(id, local, ready, forward, complete);
+	}
+
+	template <typename Forward, typename Complete>
+	inline void Partition::receive(uint64_t id, size_t node_id, size_t slot, std::istream& in, Forward&& forward, Complete&& complete) {
+		LocalInstance& local = instance(id);
+		Node& node = *local._graph -> _nodes[node_id];
+		std::vector<size_t> ready;
+
+		node._input_tokens[slot] = local._graph -> slot_codec(node_id, slot) -> _make(in);
+
+		if (node._tokens_count.fetch_sub(1, std::memory_order_relaxed) == 1)
+			ready.push_back(node_id);
+
+		execute(id, local, ready, forward, complete);
+	}
+
+	/**
+	 * @brief Esegue i nodi pronti e quelli della partizione che diventano
+	 * 			pronti. L'istanza viene rilasciata quando tutti i nodi della
+	 * 			partizione sono stati eseguiti.
+	 */
+	template <typename Forward, typename Complete>
+	inline void Partition::execute(uint64_t id, LocalInstance& local, std::vector<size_t>& ready, Forward&& forward, Complete&& complete) {
+		Graph& graph = *local._graph;
+
+		while (!ready.empty()) {
+			Node& node = *graph._nodes[ready.back()];
+			ready.pop_back();
+
+			token_vector_t* output = node.execute();
+			local._remaining--;
+
+			if (node._is_output) {
+				complete(id, output);
+				continue;
+			}
+
+			size_t i = 0;
+
+			for(const auto& target : *node._output_map) {
+				Node& next = *graph._nodes[std::get<0>(target)];
+				std::shared_ptr<Token>& token = output -> at(i++);
+
+				if (next._process != _partition) {
+					forward(next._process, id, std::get<0>(target), std::get<1>(target), token.get());
+					continue;
+				}
+
+				next._input_tokens[std::get<1>(target)] = std::move(token);
+
+				if (next._tokens_count.fetch_sub(1, std::memory_order_relaxed) == 1)
+					ready.push_back(std::get<0>(target));
+			}
+
+			release_token_vector(output);
+		}
+
+		if (local._remaining == 0) {
+			_model.release_instance(local._graph);
+			_instances.erase(id);
+		}
+	}
+
+}
+
+#endif /* PARTITION_HPP */
@@ -0,0 +1,269 @@
+#ifndef PERF_COUNTERS_HPP
+#define PERF_COUNTERS_HPP
+
+#include <vector>
+#include <string>
+#include <sstream>
+#include <iomanip>
+#include <cstdint>
+#include <cstring>
+#include "graph.hpp"
+
+#if defined(__linux__)
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+namespace mdf {
+
+	/**
+	 * @struct CounterSample
+	 * @brief I valori dei contatori hardware di un thread, o la loro
+	 * 			variazione durante l'esecuzione di un nodo
+	 */
+	struct CounterSample {
+		uint64_t _cycles = 0;
+		uint64_t _instructions = 0;
+
+		/**
+		 * @brief Miss dell'ultimo livello di cache (PERF_COUNT_HW_CACHE_MISSES)
+		 */
+		uint64_t _llc_misses = 0;
+
+		uint64_t _branch_misses = 0;
+	};
+
+	/**
+	 * @class PerfCounters
+	 * @brief Il gruppo di contatori hardware del thread chiamante, aperto
+	 * 			con perf_event_open e limitato al codice utente.
+	 * Il gruppo esiste se il contatore dei cicli può essere aperto; gli altri
+	 * contatori non supportati dalla CPU o dalla macchina virtuale restano a
+	 * zero. Senza permessi (kernel.perf_event_paranoid) o su sistemi diversi
+	 * da Linux il gruppo non è disponibile.
+	 */
+	class PerfCounters {
+	public:
+
+		PerfCounters();
+
+		PerfCounters(const PerfCounters &) = delete;
+
+		~PerfCounters();
+
+		bool available() const {
+			return _leader >= 0;
+		}
+
+		/**
+		 * @brief Legge i contatori con una sola chiamata di sistema
+		 *
+		 * @return falso se il gruppo non è disponibile o la lettura fallisce
+		 */
+		bool read(CounterSample& sample) const;
+
+		/**
+		 * @brief Ritorna il gruppo del thread chiamante, aperto al primo uso
+		 */
+		static PerfCounters& local() {
+			thread_local PerfCounters counters;
+			return counters;
+		}
+
+	private:
+
+		enum counter {
+			CYCLES,
+			INSTRUCTIONS,
+			LLC_MISSES,
+			BRANCH_MISSES,
+			COUNTERS
+		};
+
+		int 	_leader;
+
+		int 	_fds[COUNTERS];
+
+		/**
+		 * @brief La posizione di ogni contatore nella lettura del gruppo,
+		 * 			-1 se non è stato aperto
+		 */
+		int 	_index[COUNTERS];
+
+		size_t 	_opened;
+
+	};
+
+	inline PerfCounters::PerfCounters() :
+		_leader{-1},
+		_opened{0}
+	{
+		for(size_t i = 0; i < COUNTERS; i++) {
+			_fds[i] 	= -1;
+			_index[i] 	= -1;
+		}
+
+#if defined(__linux__)
+		static const uint64_t configs[COUNTERS] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+			PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+
+		for(size_t i = 0; i < COUNTERS; i++) {
+			perf_event_attr attr;
+
+			std::memset(&attr, 0, sizeof(attr));
+			attr.type 			= PERF_TYPE_HARDWARE;
+			attr.size 			= sizeof(attr);
+			attr.config 		= configs[i];
+			attr.disabled 		= i == CYCLES;
+			attr.exclude_kernel = 1;
+			attr.exclude_hv 	= 1;
+			attr.read_format 	= PERF_FORMAT_GROUP;
+
+			int fd = (int) syscall(__NR_perf_event_open, &attr, 0, -1, _leader, PERF_FLAG_FD_CLOEXEC);
+
+			if (fd < 0) {
+				if (i == CYCLES)
+					return;
+
+				continue;
+			}
+
+			if (i == CYCLES)
+				_leader = fd;
+
+			_fds[i] 	= fd;
+			_index[i] 	= (int) _opened++;
+		}
+
+		ioctl(_leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+		ioctl(_leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#endif
+	}
+
+	inline PerfCounters::~PerfCounters() {
+#if defined(__linux__)
+		for(size_t i = 0; i < COUNTERS; i++) {
+			if (_fds[i] >= 0)
+				close(_fds[i]);
+		}
+#endif
+	}
+
+	inline bool PerfCounters::read(CounterSample& sample) const {
+#if defined(__linux__)
+		// numero dei contatori seguito dai loro valori, nell'ordine di apertura
+		uint64_t values[1 + COUNTERS];
+		size_t size = (1 + _opened) * sizeof(uint64_t);
+
+		if (_leader < 0 || ::read(_leader, values, size) != (ssize_t) size)
+			return false;
+
+		auto value = [&](counter c) -> uint64_t {
+			return _index[c] >= 0 ? values[1 + _index[c]] : 0;
+		};
+
+		sample._cycles 			= value(CYCLES);
+		sample._instructions 	= value(INSTRUCTIONS);
+		sample._llc_misses 		= value(LLC_MISSES);
+		sample._branch_misses 	= value(BRANCH_MISSES);
+
+		return true;
+#else
+		return false;
+#endif
+	}
+
+	/**
+	 * @struct NodeCounters
+	 * @brief I contatori hardware accumulati dalle esecuzioni di un nodo
+	 */
+	struct NodeCounters {
+		size_t 			_node;
+
+		/**
+		 * @brief Le esecuzioni misurate
+		 */
+		uint64_t 		_samples;
+
+		CounterSample 	_total;
+
+		/**
+		 * @brief Istruzioni per ciclo
+		 */
+		double ipc() const {
+			return _total._cycles > 0 ? (double) _total._instructions / _total._cycles : 0;
+		}
+
+		/**
+		 * @brief Miss dell'ultimo livello di cache ogni mille istruzioni
+		 */
+		double llc_mpki() const {
+			return _total._instructions > 0 ? 1000.0 * _total._llc_misses / _total._instructions : 0;
+		}
+
+		double branch_mpki() const {
+			return _total._instructions > 0 ? 1000.0 * _total._branch_misses / _total._instructions : 0;
+		}
+	};
+
+	/**
+	 * @struct CounterReport
+	 * @brief I contatori hardware dei nodi di un grafo, vedi
+	 * 			Executor::set_hardware_counters e Mdf::hardware_counters
+	 */
+	struct CounterReport {
+
+		/**
+		 * @brief I nodi con almeno un'esecuzione misurata, per id
+		 */
+		std::vector<NodeCounters> _nodes;
+
+		static CounterReport collect(const Graph& graph);
+
+		std::string to_string() const;
+
+	};
+
+	inline CounterReport CounterReport::collect(const Graph& graph) {
+		CounterReport report;
+
+		for(size_t id = 0; id < graph._nodes.size(); id++) {
+			const NodeStats& stats = *graph._nodes[id] -> _stats;
+			uint64_t samples = stats._counted.load(std::memory_order_relaxed);
+
+			if (samples == 0)
+				continue;
+
+			NodeCounters node{id, samples, CounterSample()};
+
+			node._total._cycles 		= stats._cycles.load(std::memory_order_relaxed);
+			node._total._instructions 	= stats._instructions.load(std::memory_order_relaxed);
+			node._total._llc_misses 	= stats._llc_misses.load(std::memory_order_relaxed);
+			node._total._branch_misses 	= stats._branch_misses.load(std::memory_order_relaxed);
+
+			report._nodes.push_back(node);
+		}
+
+		return report;
+	}
+
+	inline std::string CounterReport::to_string() const {
+		std::ostringstream out;
+
+		out << std::fixed << std::setprecision(2);
+		out << "nodo\tesecuzioni\tcicli\tistruzioni\tIPC\tLLC MPKI\tbranch MPKI\n";
+
+		for(const NodeCounters& node : _nodes) {
+			out << node._node << "\t" << node._samples << "\t" << node._total._cycles / node._samples << "\t"
+				<< node._total._instructions / node._samples << "\t" << node.ipc() << "\t"
+				<< node.llc_mpki() << "\t" << node.branch_mpki() << "\n";
+		}
+
+		return out.str();
+	}
+
+}
+
+#endif /* PERF_COUNTERS_HPP */
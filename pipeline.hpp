@@ -0,0 +1,96 @@
+#ifndef PIPELINE_HPP
+#define PIPELINE_HPP
+
+#include "mdf.hpp"
+
+namespace mdf {
+
+	/**
+	 * @class Pipeline
+	 * @brief Una catena di grafi in cui i token di output di ogni grafo
+	 * 		  diventano i token di input del nodo di input del successivo.
+	 * L'Executor avvia l'istanza dello stadio successivo direttamente dal
+	 * nodo di output del precedente, sullo stesso worker, senza restituire
+	 * i risultati intermedi al chiamante.
+	 */
+	class Pipeline {
+
+		friend class Executor;
+
+	public:
+
+		Pipeline();
+
+		Pipeline(const Pipeline &) = delete;
+
+		/**
+		 * @brief Aggiunge uno stadio in coda alla pipeline
+		 *
+		 * @param graph il grafo, deve restare valido finché la pipeline è in uso
+		 * @return la pipeline stessa
+		 */
+		Pipeline& then(Mdf& graph);
+
+		/**
+		 * @brief Ritorna il numero di stadi
+		 */
+		size_t size() const;
+
+		/**
+		 * @brief Esegue il controllo di correttezza degli stadi e dei loro
+		 * 			collegamenti. Dopo la validazione non è più possibile
+		 * 			aggiungere stadi.
+		 */
+		void validate();
+
+	private:
+
+		std::vector<Mdf*> _stages;
+
+		bool _valid;
+
+	};
+
+	inline Pipeline::Pipeline() :
+		_valid{false}
+	{}
+
+	inline Pipeline& Pipeline::then(Mdf& graph) {
+		if (_valid)
+			throw std::invalid_argument("La pipeline non può più essere modificata");
+
+		_stages.push_back(&graph);
+
+		return *this;
+	}
+
+	inline size_t Pipeline::size() const {
+		return _stages.size();
+	}
+
+	inline void Pipeline::validate() {
+		if (_valid)
+			return;
+
+		if (_stages.empty())
+			throw std::invalid_argument("La pipeline non contiene stadi");
+
+		for(size_t i = 0; i < _stages.size(); i++) {
+			_stages[i] -> validate();
+
+			if (i == 0)
+				continue;
+
+			const Graph& previous = *_stages[i - 1] -> _graph;
+			const Graph& current  = *_stages[i] -> _graph;
+
+			if (previous._nodes[previous._output_node] -> _output_size != current._nodes[current._input_node] -> _input_size)
+				throw std::invalid_argument("L'output di uno stadio deve essere grande quanto l'input del successivo");
+		}
+
+		_valid = true;
+	}
+
+}
+
+#endif /* PIPELINE_HPP */
@@ -0,0 +1,267 @@
+#ifndef POOL_HPP
+#define POOL_HPP
+
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <algorithm>
+#include <cstdint>
+
+namespace mdf {
+
+	/**
+	 * @struct PoolCounters
+	 * @brief Contatori di una pool. A regime _allocated non cresce più:
+	 * 			ogni richiesta viene servita da un oggetto riciclato.
+	 */
+	struct PoolCounters {
+		uint64_t _allocated{0};
+		uint64_t _reused{0};
+	};
+
+	/**
+	 * @struct PoolTally
+	 * @brief Versione atomica di PoolCounters, aggiornata dalle pool
+	 */
+	struct PoolTally {
+		std::atomic<uint64_t> _allocated{0};
+		std::atomic<uint64_t> _reused{0};
+
+		void count(bool reused) {
+			(reused ? _reused : _allocated).fetch_add(1, std::memory_order_relaxed);
+		}
+
+		PoolCounters read() const {
+			return PoolCounters{_allocated.load(std::memory_order_relaxed), _reused.load(std::memory_order_relaxed)};
+		}
+
+		/**
+		 * @brief Contatori cumulativi di tutte le pool del processo
+		 */
+		static PoolTally& total() {
+			static PoolTally* tally = new PoolTally();
+			return *tally;
+		}
+	};
+
+	/**
+	 * @class ObjectPool
+	 * @brief Pool di oggetti di tipo T riciclati senza essere distrutti.
+	 * Ogni thread, e quindi ogni worker, ha una propria lista di oggetti
+	 * liberi; quando questa è piena o vuota scambia metà degli oggetti con
+	 * una lista condivisa, così che gli oggetti creati da un thread e
+	 * liberati da un altro tornino in circolo.
+	 *
+	 * @tparam T il tipo degli oggetti, deve essere default constructible.
+	 * 			Chi acquisisce un oggetto è responsabile di reinizializzarlo.
+	 */
+	template <typename T>
+	class ObjectPool {
+	public:
+
+		/**
+		 * @brief Numero massimo di oggetti liberi trattenuti da ogni thread
+		 */
+		static constexpr size_t CACHE_SIZE = 64;
+
+		/**
+		 * @brief Ritorna la pool del tipo T. La pool non viene mai distrutta,
+		 * 			dato che le liste dei thread possono sopravviverle.
+		 */
+		static ObjectPool& instance();
+
+		/**
+		 * @brief Ritorna un oggetto libero, creandolo se la pool è vuota
+		 * 
+		 * @param reused se non nullo, indica se l'oggetto è stato riciclato
+		 */
+		T* acquire(bool* reused = nullptr);
+
+		/**
+		 * @brief Restituisce un oggetto alla pool
+		 */
+		void release(T* object);
+
+		/**
+		 * @brief Crea oggetti finché la lista condivisa non ne contiene almeno n
+		 */
+		void reserve(size_t n);
+
+		PoolCounters counters() const;
+
+	private:
+
+		struct Cache {
+			std::vector<T*> _objects;
+
+			Cache();
+
+			~Cache();
+		};
+
+		ObjectPool() = default;
+
+		static Cache& cache();
+
+		std::mutex 		_mutex;
+
+		std::vector<T*> _shared;
+
+		PoolTally 		_tally;
+
+	};
+
+	template <typename T>
+	inline ObjectPool<T>& ObjectPool<T>::instance() {
+		static ObjectPool* pool = new ObjectPool();
+		return *pool;
+	}
+
+	template <typename T>
+	inline typename ObjectPool<T>::Cache& ObjectPool<T>::cache() {
+		thread_local Cache local;
+		return local;
+	}
+
+	template <typename T>
+	inline ObjectPool<T>::Cache::Cache() {
+		_objects.reserve(CACHE_SIZE);
+	}
+
+	template <typename T>
+	inline ObjectPool<T>::Cache::~Cache() {
+		ObjectPool& pool = instance();
+		std::lock_guard<std::mutex> lock(pool._mutex);
+
+		pool._shared.insert(pool._shared.end(), _objects.begin(), _objects.end());
+	}
+
+	template <typename T>
+	inline T* ObjectPool<T>::acquire(bool* reused) {
+		std::vector<T*>& local = cache()._objects;
+
+		if (local.empty()) {
+			std::lock_guard<std::mutex> lock(_mutex);
+			size_t n = std::min(_shared.size(), CACHE_SIZE / 2);
+
+			local.insert(local.end(), _shared.end() - n, _shared.end());
+			_shared.resize(_shared.size() - n);
+		}
+
+		bool recycled = !local.empty();
+		T* object;
+
+		if (recycled) {
+			object = local.back();
+			local.pop_back();
+		} else {
+			object = new T();
+		}
+
+		_tally.count(recycled);
+		PoolTally::total().count(recycled);
+
+		if (reused != nullptr)
+			*reused = recycled;
+
+		return object;
+	}
+
+	template <typename T>
+	inline void ObjectPool<T>::release(T* object) {
+		std::vector<T*>& local = cache()._objects;
+
+		if (local.size() == CACHE_SIZE) {
+			std::lock_guard<std::mutex> lock(_mutex);
+
+			_shared.insert(_shared.end(), local.begin() + CACHE_SIZE / 2, local.end());
+			local.resize(CACHE_SIZE / 2);
+		}
+
+		local.push_back(object);
+	}
+
+	template <typename T>
+	inline void ObjectPool<T>::reserve(size_t n) {
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		_shared.reserve(n);
+
+		while (_shared.size() < n) {
+			_shared.push_back(new T());
+
+			_tally.count(false);
+			PoolTally::total().count(false);
+		}
+	}
+
+	template <typename T>
+	inline PoolCounters ObjectPool<T>::counters() const {
+		return _tally.read();
+	}
+
+	/**
+	 * @struct Block
+	 * @brief Blocco di memoria grezza di dimensione e allineamento fissati
+	 */
+	template <size_t Size, size_t Align>
+	struct alignas(Align) Block {
+		unsigned char _bytes[Size];
+	};
+
+	/**
+	 * @brief Contatori cumulativi dei blocchi allocati dai PoolAllocator
+	 */
+	inline PoolTally& block_tally() {
+		static PoolTally* tally = new PoolTally();
+		return *tally;
+	}
+
+	/**
+	 * @struct PoolAllocator
+	 * @brief Allocatore che ricicla i blocchi di un singolo oggetto tramite
+	 * 			ObjectPool. Pensato per gli allocatori rebind delle strutture
+	 * 			interne della libreria standard, come lo stato condiviso di
+	 * 			std::promise.
+	 */
+	template <typename T>
+	struct PoolAllocator {
+		using value_type = T;
+
+		PoolAllocator() = default;
+
+		template <typename U>
+		PoolAllocator(const PoolAllocator<U>&) {}
+
+		T* allocate(size_t n) {
+			if (n != 1)
+				return std::allocator<T>().allocate(n);
+
+			bool reused;
+			T* block = reinterpret_cast<T*>(ObjectPool<Block<sizeof(T), alignof(T)>>::instance().acquire(&reused));
+
+			block_tally().count(reused);
+
+			return block;
+		}
+
+		void deallocate(T* p, size_t n) {
+			if (n != 1) {
+				std::allocator<T>().deallocate(p, n);
+				return;
+			}
+
+			ObjectPool<Block<sizeof(T), alignof(T)>>::instance().release(reinterpret_cast<Block<sizeof(T), alignof(T)>*>(p));
+		}
+
+		template <typename U>
+		bool operator == (const PoolAllocator<U>&) const { return true; }
+
+		template <typename U>
+		bool operator != (const PoolAllocator<U>&) const { return false; }
+	};
+
+}
+
+#endif /* POOL_HPP */
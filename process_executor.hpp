@@ -0,0 +1,698 @@
+#ifndef PROCESS_EXECUTOR_HPP
+#define PROCESS_EXECUTOR_HPP
+
+#include <future>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <deque>
+#include <vector>
+#include <unordered_map>
+#include <string>
+#include <new>
+#include <stdexcept>
+#include <cstring>
+#include <ctime>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "partition.hpp"
+
+namespace mdf {
+
+	/**
+	 * @struct ProcessConfig
+	 * @brief Parametri del ProcessExecutor
+	 */
+	struct ProcessConfig {
+
+		/**
+		 * @brief Numero dei processi figli, che eseguono i gruppi da 1 a n
+		 */
+		size_t _processes = 1;
+
+		/**
+		 * @brief Dimensione della memoria condivisa dei token serializzati
+		 */
+		size_t _heap_size = 64 << 20;
+
+		/**
+		 * @brief Numero dei messaggi di ciascuna coda, potenza di 2
+		 */
+		size_t _ring_capacity = 1024;
+	};
+
+	/**
+	 * @struct ProcessMessage
+	 * @brief Messaggio scambiato tra i processi
+	 */
+	struct ProcessMessage {
+
+		enum message_kind : uint64_t {
+			TOKEN,
+			INPUT,
+			STOP
+		};
+
+		uint64_t _kind;
+		uint64_t _instance;
+		uint64_t _node;
+		uint64_t _slot;
+
+		/**
+		 * @brief La posizione del token nella memoria condivisa o, per i
+		 * 			messaggi INPUT al processo principale, il vettore dei token
+		 */
+		uint64_t _offset;
+		uint64_t _size;
+	};
+
+	/**
+	 * @brief Inizializza un mutex e le condition variable condivisibili tra processi
+	 */
+	inline void init_shared_sync(pthread_mutex_t* mutex, std::initializer_list<pthread_cond_t*> conditions) {
+		pthread_mutexattr_t mutex_attr;
+		pthread_condattr_t 	cond_attr;
+
+		pthread_mutexattr_init(&mutex_attr);
+		pthread_mutexattr_setpshared(&mutex_attr, PTHREAD_PROCESS_SHARED);
+		pthread_mutex_init(mutex, &mutex_attr);
+		pthread_mutexattr_destroy(&mutex_attr);
+
+		pthread_condattr_init(&cond_attr);
+		pthread_condattr_setpshared(&cond_attr, PTHREAD_PROCESS_SHARED);
+
+		for(pthread_cond_t* condition : conditions) {
+			pthread_cond_init(condition, &cond_attr);
+		}
+
+		pthread_condattr_destroy(&cond_attr);
+	}
+
+	/**
+	 * @brief Attende la condizione al più per il tempo dato, il mutex deve
+	 * 			essere preso
+	 */
+	inline void shared_wait(pthread_cond_t* condition, pthread_mutex_t* mutex, long nanoseconds) {
+		timespec deadline;
+
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_nsec += nanoseconds;
+		deadline.tv_sec  += deadline.tv_nsec / 1000000000;
+		deadline.tv_nsec %= 1000000000;
+
+		pthread_cond_timedwait(condition, mutex, &deadline);
+	}
+
+	/**
+	 * @class SharedRing
+	 * @brief Coda circolare di messaggi in memoria condivisa, con un
+	 * 			consumatore e più produttori
+	 */
+	class SharedRing {
+	public:
+
+		static size_t footprint(size_t capacity) {
+			return sizeof(Header) + capacity * sizeof(ProcessMessage);
+		}
+
+		/**
+		 * @param memory la memoria condivisa della coda, di footprint(capacity) byte
+		 * @param capacity il numero dei messaggi, potenza di 2
+		 */
+		SharedRing(void* memory, size_t capacity);
+
+		bool try_push(const ProcessMessage& message);
+
+		/**
+		 * @brief Estrae un messaggio, attendendolo al più per il tempo dato
+		 *
+		 * @return falso se la coda è vuota
+		 */
+		bool pop(ProcessMessage& message, long nanoseconds);
+
+		/**
+		 * @brief Attende al più per il tempo dato che si liberi un posto
+		 */
+		void wait_not_full(long nanoseconds);
+
+	private:
+
+		struct Header {
+			pthread_mutex_t _mutex;
+			pthread_cond_t 	_not_empty;
+			pthread_cond_t 	_not_full;
+			size_t 			_head;
+			size_t 			_size;
+			size_t 			_capacity;
+		};
+
+		Header* 		_header;
+
+		ProcessMessage* _messages;
+
+	};
+
+	inline SharedRing::SharedRing(void* memory, size_t capacity) :
+		_header{static_cast<Header*>(memory)},
+		_messages{reinterpret_cast<ProcessMessage*>(_header + 1)}
+	{
+		init_shared_sync(&_header -> _mutex, {&_header -> _not_empty, &_header -> _not_full});
+
+		_header -> _head 	 = 0;
+		_header -> _size 	 = 0;
+		_header -> _capacity = capacity;
+	}
+
+	inline bool SharedRing::try_push(const ProcessMessage& message) {
+		pthread_mutex_lock(&_header -> _mutex);
+
+		bool pushed = _header -> _size < _header -> _capacity;
+
+		if (pushed) {
+			_messages[(_header -> _head + _header -> _size) & (_header -> _capacity - 1)] = message;
+			_header -> _size++;
+			pthread_cond_signal(&_header -> _not_empty);
+		}
+
+		pthread_mutex_unlock(&_header -> _mutex);
+		return pushed;
+	}
+
+	inline bool SharedRing::pop(ProcessMessage& message, long nanoseconds) {
+		pthread_mutex_lock(&_header -> _mutex);
+
+		if (_header -> _size == 0 && nanoseconds > 0)
+			shared_wait(&_header -> _not_empty, &_header -> _mutex, nanoseconds);
+
+		bool popped = _header -> _size > 0;
+
+		if (popped) {
+			message = _messages[_header -> _head];
+			_header -> _head = (_header -> _head + 1) & (_header -> _capacity - 1);
+			_header -> _size--;
+			pthread_cond_broadcast(&_header -> _not_full);
+		}
+
+		pthread_mutex_unlock(&_header -> _mutex);
+		return popped;
+	}
+
+	inline void SharedRing::wait_not_full(long nanoseconds) {
+		pthread_mutex_lock(&_header -> _mutex);
+
+		if (_header -> _size == _header -> _capacity)
+			shared_wait(&_header -> _not_full, &_header -> _mutex, nanoseconds);
+
+		pthread_mutex_unlock(&_header -> _mutex);
+	}
+
+	/**
+	 * @class SharedHeap
+	 * @brief Memoria condivisa dei token serializzati. I blocchi hanno
+	 * 			dimensioni potenze di 2 e vengono riciclati dalla lista
+	 * 			della loro dimensione, senza essere fusi.
+	 */
+	class SharedHeap {
+	public:
+
+		static constexpr size_t NONE = SIZE_MAX;
+
+		static size_t footprint(size_t size) {
+			return sizeof(Header) + size;
+		}
+
+		SharedHeap(void* memory, size_t size);
+
+		/**
+		 * @brief Alloca un blocco di almeno size byte
+		 *
+		 * @return la posizione del blocco, o NONE se la memoria è esaurita
+		 * @throw std::length_error se il blocco non può essere mai allocato
+		 */
+		size_t try_allocate(size_t size);
+
+		void deallocate(size_t offset);
+
+		/**
+		 * @brief Attende al più per il tempo dato che un blocco venga liberato
+		 */
+		void wait_freed(long nanoseconds);
+
+		char* data(size_t offset) {
+			return _data + offset;
+		}
+
+	private:
+
+		struct Header {
+			pthread_mutex_t _mutex;
+			pthread_cond_t 	_freed;
+			size_t 			_top;
+			size_t 			_capacity;
+			size_t 			_free[64];
+		};
+
+		/**
+		 * @brief Intestazione di un blocco, precede i dati
+		 */
+		struct Block {
+			size_t _class;
+			size_t _next;
+		};
+
+		Header* _header;
+
+		char* 	_data;
+
+	};
+
+	inline SharedHeap::SharedHeap(void* memory, size_t size) :
+		_header{static_cast<Header*>(memory)},
+		_data{reinterpret_cast<char*>(_header + 1)}
+	{
+		init_shared_sync(&_header -> _mutex, {&_header -> _freed});
+
+		_header -> _top 	 = 0;
+		_header -> _capacity = size;
+
+		std::fill(std::begin(_header -> _free), std::end(_header -> _free), NONE);
+	}
+
+	inline size_t SharedHeap::try_allocate(size_t size) {
+		size_t type = 6;
+
+		while (((size_t) 1 << type) < size + sizeof(Block)) {
+			type++;
+		}
+
+		if (((size_t) 1 << type) > _header -> _capacity)
+			throw std::length_error("Il token è più grande della memoria condivisa");
+
+		size_t block = NONE;
+
+		pthread_mutex_lock(&_header -> _mutex);
+
+		if (_header -> _free[type] != NONE) {
+			block = _header -> _free[type];
+			_header -> _free[type] = reinterpret_cast<Block*>(_data + block) -> _next;
+		} else if (_header -> _top + ((size_t) 1 << type) <= _header -> _capacity) {
+			block = _header -> _top;
+			_header -> _top += (size_t) 1 << type;
+		}
+
+		pthread_mutex_unlock(&_header -> _mutex);
+
+		if (block == NONE)
+			return NONE;
+
+		reinterpret_cast<Block*>(_data + block) -> _class = type;
+		return block + sizeof(Block);
+	}
+
+	inline void SharedHeap::deallocate(size_t offset) {
+		size_t block = offset - sizeof(Block);
+		Block* header = reinterpret_cast<Block*>(_data + block);
+
+		pthread_mutex_lock(&_header -> _mutex);
+
+		header -> _next = _header -> _free[header -> _class];
+		_header -> _free[header -> _class] = block;
+
+		pthread_cond_broadcast(&_header -> _freed);
+		pthread_mutex_unlock(&_header -> _mutex);
+	}
+
+	inline void SharedHeap::wait_freed(long nanoseconds) {
+		pthread_mutex_lock(&_header -> _mutex);
+		shared_wait(&_header -> _freed, &_header -> _mutex, nanoseconds);
+		pthread_mutex_unlock(&_header -> _mutex);
+	}
+
+	/**
+	 * @class ProcessExecutor
+	 * @brief Esegue un grafo ripartendone i nodi tra il processo
+	 * 			principale e dei processi figli, vedi Mdf::set_process.
+	 * Ogni processo esegue la propria Partition su un solo thread, così
+	 * che le librerie non thread-safe o che perdono memoria restino
+	 * isolate. I token tra nodi di processi diversi vengono serializzati in
+	 * una memoria condivisa e annunciati sulla coda del processo
+	 * destinatario; tra nodi dello stesso processo vengono spostati.
+	 * I figli vengono creati con fork dal costruttore, che va quindi
+	 * chiamato prima di avviare altri thread, e condividono con il
+	 * processo principale il grafo e le sue callable.
+	 * Se un figlio termina, il thread che serve il processo principale se
+	 * ne accorge alla prima attesa a vuoto e fa fallire con
+	 * std::runtime_error le esecuzioni in corso e quelle successive.
+	 */
+	class ProcessExecutor {
+	public:
+
+		/**
+		 * @param graph il grafo da eseguire, non più modificabile
+		 * @param config il numero dei processi e le dimensioni della
+		 * 			memoria condivisa
+		 * @throw std::invalid_argument se la ripartizione non è eseguibile,
+		 * 			vedi Partition::check
+		 */
+		ProcessExecutor(Mdf& graph, const ProcessConfig& config = ProcessConfig());
+
+		ProcessExecutor(const ProcessExecutor &) = delete;
+
+		/**
+		 * @brief Ferma i processi figli. Le esecuzioni in corso vengono
+		 * 			abbandonate.
+		 */
+		~ProcessExecutor();
+
+		/**
+		 * @brief Esegue un'istanza del grafo, passati gli argomenti di input
+		 *
+		 * @return un future contenente il risultato dell'esecuzione, o
+		 * 			std::runtime_error se un processo figlio è terminato
+		 */
+		template <typename ... Args>
+		std::future<token_vector_t*> run(Args && ... input_args);
+
+	private:
+
+		static constexpr size_t NO_PROCESS = SIZE_MAX;
+
+		static constexpr long WAIT = 1000000;
+
+		void serve(size_t process);
+
+		void send_token(size_t from, size_t to, uint64_t id, size_t node_id, size_t slot, Token* token);
+
+		void send(size_t from, size_t to, const ProcessMessage& message);
+
+		void drain(size_t process);
+
+		void reap();
+
+		Graph* 					_model;
+
+		ProcessConfig 			_config;
+
+		void* 					_shared;
+
+		size_t 					_shared_size;
+
+		std::vector<SharedRing> _rings;
+
+		std::unique_ptr<SharedHeap> _heap;
+
+		std::vector<pid_t> 		_children;
+
+		/**
+		 * @brief Processi terminati, in memoria condivisa così che nessun
+		 * 			processo attenda di inviare loro messaggi
+		 */
+		std::atomic<bool>* 		_exited;
+
+		/**
+		 * @brief Messaggi ricevuti mentre il processo attendeva di poter
+		 * 			inviare, da gestire prima della coda
+		 */
+		std::deque<ProcessMessage> _backlog;
+
+		std::mutex 				_mutex;
+
+		std::unordered_map<uint64_t, std::promise<token_vector_t*>> _promises;
+
+		/**
+		 * @brief L'errore delle esecuzioni, impostato quando un figlio termina
+		 */
+		std::exception_ptr 		_failure;
+
+		std::atomic<uint64_t> 	_next_instance;
+
+		std::thread 			_dispatcher;
+
+	};
+
+	inline ProcessExecutor::ProcessExecutor(Mdf& graph, const ProcessConfig& config) :
+		_model{graph._graph},
+		_config{config},
+		_shared{nullptr},
+		_exited{nullptr},
+		_next_instance{0}
+	{
+		if (_config._ring_capacity == 0 || (_config._ring_capacity & (_config._ring_capacity - 1)) != 0)
+			throw std::invalid_argument("La capacità delle code deve essere una potenza di 2");
+
+		graph.validate();
+		Partition::check(*_model, _config._processes + 1);
+
+		size_t ring_size = (SharedRing::footprint(_config._ring_capacity) + 63) / 64 * 64;
+		size_t processes = _config._processes + 1;
+		size_t flags_size = (processes * sizeof(std::atomic<bool>) + 63) / 64 * 64;
+
+		static_assert(std::atomic<bool>::is_always_lock_free, "I flag condivisi tra processi devono essere lock-free");
+
+		_shared_size = ring_size * processes + flags_size + SharedHeap::footprint(_config._heap_size);
+		_shared 	 = mmap(nullptr, _shared_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+		if (_shared == MAP_FAILED)
+			throw std::runtime_error(std::string("Impossibile allocare la memoria condivisa: ") + std::strerror(errno));
+
+		for(size_t i = 0; i < processes; i++) {
+			_rings.emplace_back(static_cast<char*>(_shared) + i * ring_size, _config._ring_capacity);
+		}
+
+		_exited = reinterpret_cast<std::atomic<bool>*>(static_cast<char*>(_shared) + processes * ring_size);
+
+		for(size_t i = 0; i < processes; i++) {
+			new (_exited + i) std::atomic<bool>(false);
+		}
+
+		_heap = std::make_unique<SharedHeap>(static_cast<char*>(_shared) + processes * ring_size + flags_size, _config._heap_size);
+
+		for(size_t i = 1; i < processes; i++) {
+			pid_t pid = fork();
+
+			if (pid == 0) {
+				serve(i);
+				_exit(0);
+			}
+
+			if (pid < 0) {
+				int error = errno;
+
+				// il distruttore non viene chiamato: si fermano i processi già creati
+				for(size_t j = 1; j <= _children.size(); j++) {
+					send(NO_PROCESS, j, ProcessMessage{ProcessMessage::STOP, 0, 0, 0, 0, 0});
+				}
+
+				for(pid_t& child : _children) {
+					waitpid(child, nullptr, 0);
+				}
+
+				munmap(_shared, _shared_size);
+				throw std::runtime_error(std::string("Impossibile creare il processo: ") + std::strerror(error));
+			}
+
+			_children.push_back(pid);
+		}
+
+		_dispatcher = std::thread([this] { serve(0); });
+	}
+
+	inline ProcessExecutor::~ProcessExecutor() {
+		// i figli già terminati sono stati raccolti dal dispatcher
+		for(size_t i = 1; i < _rings.size(); i++) {
+			if (!_exited[i])
+				send(NO_PROCESS, i, ProcessMessage{ProcessMessage::STOP, 0, 0, 0, 0, 0});
+		}
+
+		for(size_t i = 1; i < _rings.size(); i++) {
+			if (!_exited[i])
+				waitpid(_children[i - 1], nullptr, 0);
+		}
+
+		send(NO_PROCESS, 0, ProcessMessage{ProcessMessage::STOP, 0, 0, 0, 0, 0});
+		_dispatcher.join();
+
+		munmap(_shared, _shared_size);
+	}
+
+	/**
+	 * @brief Esegue i messaggi ricevuti dal processo finché non riceve STOP
+	 */
+	inline void ProcessExecutor::serve(size_t process) {
+		Partition partition(*_model, process);
+		ProcessMessage message;
+
+		auto forward = [this, process](size_t to, uint64_t id, size_t node_id, size_t slot, Token* token) {
+			send_token(process, to, id, node_id, slot, token);
+		};
+
+		auto complete = [this](uint64_t id, token_vector_t* output) {
+			std::lock_guard<std::mutex> lock(_mutex);
+			auto it = _promises.find(id);
+
+			// l'esecuzione è già fallita per la terminazione di un figlio
+			if (it == _promises.end()) {
+				release_token_vector(output);
+				return;
+			}
+
+			it -> second.set_value(output);
+			_promises.erase(it);
+		};
+
+		for(;;) {
+			if (!_backlog.empty()) {
+				message = _backlog.front();
+				_backlog.pop_front();
+			} else if (!_rings[process].pop(message, WAIT)) {
+				if (process == 0)
+					reap();
+
+				continue;
+			}
+
+			if (message._kind == ProcessMessage::STOP)
+				return;
+
+			if (message._kind == ProcessMessage::INPUT) {
+				partition.input(message._instance, reinterpret_cast<token_vector_t*>(message._offset), forward, complete);
+				continue;
+			}
+
+			{
+				MemoryBuffer buffer(_heap -> data(message._offset), message._size);
+				std::istream in(&buffer);
+
+				partition.receive(message._instance, message._node, message._slot, in, forward, complete);
+			}
+
+			_heap -> deallocate(message._offset);
+		}
+	}
+
+	/**
+	 * @brief Serializza il token nella memoria condivisa e lo annuncia al
+	 * 			processo del nodo destinatario
+	 */
+	inline void ProcessExecutor::send_token(size_t from, size_t to, uint64_t id, size_t node_id, size_t slot, Token* token) {
+		if (_exited[to])
+			return;
+
+		const IoVector& bytes = Partition::serialize(*_model, node_id, slot, token);
+		size_t offset;
+
+		while ((offset = _heap -> try_allocate(bytes.size())) == SharedHeap::NONE) {
+			if (_exited[to])
+				return;
+
+			drain(from);
+			_heap -> wait_freed(WAIT);
+		}
+
+		bytes.copy_to(_heap -> data(offset));
+		send(from, to, ProcessMessage{ProcessMessage::TOKEN, id, node_id, slot, offset, bytes.size()});
+	}
+
+	/**
+	 * @brief Accoda il messaggio al processo destinatario. Mentre la coda
+	 * 			è piena il mittente raccoglie i propri messaggi, così che
+	 * 			due processi che si inviano token non si blocchino a vicenda.
+	 *
+	 * 			Il messaggio viene scartato se il destinatario è terminato.
+	 *
+	 * @param from il processo che invia, NO_PROCESS se il thread non
+	 * 			serve nessuna coda
+	 */
+	inline void ProcessExecutor::send(size_t from, size_t to, const ProcessMessage& message) {
+		while (!_rings[to].try_push(message)) {
+			if (_exited[to]) {
+				if (message._kind == ProcessMessage::TOKEN)
+					_heap -> deallocate(message._offset);
+
+				return;
+			}
+
+			drain(from);
+			_rings[to].wait_not_full(WAIT);
+		}
+	}
+
+	inline void ProcessExecutor::drain(size_t process) {
+		ProcessMessage message;
+
+		if (process == NO_PROCESS)
+			return;
+
+		while (_rings[process].pop(message, 0)) {
+			_backlog.push_back(message);
+		}
+	}
+
+	/**
+	 * @brief Raccoglie i figli terminati e fa fallire le esecuzioni in
+	 * 			corso, che potrebbero attendere i loro nodi
+	 */
+	inline void ProcessExecutor::reap() {
+		for(size_t i = 1; i < _rings.size(); i++) {
+			if (_exited[i] || waitpid(_children[i - 1], nullptr, WNOHANG) != _children[i - 1])
+				continue;
+
+			_exited[i] = true;
+
+			std::lock_guard<std::mutex> lock(_mutex);
+
+			if (_failure == nullptr)
+				_failure = std::make_exception_ptr(std::runtime_error("Il processo " + std::to_string(i) + " è terminato"));
+
+			for(auto& pending : _promises) {
+				pending.second.set_exception(_failure);
+			}
+
+			_promises.clear();
+		}
+	}
+
+	template <typename ... Args>
+	inline std::future<token_vector_t*> ProcessExecutor::run(Args && ... input_args) {
+		Node& input 	= *_model -> _nodes[_model -> _input_node];
+		uint64_t id 	= _next_instance++;
+
+		if (input._input_size != sizeof...(Args))
+			throw std::invalid_argument("Il numero degli argomenti non corrisponde all'input del grafo");
+
+		std::future<token_vector_t*> future;
+
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+
+			if (_failure != nullptr) {
+				std::promise<token_vector_t*> failed;
+
+				failed.set_exception(_failure);
+				return failed.get_future();
+			}
+
+			future = _promises[id].get_future();
+		}
+
+		token_vector_t* tokens = acquire_token_vector(sizeof...(Args));
+		(tokens -> push_back(make_input_token(std::forward<Args>(input_args))), ...);
+
+		if (input._process == 0) {
+			send(NO_PROCESS, 0, ProcessMessage{ProcessMessage::INPUT, id, input._node_id, 0, reinterpret_cast<uint64_t>(tokens), 0});
+			return future;
+		}
+
+		for(size_t slot = 0; slot < tokens -> size(); slot++) {
+			send_token(NO_PROCESS, input._process, id, input._node_id, slot, tokens -> at(slot).get());
+		}
+
+		release_token_vector(tokens);
+		return future;
+	}
+
+}
+
+#endif /* PROCESS_EXECUTOR_HPP */
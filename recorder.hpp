@@ -0,0 +1,356 @@
+#ifndef RECORDER_HPP
+#define RECORDER_HPP
+
+#include <fstream>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <unordered_set>
+#include <stdexcept>
+#include "graph.hpp"
+#include "pool.hpp"
+#include "checkpoint.hpp"
+
+namespace mdf {
+
+	/**
+	 * @struct RecordConfig
+	 * @brief Parametri della registrazione delle esecuzioni
+	 */
+	struct RecordConfig {
+
+		/**
+		 * @brief Il file del log, sovrascritto
+		 */
+		std::string _path;
+
+		/**
+		 * @brief Viene registrata un'esecuzione ogni _sample_period
+		 */
+		size_t 		_sample_period = 1;
+
+		/**
+		 * @brief Dimensione del buffer di scrittura del log
+		 */
+		size_t 		_buffer_size = 1 << 20;
+	};
+
+	struct RecordStats {
+		uint64_t _runs = 0;
+		uint64_t _recorded = 0;
+		uint64_t _bytes_written = 0;
+	};
+
+	/**
+	 * @struct NodeTrace
+	 * @brief L'esecuzione di un nodo in una esecuzione registrata, con i
+	 * 			tempi in nanosecondi dall'avvio dell'esecuzione
+	 */
+	struct NodeTrace {
+
+		enum trace_flags : uint32_t {
+
+			/**
+			 * @brief Il nodo è stato eseguito
+			 */
+			EXECUTED = 1,
+
+			/**
+			 * @brief Il nodo è stato eseguito dal worker del predecessore,
+			 * 			perché nello stesso cluster, senza passare dalla coda
+			 */
+			INLINED = 2
+		};
+
+		/**
+		 * @brief Quando il nodo è diventato pronto
+		 */
+		uint64_t _ready_ns;
+
+		uint64_t _start_ns;
+
+		uint64_t _duration_ns;
+
+		/**
+		 * @brief La memoria dei token di input serializzabili, vedi
+		 * 			TokenCodec::_size
+		 */
+		uint64_t _input_bytes;
+
+		/**
+		 * @brief L'indice del worker che ha eseguito il nodo
+		 */
+		uint32_t _worker;
+
+		uint32_t _flags;
+	};
+
+	/**
+	 * @brief Ritorna l'indice del worker dell'Executor che esegue il thread,
+	 * 			UINT32_MAX per gli altri thread
+	 */
+	inline uint32_t& worker_index() {
+		thread_local uint32_t index = UINT32_MAX;
+		return index;
+	}
+
+	/**
+	 * @struct RunTrace
+	 * @brief La registrazione di un'esecuzione in corso. Ogni nodo viene
+	 * 			eseguito una volta per esecuzione, quindi i worker scrivono
+	 * 			elementi distinti senza sincronizzarsi.
+	 */
+	struct RunTrace {
+
+		/**
+		 * @brief Impronta del grafo, solo per le esecuzioni scritte nel log
+		 */
+		uint64_t 				_fingerprint;
+
+		uint64_t 				_run;
+
+		std::chrono::steady_clock::time_point _start;
+
+		std::vector<NodeTrace> 	_nodes;
+
+		/**
+		 * @brief Le destinazioni della registrazione: il log di RunRecorder
+		 * 			e le latenze di LatencySampler
+		 */
+		bool 					_recorded;
+
+		bool 					_sampled;
+
+		/**
+		 * @brief Ritorna una registrazione presa dalla pool, avviata ora
+		 */
+		static RunTrace* acquire(const Graph& model);
+
+		static void release(RunTrace* trace) {
+			ObjectPool<RunTrace>::instance().release(trace);
+		}
+
+		uint64_t elapsed(std::chrono::steady_clock::time_point time) const {
+			return std::chrono::duration_cast<std::chrono::nanoseconds>(time - _start).count();
+		}
+
+		/**
+		 * @brief Registra che il nodo è diventato pronto
+		 *
+		 * @param inlined vero se verrà eseguito dallo stesso worker
+		 */
+		void ready(size_t node_id, bool inlined) {
+			_nodes[node_id]._ready_ns = elapsed(std::chrono::steady_clock::now());
+
+			if (inlined)
+				_nodes[node_id]._flags |= NodeTrace::INLINED;
+		}
+
+		/**
+		 * @brief Registra la memoria dei token di input, prima che il nodo
+		 * 			li consumi
+		 */
+		void executing(const Node& node);
+
+		/**
+		 * @brief Registra l'esecuzione del nodo
+		 */
+		void executed(size_t node_id, std::chrono::steady_clock::time_point start,
+			std::chrono::steady_clock::time_point end);
+	};
+
+	/**
+	 * @class RunRecorder
+	 * @brief Scrive il log binario delle esecuzioni campionate di un
+	 * 			Executor, vedi Executor::set_recording e RunLog.
+	 * Il log inizia con "MDFRUNL1" ed è una sequenza di blocchi, ciascuno
+	 * preceduto dal proprio tipo:
+	 * - GRAPH: impronta, numero dei nodi, nodo di input e di output e, per
+	 *   ogni nodo, tipo, dimensione di input e output, cluster e archi
+	 *   (nodo, slot). Viene scritto la prima volta che un grafo viene
+	 *   registrato.
+	 * - RUN: impronta del grafo, numero dell'esecuzione, istante di avvio,
+	 *   numero dei nodi e un NodeTrace per nodo.
+	 */
+	class RunRecorder {
+	public:
+
+		enum block_kind : uint64_t {
+			GRAPH = 1,
+			RUN = 2
+		};
+
+		static constexpr char MAGIC[8] = {'M', 'D', 'F', 'R', 'U', 'N', 'L', '1'};
+
+		/**
+		 * @throw std::runtime_error se il log non può essere creato
+		 */
+		RunRecorder(const RecordConfig& config);
+
+		RunRecorder(const RunRecorder &) = delete;
+
+		/**
+		 * @brief Conta un'esecuzione e ritorna vero se va registrata
+		 *
+		 * @param run il numero dell'esecuzione
+		 */
+		bool sample(uint64_t& run);
+
+		/**
+		 * @brief Associa la registrazione dell'esecuzione run al grafo,
+		 * 			scrivendone la struttura la prima volta
+		 */
+		void attach(const Graph& model, RunTrace* trace, uint64_t run);
+
+		/**
+		 * @brief Scrive la registrazione dell'esecuzione completata
+		 */
+		void finish(const RunTrace* trace);
+
+		RecordStats stats();
+
+	private:
+
+		void write_graph(const Graph& model, uint64_t fingerprint);
+
+		RecordConfig 			_config;
+
+		std::vector<char> 		_buffer;
+
+		std::ofstream 			_out;
+
+		std::mutex 				_mutex;
+
+		/**
+		 * @brief Le impronte dei grafi già scritti nel log
+		 */
+		std::unordered_set<uint64_t> _graphs;
+
+		std::atomic<uint64_t> 	_runs;
+
+		RecordStats 			_stats;
+
+	};
+
+	inline void RunTrace::executing(const Node& node) {
+		NodeTrace& trace = _nodes[node._node_id];
+
+		if (node._type != STANDARD)
+			return;
+
+		for(size_t slot = 0; slot < node._input_tokens.size(); slot++) {
+			const TokenCodec* codec = node._function -> input_codec(slot);
+			Token* token = node._input_tokens[slot].get();
+
+			if (codec != nullptr && token != nullptr && codec -> _owned(token))
+				trace._input_bytes += codec -> _size(token);
+		}
+	}
+
+	inline void RunTrace::executed(size_t node_id, std::chrono::steady_clock::time_point start,
+		std::chrono::steady_clock::time_point end) {
+		NodeTrace& trace = _nodes[node_id];
+
+		trace._start_ns 	= elapsed(start);
+		trace._duration_ns 	= std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+		trace._worker 		= worker_index();
+		trace._flags 	   |= NodeTrace::EXECUTED;
+	}
+
+	inline RunRecorder::RunRecorder(const RecordConfig& config) :
+		_config{config},
+		_buffer(config._buffer_size),
+		_runs{0}
+	{
+		if (_config._sample_period == 0)
+			_config._sample_period = 1;
+
+		_out.rdbuf() -> pubsetbuf(_buffer.data(), _buffer.size());
+		_out.open(_config._path, std::ios::binary | std::ios::trunc);
+
+		if (!_out)
+			throw std::runtime_error("Impossibile creare il log " + _config._path);
+
+		_out.write(MAGIC, sizeof(MAGIC));
+		_stats._bytes_written = sizeof(MAGIC);
+	}
+
+	inline RunTrace* RunTrace::acquire(const Graph& model) {
+		RunTrace* trace = ObjectPool<RunTrace>::instance().acquire();
+
+		trace -> _fingerprint = 0;
+		trace -> _run 		  = 0;
+		trace -> _nodes.assign(model._nodes.size(), NodeTrace{0, 0, 0, 0, UINT32_MAX, 0});
+		trace -> _recorded 	  = false;
+		trace -> _sampled 	  = false;
+		trace -> _start 	  = std::chrono::steady_clock::now();
+
+		return trace;
+	}
+
+	inline bool RunRecorder::sample(uint64_t& run) {
+		run = _runs.fetch_add(1, std::memory_order_relaxed);
+
+		return run % _config._sample_period == 0;
+	}
+
+	inline void RunRecorder::attach(const Graph& model, RunTrace* trace, uint64_t run) {
+		trace -> _fingerprint = CheckpointManager::fingerprint(model);
+		trace -> _run 		  = run;
+		trace -> _recorded 	  = true;
+
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		if (_graphs.insert(trace -> _fingerprint).second)
+			write_graph(model, trace -> _fingerprint);
+	}
+
+	inline void RunRecorder::write_graph(const Graph& model, uint64_t fingerprint) {
+		std::vector<uint64_t> block{GRAPH, fingerprint, model._nodes.size(),
+			static_cast<uint64_t>(model._input_node), static_cast<uint64_t>(model._output_node)};
+
+		for(const auto& node : model._nodes) {
+			block.insert(block.end(), {static_cast<uint64_t>(node -> _type), node -> _input_size,
+				node -> _output_size, node -> _cluster, node -> _output_map -> size()});
+
+			for(const auto& target : *node -> _output_map) {
+				block.insert(block.end(), {std::get<0>(target), std::get<1>(target)});
+			}
+		}
+
+		_out.write(reinterpret_cast<const char*>(block.data()), block.size() * sizeof(uint64_t));
+		_stats._bytes_written += block.size() * sizeof(uint64_t);
+	}
+
+	inline void RunRecorder::finish(const RunTrace* trace) {
+		uint64_t header[5] = {RUN, trace -> _fingerprint, trace -> _run,
+			static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+				trace -> _start.time_since_epoch()).count()),
+			trace -> _nodes.size()};
+
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+
+			_out.write(reinterpret_cast<const char*>(header), sizeof(header));
+			_out.write(reinterpret_cast<const char*>(trace -> _nodes.data()), trace -> _nodes.size() * sizeof(NodeTrace));
+			_out.flush();
+
+			_stats._recorded++;
+			_stats._bytes_written += sizeof(header) + trace -> _nodes.size() * sizeof(NodeTrace);
+		}
+	}
+
+	inline RecordStats RunRecorder::stats() {
+		std::lock_guard<std::mutex> lock(_mutex);
+		RecordStats stats = _stats;
+
+		stats._runs = _runs.load(std::memory_order_relaxed);
+
+		return stats;
+	}
+
+}
+
+#endif /* RECORDER_HPP */
@@ -0,0 +1,362 @@
+#ifndef REPLAY_HPP
+#define REPLAY_HPP
+
+#include <fstream>
+#include <memory>
+#include <vector>
+#include <string>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <stdexcept>
+#include "mdf.hpp"
+#include "recorder.hpp"
+
+namespace mdf {
+
+	/**
+	 * @struct RecordedNode
+	 * @brief La struttura di un nodo di un grafo registrato
+	 */
+	struct RecordedNode {
+		node_type 	_type;
+		size_t 		_input_size;
+		size_t 		_output_size;
+		size_t 		_cluster;
+
+		/**
+		 * @brief Gli archi (nodo, slot) in ordine di output
+		 */
+		std::vector<std::pair<size_t, size_t>> _outputs;
+	};
+
+	struct RecordedGraph {
+		uint64_t 	_fingerprint;
+		size_t 		_input_node;
+		size_t 		_output_node;
+		std::vector<RecordedNode> _nodes;
+	};
+
+	struct RecordedRun {
+		uint64_t 	_fingerprint;
+		uint64_t 	_run;
+
+		/**
+		 * @brief L'istante di avvio, sull'orologio monotono del processo
+		 */
+		uint64_t 	_start_ns;
+
+		std::vector<NodeTrace> _nodes;
+
+		/**
+		 * @brief Ritorna il tempo tra l'avvio e la fine dell'ultimo nodo
+		 */
+		uint64_t makespan() const {
+			uint64_t end = 0;
+
+			for(const NodeTrace& node : _nodes) {
+				end = std::max(end, node._start_ns + node._duration_ns);
+			}
+
+			return end;
+		}
+	};
+
+	/**
+	 * @struct ScheduleEntry
+	 * @brief Un nodo eseguito da un worker in un'esecuzione registrata
+	 */
+	struct ScheduleEntry {
+		size_t 		_node;
+		uint64_t 	_start_ns;
+		uint64_t 	_end_ns;
+
+		/**
+		 * @brief Il tempo passato dal nodo pronto in attesa di un worker
+		 */
+		uint64_t 	_wait_ns;
+
+		bool 		_inlined;
+	};
+
+	/**
+	 * @class ReplayFunction
+	 * @brief Funzione che occupa il worker per le durate registrate di un
+	 * 			nodo, a turno, e produce token vuoti. Sostituisce il codice
+	 * 			dei nodi nei grafi ricostruiti da RunLog::rebuild.
+	 */
+	class ReplayFunction : public Function {
+	public:
+
+		ReplayFunction(size_t arity, size_t output_size, std::vector<uint64_t> durations) :
+			_arity{arity},
+			_output_size{output_size},
+			_durations{std::move(durations)},
+			_next{0}
+		{}
+
+		size_t get_arity() const { return _arity; }
+
+		size_t get_output_size() const { return _output_size; }
+
+		token_vector_t* execute(token_vector_t& input) const;
+
+		void execute(token_vector_t& input, ResultSink& sink) const {
+			sink.accept(execute(input));
+		}
+
+	private:
+
+		size_t 					_arity;
+
+		size_t 					_output_size;
+
+		std::vector<uint64_t> 	_durations;
+
+		mutable std::atomic<size_t> _next;
+
+	};
+
+	inline token_vector_t* ReplayFunction::execute(token_vector_t&) const {
+		if (!_durations.empty()) {
+			auto start 	  = std::chrono::steady_clock::now();
+			auto duration = std::chrono::nanoseconds(_durations[_next.fetch_add(1, std::memory_order_relaxed) % _durations.size()]);
+
+			// attesa attiva: il worker resta occupato come con il nodo originale
+			while (std::chrono::steady_clock::now() - start < duration);
+		}
+
+		token_vector_t* output = acquire_token_vector(_output_size);
+
+		for(size_t i = 0; i < _output_size; i++) {
+			output -> push_back(make_token<uint64_t>(0));
+		}
+
+		return output;
+	}
+
+	/**
+	 * @class RunLog
+	 * @brief Il contenuto di un log scritto da RunRecorder. Permette di
+	 * 			ricostruire lo schedule delle esecuzioni registrate, di
+	 * 			ottenere i costi dei nodi per il Simulator e di ricostruire
+	 * 			il grafo con nodi sintetici per eseguirlo senza il codice
+	 * 			originale.
+	 */
+	class RunLog {
+	public:
+
+		/**
+		 * @throw std::runtime_error se il file non è un log o è troncato
+		 */
+		static RunLog load(const std::string& path);
+
+		const std::vector<RecordedGraph>& graphs() const {
+			return _graphs;
+		}
+
+		const std::vector<RecordedRun>& runs() const {
+			return _runs;
+		}
+
+		/**
+		 * @throw std::invalid_argument se il grafo non è nel log
+		 */
+		const RecordedGraph& graph(uint64_t fingerprint) const;
+
+		/**
+		 * @brief Ritorna i nodi eseguiti da ogni worker, in ordine di avvio
+		 */
+		std::vector<std::vector<ScheduleEntry>> schedule(const RecordedRun& run) const;
+
+		/**
+		 * @brief Ritorna la durata media di ogni nodo nelle esecuzioni
+		 * 			registrate del grafo, in nanosecondi
+		 */
+		std::vector<double> mean_costs(uint64_t fingerprint) const;
+
+		/**
+		 * @brief Ricostruisce il grafo con la stessa struttura e lo stesso
+		 * 			clustering, con nodi che durano quanto le esecuzioni
+		 * 			registrate. Il nodo di input riceve un solo argomento,
+		 * 			di qualsiasi tipo.
+		 */
+		std::unique_ptr<Mdf> rebuild(uint64_t fingerprint) const;
+
+	private:
+
+		std::vector<RecordedGraph> 	_graphs;
+
+		std::vector<RecordedRun> 	_runs;
+
+	};
+
+	inline RunLog RunLog::load(const std::string& path) {
+		std::ifstream in(path, std::ios::binary);
+		char magic[sizeof(RunRecorder::MAGIC)];
+		RunLog log;
+
+		if (!in.read(magic, sizeof(magic)) || !std::equal(magic, magic + sizeof(magic), RunRecorder::MAGIC))
+			throw std::runtime_error("Il file " + path + " non è un log delle esecuzioni");
+
+		auto read = [&in, &path]() {
+			uint64_t value;
+
+			if (!in.read(reinterpret_cast<char*>(&value), sizeof(value)))
+				throw std::runtime_error("Il log " + path + " è troncato");
+
+			return value;
+		};
+
+		uint64_t kind;
+
+		while (in.read(reinterpret_cast<char*>(&kind), sizeof(kind))) {
+			if (kind == RunRecorder::GRAPH) {
+				RecordedGraph graph;
+
+				graph._fingerprint = read();
+				graph._nodes.resize(read());
+				graph._input_node  = read();
+				graph._output_node = read();
+
+				for(RecordedNode& node : graph._nodes) {
+					node._type 		  = static_cast<node_type>(read());
+					node._input_size  = read();
+					node._output_size = read();
+					node._cluster 	  = read();
+					node._outputs.resize(read());
+
+					for(auto& target : node._outputs) {
+						target.first  = read();
+						target.second = read();
+					}
+				}
+
+				log._graphs.push_back(std::move(graph));
+			} else if (kind == RunRecorder::RUN) {
+				RecordedRun run;
+
+				run._fingerprint = read();
+				run._run 		 = read();
+				run._start_ns 	 = read();
+				run._nodes.resize(read());
+
+				if (!in.read(reinterpret_cast<char*>(run._nodes.data()), run._nodes.size() * sizeof(NodeTrace)))
+					throw std::runtime_error("Il log " + path + " è troncato");
+
+				log._runs.push_back(std::move(run));
+			} else {
+				throw std::runtime_error("Blocco sconosciuto nel log " + path);
+			}
+		}
+
+		return log;
+	}
+
+	inline const RecordedGraph& RunLog::graph(uint64_t fingerprint) const {
+		for(const RecordedGraph& graph : _graphs) {
+			if (graph._fingerprint == fingerprint)
+				return graph;
+		}
+
+		throw std::invalid_argument("Il grafo " + std::to_string(fingerprint) + " non è nel log");
+	}
+
+	inline std::vector<std::vector<ScheduleEntry>> RunLog::schedule(const RecordedRun& run) const {
+		std::vector<std::vector<ScheduleEntry>> workers;
+
+		for(size_t id = 0; id < run._nodes.size(); id++) {
+			const NodeTrace& node = run._nodes[id];
+
+			if (!(node._flags & NodeTrace::EXECUTED) || node._worker == UINT32_MAX)
+				continue;
+
+			if (node._worker >= workers.size())
+				workers.resize(node._worker + 1);
+
+			workers[node._worker].push_back(ScheduleEntry{id, node._start_ns, node._start_ns + node._duration_ns,
+				node._start_ns > node._ready_ns ? node._start_ns - node._ready_ns : 0,
+				(node._flags & NodeTrace::INLINED) != 0});
+		}
+
+		for(auto& entries : workers) {
+			std::sort(entries.begin(), entries.end(), [](const ScheduleEntry& a, const ScheduleEntry& b) {
+				return a._start_ns < b._start_ns;
+			});
+		}
+
+		return workers;
+	}
+
+	inline std::vector<double> RunLog::mean_costs(uint64_t fingerprint) const {
+		const RecordedGraph& recorded = graph(fingerprint);
+		std::vector<double> total(recorded._nodes.size(), 0);
+		std::vector<size_t> count(recorded._nodes.size(), 0);
+
+		for(const RecordedRun& run : _runs) {
+			if (run._fingerprint != fingerprint)
+				continue;
+
+			for(size_t id = 0; id < run._nodes.size() && id < total.size(); id++) {
+				if (run._nodes[id]._flags & NodeTrace::EXECUTED) {
+					total[id] += run._nodes[id]._duration_ns;
+					count[id]++;
+				}
+			}
+		}
+
+		for(size_t id = 0; id < total.size(); id++) {
+			total[id] = count[id] > 0 ? total[id] / count[id] : 0;
+		}
+
+		return total;
+	}
+
+	inline std::unique_ptr<Mdf> RunLog::rebuild(uint64_t fingerprint) const {
+		const RecordedGraph& recorded = graph(fingerprint);
+		std::vector<std::vector<uint64_t>> durations(recorded._nodes.size());
+		std::unique_ptr<Mdf> graph = std::make_unique<Mdf>();
+		std::vector<Instruction> nodes;
+
+		for(const RecordedRun& run : _runs) {
+			if (run._fingerprint != fingerprint)
+				continue;
+
+			for(size_t id = 0; id < run._nodes.size() && id < durations.size(); id++) {
+				if (run._nodes[id]._flags & NodeTrace::EXECUTED)
+					durations[id].push_back(run._nodes[id]._duration_ns);
+			}
+		}
+
+		for(size_t id = 0; id < recorded._nodes.size(); id++) {
+			const RecordedNode& node = recorded._nodes[id];
+
+			if (id == recorded._input_node || node._type == STANDARD)
+				nodes.push_back(graph -> emplace_function(std::make_shared<ReplayFunction>(
+					id == recorded._input_node ? 1 : node._input_size, node._output_size, std::move(durations[id]))));
+			else if (node._type == SPLIT)
+				nodes.push_back(graph -> split_node(node._output_size));
+			else
+				nodes.push_back(graph -> merge_node(node._input_size));
+		}
+
+		for(size_t id = 0; id < recorded._nodes.size(); id++) {
+			for(const auto& target : recorded._nodes[id]._outputs) {
+				graph -> add_output(nodes[id], {nodes[target.first](), target.second});
+			}
+		}
+
+		graph -> mark_as_input(nodes[recorded._input_node]);
+		graph -> mark_as_output(nodes[recorded._output_node]);
+		graph -> validate();
+
+		for(size_t id = 0; id < recorded._nodes.size(); id++) {
+			graph -> _graph -> _nodes[id] -> _cluster = recorded._nodes[id]._cluster;
+		}
+
+		return graph;
+	}
+
+}
+
+#endif /* REPLAY_HPP */
@@ -0,0 +1,870 @@
+#ifndef SERIALIZATION_HPP
+#define SERIALIZATION_HPP
+
+#include <istream>
+#include <ostream>
+#include <streambuf>
+#include <type_traits>
+#include <typeinfo>
+#include <utility>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <array>
+#include <tuple>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <stdexcept>
+#include <cstring>
+#include <cerrno>
+#include <climits>
+#include <cstdint>
+#include <sys/uio.h>
+#include <sys/socket.h>
+#include "token.hpp"
+#include "memory.hpp"
+
+namespace mdf {
+
+	/**
+	 * @class IoVector
+	 * @brief I byte di un valore serializzato come sequenza di segmenti.
+	 * I segmenti aggiunti con append() si riferiscono alla memoria del
+	 * valore senza copiarla e restano validi finché il valore non viene
+	 * modificato; quelli aggiunti con copy(), come i prefissi di lunghezza,
+	 * vengono copiati in memoria dell'IoVector.
+	 */
+	class IoVector {
+	public:
+
+		IoVector() :
+			_used{0},
+			_size{0}
+		{}
+
+		IoVector(const IoVector &) = delete;
+
+		/**
+		 * @brief Aggiunge un segmento che si riferisce a data, senza copiarlo
+		 */
+		void append(const void* data, size_t size);
+
+		/**
+		 * @brief Aggiunge i segmenti di un altro IoVector, che deve restare
+		 * 			valido finché questo viene usato
+		 */
+		void append(const IoVector& other);
+
+		/**
+		 * @brief Copia i byte in coda all'IoVector
+		 */
+		void copy(const void* data, size_t size);
+
+		template <typename T>
+		void copy_value(const T& value) {
+			copy(&value, sizeof(T));
+		}
+
+		/**
+		 * @brief Svuota l'IoVector, conservando la memoria delle copie
+		 */
+		void clear();
+
+		size_t size() const {
+			return _size;
+		}
+
+		const std::vector<iovec>& segments() const {
+			return _segments;
+		}
+
+		/**
+		 * @brief Copia tutti i byte a partire da destination
+		 */
+		void copy_to(char* destination) const;
+
+		/**
+		 * @brief Aggiunge tutti i byte in coda alla stringa
+		 */
+		void append_to(std::string& destination) const;
+
+		/**
+		 * @brief Scrive tutti i byte sul file con writev
+		 *
+		 * @return falso se la scrittura fallisce
+		 */
+		bool write(int fd) const;
+
+		/**
+		 * @brief Scrive tutti i byte sul socket con sendmsg, senza SIGPIPE
+		 * 			se la connessione è chiusa
+		 *
+		 * @return falso se la connessione è stata chiusa
+		 */
+		bool send(int fd) const;
+
+	private:
+
+		static constexpr size_t SCRATCH = 4096;
+
+		template <typename W>
+		bool write_segments(W&& write) const;
+
+		std::vector<iovec> 		_segments;
+
+		/**
+		 * @brief La memoria dei byte copiati; si usa sempre l'ultimo blocco
+		 */
+		std::vector<std::pair<std::unique_ptr<char[]>, size_t>> _scratch;
+
+		size_t 					_used;
+
+		size_t 					_size;
+
+	};
+
+	inline void IoVector::append(const void* data, size_t size) {
+		if (size == 0)
+			return;
+
+		_segments.push_back(iovec{const_cast<void*>(data), size});
+		_size += size;
+	}
+
+	inline void IoVector::append(const IoVector& other) {
+		_segments.insert(_segments.end(), other._segments.begin(), other._segments.end());
+		_size += other._size;
+	}
+
+	inline void IoVector::copy(const void* data, size_t size) {
+		if (size == 0)
+			return;
+
+		if (_scratch.empty() || _scratch.back().second - _used < size) {
+			size_t capacity = std::max(SCRATCH, size);
+
+			_scratch.emplace_back(std::make_unique<char[]>(capacity), capacity);
+			_used = 0;
+		}
+
+		char* position = _scratch.back().first.get() + _used;
+		std::memcpy(position, data, size);
+		_used += size;
+		_size += size;
+
+		// le copie consecutive formano un solo segmento
+		if (!_segments.empty() && static_cast<char*>(_segments.back().iov_base) + _segments.back().iov_len == position)
+			_segments.back().iov_len += size;
+		else
+			_segments.push_back(iovec{position, size});
+	}
+
+	inline void IoVector::clear() {
+		if (_scratch.size() > 1)
+			_scratch.erase(_scratch.begin(), _scratch.end() - 1);
+
+		_segments.clear();
+		_used = 0;
+		_size = 0;
+	}
+
+	inline void IoVector::copy_to(char* destination) const {
+		for(const iovec& segment : _segments) {
+			std::memcpy(destination, segment.iov_base, segment.iov_len);
+			destination += segment.iov_len;
+		}
+	}
+
+	inline void IoVector::append_to(std::string& destination) const {
+		destination.reserve(destination.size() + _size);
+
+		for(const iovec& segment : _segments) {
+			destination.append(static_cast<const char*>(segment.iov_base), segment.iov_len);
+		}
+	}
+
+	/**
+	 * @brief Scrive i segmenti a gruppi di IOV_MAX, riprendendo dalle
+	 * 			scritture parziali
+	 */
+	template <typename W>
+	inline bool IoVector::write_segments(W&& write) const {
+		std::vector<iovec> pending(_segments);
+		size_t first = 0;
+
+		while (first < pending.size()) {
+			int count = static_cast<int>(std::min<size_t>(pending.size() - first, IOV_MAX));
+			ssize_t written = write(&pending[first], count);
+
+			if (written < 0 && errno == EINTR)
+				continue;
+
+			if (written <= 0)
+				return false;
+
+			while (first < pending.size() && static_cast<size_t>(written) >= pending[first].iov_len) {
+				written -= pending[first].iov_len;
+				first++;
+			}
+
+			if (written > 0) {
+				pending[first].iov_base = static_cast<char*>(pending[first].iov_base) + written;
+				pending[first].iov_len -= written;
+			}
+		}
+
+		return true;
+	}
+
+	inline bool IoVector::write(int fd) const {
+		return write_segments([fd](iovec* segments, int count) {
+			return ::writev(fd, segments, count);
+		});
+	}
+
+	inline bool IoVector::send(int fd) const {
+		return write_segments([fd](iovec* segments, int count) {
+			msghdr message{};
+
+			message.msg_iov    = segments;
+			message.msg_iovlen = count;
+
+			return ::sendmsg(fd, &message, MSG_NOSIGNAL);
+		});
+	}
+
+	/**
+	 * @brief Stream buffer che copia i byte scritti in un IoVector, per i
+	 * 			Serializer che scrivono solo su std::ostream
+	 */
+	class IoVectorBuffer : public std::streambuf {
+	public:
+
+		IoVectorBuffer(IoVector& destination) :
+			_destination{destination}
+		{}
+
+	protected:
+
+		std::streamsize xsputn(const char* data, std::streamsize size) {
+			_destination.copy(data, size);
+			return size;
+		}
+
+		int_type overflow(int_type c) {
+			if (!traits_type::eq_int_type(c, traits_type::eof())) {
+				char value = traits_type::to_char_type(c);
+				_destination.copy(&value, 1);
+			}
+
+			return traits_type::not_eof(c);
+		}
+
+	private:
+
+		IoVector& _destination;
+
+	};
+
+	/**
+	 * @struct Serializer
+	 * @brief Punto di estensione per la serializzazione dei token di tipo T.
+	 * Un tipo diventa serializzabile specializzando Serializer con:
+	 *
+	 * 	static void serialize(const T& value, std::ostream& out);
+	 * 	static T deserialize(std::istream& in);
+	 *
+	 * e, facoltativamente, con:
+	 *
+	 * 	static size_t size(const T& value);
+	 * 		la memoria occupata dal valore; se assente si usa sizeof(T)
+	 * 	static void gather(const T& value, IoVector& out);
+	 * 		gli stessi byte di serialize, riferendo la memoria del valore
+	 * 		invece di copiarla
+	 * 	static std::string name();
+	 * 		il nome del tipo nel TokenTypeRegistry, da cui si ricava
+	 * 		l'id, vedi token_type_id; se assente si usa typeid(T).name(),
+	 * 		che può cambiare tra compilatori: va definito se il token è
+	 * 		letto da un programma compilato diversamente
+	 *
+	 * Sono già serializzabili i tipi banalmente copiabili, vedi
+	 * is_bitwise_serializable, std::basic_string e std::vector, std::array,
+	 * std::pair e std::tuple di tipi serializzabili.
+	 */
+	template <typename T, typename = void>
+	struct Serializer {};
+
+	template <typename T, typename = void>
+	struct is_serializable : std::false_type {};
+
+	template <typename T>
+	struct is_serializable<T, std::void_t<
+		decltype(Serializer<T>::serialize(std::declval<const T&>(), std::declval<std::ostream&>())),
+		decltype(Serializer<T>::deserialize(std::declval<std::istream&>()))>> : std::true_type {};
+
+	template <typename T, typename = void>
+	struct has_serialized_size : std::false_type {};
+
+	template <typename T>
+	struct has_serialized_size<T, std::void_t<
+		decltype(Serializer<T>::size(std::declval<const T&>()))>> : std::true_type {};
+
+	template <typename T, typename = void>
+	struct has_gather : std::false_type {};
+
+	template <typename T>
+	struct has_gather<T, std::void_t<
+		decltype(Serializer<T>::gather(std::declval<const T&>(), std::declval<IoVector&>()))>> : std::true_type {};
+
+	template <typename T, typename = void>
+	struct has_type_name : std::false_type {};
+
+	template <typename T>
+	struct has_type_name<T, std::void_t<decltype(Serializer<T>::name())>> : std::true_type {};
+
+	/**
+	 * @struct is_bitwise_serializable
+	 * @brief Vero per i tipi serializzati copiandone la rappresentazione in
+	 * 			memoria: i tipi banalmente copiabili che non sono puntatori.
+	 * Va specializzato a std::false_type per le strutture che contengono
+	 * puntatori, che non avrebbero senso in un altro processo.
+	 */
+	template <typename T>
+	struct is_bitwise_serializable : std::bool_constant<
+		std::is_trivially_copyable<T>::value && !std::is_pointer<T>::value &&
+		!std::is_member_pointer<T>::value> {};
+
+	template <typename C, typename Traits>
+	struct is_bitwise_serializable<std::basic_string_view<C, Traits>> : std::false_type {};
+
+	/**
+	 * @brief Ritorna la memoria occupata dal valore, vedi Serializer::size
+	 */
+	template <typename T>
+	inline size_t serialized_size(const T& value) {
+		if constexpr (has_serialized_size<T>::value)
+			return Serializer<T>::size(value);
+		else
+			return sizeof(T);
+	}
+
+	/**
+	 * @brief Aggiunge i byte serializzati del valore all'IoVector, senza
+	 * 			copiarli se il Serializer lo permette
+	 */
+	template <typename T>
+	inline void gather(const T& value, IoVector& out) {
+		if constexpr (has_gather<T>::value) {
+			Serializer<T>::gather(value, out);
+		} else {
+			IoVectorBuffer buffer(out);
+			std::ostream stream(&buffer);
+
+			Serializer<T>::serialize(value, stream);
+		}
+	}
+
+	/**
+	 * @brief Ritorna il nome del tipo nel TokenTypeRegistry, vedi Serializer::name
+	 */
+	template <typename T>
+	inline std::string token_type_name() {
+		if constexpr (has_type_name<T>::value) {
+			return Serializer<T>::name();
+		} else if constexpr (std::is_same<T, bool>::value) {
+			return "bool";
+		} else if constexpr (std::is_same<T, char>::value) {
+			return "char";
+		} else if constexpr (std::is_integral<T>::value) {
+			return (std::is_signed<T>::value ? "i" : "u") + std::to_string(sizeof(T) * 8);
+		} else if constexpr (std::is_floating_point<T>::value) {
+			return "f" + std::to_string(sizeof(T) * 8);
+		} else {
+			return typeid(T).name();
+		}
+	}
+
+	/**
+	 * @brief Ritorna l'id del tipo, l'hash FNV-1a del suo nome. Viene
+	 * 			scritto prima di ogni token negli snapshot e nei file
+	 * 			scaricati, che vengono letti con il codec registrato con
+	 * 			quell'id, vedi TokenTypeRegistry.
+	 */
+	template <typename T>
+	inline uint64_t token_type_id() {
+		static const uint64_t id = [] {
+			uint64_t hash = 14695981039346656037ull;
+
+			for(unsigned char c : token_type_name<T>()) {
+				hash = (hash ^ c) * 1099511628211ull;
+			}
+
+			return hash;
+		}();
+
+		return id;
+	}
+
+	template <typename T>
+	struct Serializer<T, std::enable_if_t<is_bitwise_serializable<T>::value>> {
+
+		static void serialize(const T& value, std::ostream& out) {
+			out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+		}
+
+		static T deserialize(std::istream& in) {
+			typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+
+			in.read(reinterpret_cast<char*>(&storage), sizeof(T));
+			return *reinterpret_cast<T*>(&storage);
+		}
+
+		static void gather(const T& value, IoVector& out) {
+			out.append(&value, sizeof(T));
+		}
+	};
+
+	template <typename C, typename Traits, typename Allocator>
+	struct Serializer<std::basic_string<C, Traits, Allocator>,
+		std::enable_if_t<is_bitwise_serializable<C>::value>> {
+
+		using string_t = std::basic_string<C, Traits, Allocator>;
+
+		static void serialize(const string_t& value, std::ostream& out) {
+			uint64_t length = value.size();
+
+			out.write(reinterpret_cast<const char*>(&length), sizeof(length));
+			out.write(reinterpret_cast<const char*>(value.data()), length * sizeof(C));
+		}
+
+		static string_t deserialize(std::istream& in) {
+			uint64_t length = 0;
+			string_t value;
+
+			in.read(reinterpret_cast<char*>(&length), sizeof(length));
+			value.resize(length);
+			in.read(reinterpret_cast<char*>(value.data()), length * sizeof(C));
+
+			return value;
+		}
+
+		static size_t size(const string_t& value) {
+			return sizeof(string_t) + value.size() * sizeof(C);
+		}
+
+		static void gather(const string_t& value, IoVector& out) {
+			out.copy_value<uint64_t>(value.size());
+			out.append(value.data(), value.size() * sizeof(C));
+		}
+
+		static std::string name() {
+			return "string<" + token_type_name<C>() + ">";
+		}
+	};
+
+	/**
+	 * I vettori di tipi banalmente copiabili vengono scritti con un solo
+	 * segmento, gli altri elemento per elemento dopo la lunghezza.
+	 */
+	template <typename T, typename Allocator>
+	struct Serializer<std::vector<T, Allocator>,
+		std::enable_if_t<is_serializable<T>::value && !std::is_same<T, bool>::value>> {
+
+		using vector_t = std::vector<T, Allocator>;
+
+		static void serialize(const vector_t& value, std::ostream& out) {
+			uint64_t length = value.size();
+			out.write(reinterpret_cast<const char*>(&length), sizeof(length));
+
+			if constexpr (is_bitwise_serializable<T>::value) {
+				out.write(reinterpret_cast<const char*>(value.data()), length * sizeof(T));
+			} else {
+				for(const T& element : value) {
+					Serializer<T>::serialize(element, out);
+				}
+			}
+		}
+
+		static vector_t deserialize(std::istream& in) {
+			uint64_t length = 0;
+			vector_t value;
+
+			in.read(reinterpret_cast<char*>(&length), sizeof(length));
+
+			if constexpr (is_bitwise_serializable<T>::value) {
+				value.resize(length);
+				in.read(reinterpret_cast<char*>(value.data()), length * sizeof(T));
+			} else {
+				value.reserve(length);
+
+				for(uint64_t i = 0; i < length && in; i++) {
+					value.push_back(Serializer<T>::deserialize(in));
+				}
+			}
+
+			return value;
+		}
+
+		static size_t size(const vector_t& value) {
+			size_t total = sizeof(vector_t);
+
+			if constexpr (has_serialized_size<T>::value) {
+				for(const T& element : value) {
+					total += Serializer<T>::size(element);
+				}
+			} else {
+				total += value.size() * sizeof(T);
+			}
+
+			return total;
+		}
+
+		static void gather(const vector_t& value, IoVector& out) {
+			out.copy_value<uint64_t>(value.size());
+
+			if constexpr (is_bitwise_serializable<T>::value) {
+				out.append(value.data(), value.size() * sizeof(T));
+			} else {
+				for(const T& element : value) {
+					mdf::gather(element, out);
+				}
+			}
+		}
+
+		static std::string name() {
+			return "vector<" + token_type_name<T>() + ">";
+		}
+	};
+
+	template <typename T, size_t N>
+	struct Serializer<std::array<T, N>,
+		std::enable_if_t<!is_bitwise_serializable<std::array<T, N>>::value && is_serializable<T>::value>> {
+
+		static void serialize(const std::array<T, N>& value, std::ostream& out) {
+			for(const T& element : value) {
+				Serializer<T>::serialize(element, out);
+			}
+		}
+
+		static std::array<T, N> deserialize(std::istream& in) {
+			return deserialize(in, std::make_index_sequence<N>());
+		}
+
+		static size_t size(const std::array<T, N>& value) {
+			size_t total = 0;
+
+			for(const T& element : value) {
+				total += serialized_size(element);
+			}
+
+			return total;
+		}
+
+		static void gather(const std::array<T, N>& value, IoVector& out) {
+			for(const T& element : value) {
+				mdf::gather(element, out);
+			}
+		}
+
+		static std::string name() {
+			return "array<" + token_type_name<T>() + "," + std::to_string(N) + ">";
+		}
+
+	private:
+
+		template <size_t ... I>
+		static std::array<T, N> deserialize(std::istream& in, std::index_sequence<I...>) {
+			// l'inizializzazione con le graffe valuta gli elementi in ordine
+			return std::array<T, N>{((void) I, Serializer<T>::deserialize(in))...};
+		}
+	};
+
+	template <typename ... Ts>
+	struct Serializer<std::tuple<Ts...>,
+		std::enable_if_t<!is_bitwise_serializable<std::tuple<Ts...>>::value && (is_serializable<Ts>::value && ...)>> {
+
+		static void serialize(const std::tuple<Ts...>& value, std::ostream& out) {
+			std::apply([&out](const Ts& ... elements) {
+				(Serializer<Ts>::serialize(elements, out), ...);
+			}, value);
+		}
+
+		static std::tuple<Ts...> deserialize(std::istream& in) {
+			return std::tuple<Ts...>{Serializer<Ts>::deserialize(in)...};
+		}
+
+		static size_t size(const std::tuple<Ts...>& value) {
+			return std::apply([](const Ts& ... elements) {
+				return (size_t{0} + ... + serialized_size(elements));
+			}, value);
+		}
+
+		static void gather(const std::tuple<Ts...>& value, IoVector& out) {
+			std::apply([&out](const Ts& ... elements) {
+				(mdf::gather(elements, out), ...);
+			}, value);
+		}
+
+		static std::string name() {
+			std::string name = "tuple<";
+			((name += token_type_name<Ts>() + ","), ...);
+			name.back() = '>';
+
+			return name;
+		}
+	};
+
+	template <typename A, typename B>
+	struct Serializer<std::pair<A, B>,
+		std::enable_if_t<!is_bitwise_serializable<std::pair<A, B>>::value &&
+			is_serializable<A>::value && is_serializable<B>::value>> {
+
+		static void serialize(const std::pair<A, B>& value, std::ostream& out) {
+			Serializer<A>::serialize(value.first, out);
+			Serializer<B>::serialize(value.second, out);
+		}
+
+		static std::pair<A, B> deserialize(std::istream& in) {
+			A first = Serializer<A>::deserialize(in);
+			return std::pair<A, B>(std::move(first), Serializer<B>::deserialize(in));
+		}
+
+		static size_t size(const std::pair<A, B>& value) {
+			return serialized_size(value.first) + serialized_size(value.second);
+		}
+
+		static void gather(const std::pair<A, B>& value, IoVector& out) {
+			mdf::gather(value.first, out);
+			mdf::gather(value.second, out);
+		}
+
+		static std::string name() {
+			return "pair<" + token_type_name<A>() + "," + token_type_name<B>() + ">";
+		}
+	};
+
+	/**
+	 * @struct TokenCodec
+	 * @brief Operazioni di serializzazione di un TokenSlot a tipo cancellato
+	 */
+	struct TokenCodec {
+
+		/**
+		 * @brief Ritorna la memoria occupata dal valore del token
+		 */
+		size_t (*_size)(Token* token);
+
+		/**
+		 * @brief Scrive il valore del token sullo stream
+		 */
+		void (*_write)(Token* token, std::ostream& out);
+
+		/**
+		 * @brief Legge un valore dallo stream e lo ripristina nel token
+		 */
+		void (*_read)(Token* token, std::istream& in);
+
+		/**
+		 * @brief Distrugge il valore del token, vedi TokenSlot::drop()
+		 */
+		void (*_drop)(Token* token);
+
+		/**
+		 * @brief Vero se il token possiede il proprio valore, che può quindi
+		 * 			essere scaricato
+		 */
+		bool (*_owned)(Token* token);
+
+		/**
+		 * @brief Legge un valore dallo stream e crea un nuovo token che lo
+		 * 			contiene, allocato dalla risorsa corrente
+		 */
+		std::shared_ptr<Token> (*_make)(std::istream& in);
+
+		/**
+		 * @brief Aggiunge i byte serializzati del token all'IoVector,
+		 * 			riferendo dove possibile la memoria del valore
+		 */
+		void (*_gather)(Token* token, IoVector& out);
+
+		/**
+		 * @brief L'id del tipo nel TokenTypeRegistry
+		 */
+		uint64_t _type;
+
+	};
+
+	/**
+	 * @class TokenTypeRegistry
+	 * @brief I codec dei tipi serializzabili, indicizzati per id del tipo,
+	 * 			vedi token_type_id. Un tipo viene registrato all'avvio del
+	 * 			programma se il suo codec è usato, ad esempio perché è un
+	 * 			parametro di una funzione del grafo.
+	 */
+	class TokenTypeRegistry {
+	public:
+
+		static TokenTypeRegistry& instance() {
+			static TokenTypeRegistry registry;
+			return registry;
+		}
+
+		/**
+		 * @brief Registra il codec. Se l'id è già registrato con lo stesso
+		 * 			nome, ad esempio per long e long long che hanno entrambi
+		 * 			il nome i64, resta il primo codec: i tipi con lo stesso
+		 * 			nome devono avere la stessa forma serializzata.
+		 *
+		 * @throw std::logic_error se l'id è già registrato con un altro
+		 * 			nome; avviene all'avvio, e va risolto cambiando il nome
+		 * 			di uno dei due tipi con Serializer::name
+		 */
+		bool add(uint64_t type, const std::string& name, const TokenCodec* codec);
+
+		/**
+		 * @brief Ritorna il codec del tipo, o nullptr se non è registrato
+		 */
+		const TokenCodec* find(uint64_t type) const;
+
+	private:
+
+		TokenTypeRegistry() = default;
+
+		struct Entry {
+			std::string 		_name;
+			const TokenCodec* 	_codec;
+		};
+
+		mutable std::mutex _mutex;
+
+		std::unordered_map<uint64_t, Entry> _codecs;
+
+	};
+
+	inline bool TokenTypeRegistry::add(uint64_t type, const std::string& name, const TokenCodec* codec) {
+		std::lock_guard<std::mutex> lock(_mutex);
+		auto result = _codecs.emplace(type, Entry{name, codec});
+
+		if (!result.second && result.first -> second._name != name)
+			throw std::logic_error("I tipi " + result.first -> second._name + " e " + name + " hanno lo stesso id");
+
+		return result.second;
+	}
+
+	inline const TokenCodec* TokenTypeRegistry::find(uint64_t type) const {
+		std::lock_guard<std::mutex> lock(_mutex);
+		auto it = _codecs.find(type);
+
+		return it == _codecs.end() ? nullptr : it -> second._codec;
+	}
+
+	template <typename T>
+	struct TokenCodecImp {
+
+		static size_t size(Token* token) {
+			if constexpr (has_serialized_size<T>::value)
+				return Serializer<T>::size(TokenSlot<T>::from_token(token));
+			else
+				return sizeof(T);
+		}
+
+		static void write(Token* token, std::ostream& out) {
+			Serializer<T>::serialize(TokenSlot<T>::from_token(token), out);
+		}
+
+		static void read(Token* token, std::istream& in) {
+			static_cast<TokenSlot<T>*>(token) -> restore(Serializer<T>::deserialize(in));
+		}
+
+		static void drop(Token* token) {
+			static_cast<TokenSlot<T>*>(token) -> drop();
+		}
+
+		static bool owned(Token* token) {
+			TokenSlot<T>* slot = static_cast<TokenSlot<T>*>(token);
+			return slot -> is_resident() && !slot -> is_borrowed();
+		}
+
+		static std::shared_ptr<Token> make(std::istream& in) {
+			return make_token<T>(Serializer<T>::deserialize(in));
+		}
+
+		static void gather(Token* token, IoVector& out) {
+			mdf::gather(TokenSlot<T>::from_token(token), out);
+		}
+
+		static const bool registered;
+	};
+
+	/**
+	 * @brief Ritorna il codec dei token di tipo T, o nullptr se il tipo non
+	 * 			specializza Serializer
+	 */
+	template <typename T>
+	inline const TokenCodec* token_codec() {
+		if constexpr (is_serializable<T>::value) {
+			static const TokenCodec codec{
+				&TokenCodecImp<T>::size,
+				&TokenCodecImp<T>::write,
+				&TokenCodecImp<T>::read,
+				&TokenCodecImp<T>::drop,
+				&TokenCodecImp<T>::owned,
+				&TokenCodecImp<T>::make,
+				&TokenCodecImp<T>::gather,
+				token_type_id<T>()};
+
+			(void) TokenCodecImp<T>::registered;
+			return &codec;
+		} else {
+			return nullptr;
+		}
+	}
+
+	template <typename T>
+	const bool TokenCodecImp<T>::registered =
+		TokenTypeRegistry::instance().add(token_type_id<T>(), token_type_name<T>(), token_codec<T>());
+
+	/**
+	 * @brief Scrive l'id del tipo seguito dal valore del token, così che
+	 * 			read_token possa leggerlo senza conoscerne il tipo
+	 */
+	inline void write_token(const TokenCodec* codec, Token* token, std::ostream& out) {
+		out.write(reinterpret_cast<const char*>(&codec -> _type), sizeof(codec -> _type));
+		codec -> _write(token, out);
+	}
+
+	/**
+	 * @brief Legge l'id del tipo scritto da write_token e ritorna il codec
+	 * 			registrato, con cui leggere il valore che segue
+	 *
+	 * @throw std::runtime_error se lo stream è finito o il tipo non è
+	 * 			registrato
+	 */
+	inline const TokenCodec* read_token_codec(std::istream& in) {
+		uint64_t type = 0;
+		in.read(reinterpret_cast<char*>(&type), sizeof(type));
+
+		if (!in)
+			throw std::runtime_error("Token troncato");
+
+		const TokenCodec* codec = TokenTypeRegistry::instance().find(type);
+
+		if (codec == nullptr)
+			throw std::runtime_error("Tipo di token " + std::to_string(type) + " non registrato");
+
+		return codec;
+	}
+
+	/**
+	 * @brief Legge un token scritto da write_token
+	 *
+	 * @throw std::runtime_error se il tipo non è registrato
+	 */
+	inline std::shared_ptr<Token> read_token(std::istream& in) {
+		return read_token_codec(in) -> _make(in);
+	}
+
+}
+
+#endif /* SERIALIZATION_HPP */
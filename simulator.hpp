@@ -0,0 +1,450 @@
+#ifndef SIMULATOR_HPP
+#define SIMULATOR_HPP
+
+#include <vector>
+#include <deque>
+#include <queue>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+#include "mdf.hpp"
+
+namespace mdf {
+
+	/**
+	 * @brief Le politiche di scheduling simulate. FIFO è quella
+	 * 			dell'Executor: una coda condivisa di job, con i successori
+	 * 			dello stesso cluster eseguiti dallo stesso worker.
+	 */
+	enum schedule_policy {
+
+		/**
+		 * @brief Coda condivisa, in ordine di arrivo
+		 */
+		FIFO,
+
+		/**
+		 * @brief Coda condivisa, prima i nodi più lontani dalla fine del grafo
+		 */
+		CRITICAL_PATH,
+
+		/**
+		 * @brief Una coda per worker: il worker esegue per primi i job che ha
+		 * 			reso pronti e, quando la sua coda è vuota, ruba il job più
+		 * 			vecchio dalla coda di un altro worker
+		 */
+		WORK_STEALING,
+
+		/**
+		 * @brief Ogni nodo è assegnato a un worker prima dell'esecuzione,
+		 * 			senza bilanciamento a runtime
+		 */
+		STATIC
+	};
+
+	/**
+	 * @struct SimulationConfig
+	 * @brief Parametri di una simulazione
+	 */
+	struct SimulationConfig {
+
+		schedule_policy 			_policy = FIFO;
+
+		size_t 						_workers = 1;
+
+		/**
+		 * @brief Istanze del grafo eseguite
+		 */
+		size_t 						_instances = 1;
+
+		/**
+		 * @brief Tempo tra l'arrivo di due istanze, zero per avviarle insieme
+		 */
+		std::chrono::nanoseconds 	_interval{0};
+
+		/**
+		 * @brief Costo di ogni job preso da una coda; i successori dello
+		 * 			stesso cluster eseguiti direttamente non lo pagano
+		 */
+		std::chrono::nanoseconds 	_overhead{0};
+
+		/**
+		 * @brief Costo aggiuntivo di un job rubato da un altro worker
+		 */
+		std::chrono::nanoseconds 	_steal_overhead{0};
+
+		/**
+		 * @brief Seme della scelta dei worker derubati
+		 */
+		uint64_t 					_seed = 1;
+	};
+
+	/**
+	 * @struct SimulationResult
+	 * @brief Le previsioni di una simulazione, con i tempi in nanosecondi
+	 */
+	struct SimulationResult {
+
+		/**
+		 * @brief Tempo di completamento dell'ultima istanza
+		 */
+		double 				_makespan = 0;
+
+		/**
+		 * @brief Frazione del tempo dei worker spesa eseguendo nodi
+		 */
+		double 				_utilization = 0;
+
+		/**
+		 * @brief Tempo medio e massimo tra l'arrivo di un'istanza e il suo completamento
+		 */
+		double 				_mean_latency = 0;
+
+		double 				_max_latency = 0;
+
+		/**
+		 * @brief Tempo speso da ogni worker eseguendo nodi
+		 */
+		std::vector<double> _busy;
+
+		/**
+		 * @brief Tempo speso in overhead di scheduling, furti compresi
+		 */
+		double 				_overhead = 0;
+
+		uint64_t 			_jobs = 0;
+
+		/**
+		 * @brief Nodi eseguiti direttamente come successori dello stesso cluster
+		 */
+		uint64_t 			_inlined = 0;
+
+		uint64_t 			_steals = 0;
+
+	};
+
+	/**
+	 * @class Simulator
+	 * @brief Simulatore a eventi discreti dell'esecuzione di un grafo.
+	 * Prevede il makespan e l'utilizzo dei worker con diverse politiche di
+	 * scheduling a partire dal costo dei nodi, senza eseguirli. I costi
+	 * sono quelli di Mdf::analyze, dichiarati o misurati, oppure dati
+	 * esplicitamente.
+	 */
+	class Simulator {
+	public:
+
+		/**
+		 * @param graph il grafo, che viene validato
+		 */
+		Simulator(Mdf& graph);
+
+		/**
+		 * @param graph il grafo, che viene validato
+		 * @param costs il costo in nanosecondi di ogni nodo, per id
+		 * @throw std::invalid_argument se i costi non sono uno per nodo
+		 */
+		Simulator(Mdf& graph, std::vector<double> costs);
+
+		SimulationResult run(const SimulationConfig& config) const;
+
+		const std::vector<double>& costs() const {
+			return _costs;
+		}
+
+	private:
+
+		struct Task {
+			size_t 	_instance;
+			size_t 	_node;
+		};
+
+		Graph* 				_model;
+
+		std::vector<double> _costs;
+
+		/**
+		 * @brief Priorità dei nodi per CRITICAL_PATH, vedi GraphAnalysis::bottom_levels
+		 */
+		std::vector<double> _priority;
+
+		/**
+		 * @brief Il worker di ogni nodo per STATIC, modulo il numero dei worker
+		 */
+		std::vector<size_t> _assignment;
+
+		/**
+		 * @brief Numero dei predecessori di ogni nodo, con molteplicità
+		 */
+		std::vector<size_t> _predecessors;
+
+	};
+
+	inline Simulator::Simulator(Mdf& graph) :
+		Simulator(graph, std::vector<double>())
+	{}
+
+	inline Simulator::Simulator(Mdf& graph, std::vector<double> costs) :
+		_model{graph._graph},
+		_costs{std::move(costs)}
+	{
+		graph.validate();
+
+		size_t n = _model -> _nodes.size();
+
+		if (_costs.empty()) {
+			size_t unknown;
+			_costs = GraphAnalysis::node_costs(*_model, unknown);
+		}
+
+		if (_costs.size() != n)
+			throw std::invalid_argument("Il profilo deve contenere il costo di ogni nodo");
+
+		_priority = GraphAnalysis::bottom_levels(*_model, _costs);
+		_predecessors.assign(n, 0);
+		_assignment.assign(n, 0);
+
+		for(const auto& node : _model -> _nodes) {
+			for(const size_t& next : *node -> _successors) {
+				_predecessors[next]++;
+			}
+		}
+
+		// i nodi di uno stesso livello vengono distribuiti tra i worker in
+		// ordine di priorità, i nodi di uno stesso cluster restano insieme
+		std::vector<size_t> order = _model -> topological_order();
+		std::vector<size_t> level(n, 0);
+		std::vector<size_t> next_slot;
+
+		for(const size_t& id : order) {
+			for(const size_t& next : *_model -> _nodes[id] -> _successors) {
+				level[next] = std::max(level[next], level[id] + 1);
+			}
+		}
+
+		std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+			return level[a] != level[b] ? level[a] < level[b] : _priority[a] > _priority[b];
+		});
+
+		for(const size_t& id : order) {
+			size_t cluster = _model -> _nodes[id] -> _cluster;
+
+			if (cluster != id) {
+				_assignment[id] = _assignment[cluster];
+				continue;
+			}
+
+			if (level[id] >= next_slot.size())
+				next_slot.resize(level[id] + 1, 0);
+
+			_assignment[id] = next_slot[level[id]]++;
+		}
+	}
+
+	inline SimulationResult Simulator::run(const SimulationConfig& config) const {
+		// (tempo, ordine di creazione, worker che ha completato il task o
+		// ARRIVAL per l'arrivo di un'istanza, task)
+		using event_t = std::tuple<double, uint64_t, size_t, Task>;
+
+		if (config._workers == 0)
+			throw std::invalid_argument("Serve almeno un worker");
+
+		size_t workers 		= config._workers;
+		size_t instances 	= config._instances;
+		double overhead 	= (double) config._overhead.count();
+		double steal 		= (double) config._steal_overhead.count();
+		size_t n 			= _model -> _nodes.size();
+		const size_t ARRIVAL = workers;
+
+		SimulationResult result;
+		std::mt19937_64 random(config._seed);
+
+		// eventi in ordine di tempo e, a parità, di creazione
+		auto later = [](const event_t& a, const event_t& b) {
+			return std::tie(std::get<0>(a), std::get<1>(a)) > std::tie(std::get<0>(b), std::get<1>(b));
+		};
+
+		std::priority_queue<event_t, std::vector<event_t>, decltype(later)> events(later);
+		uint64_t sequence = 0;
+
+		auto compare = [this](const std::pair<uint64_t, Task>& a, const std::pair<uint64_t, Task>& b) {
+			double pa = _priority[a.second._node], pb = _priority[b.second._node];
+			return pa != pb ? pa < pb : a.first > b.first;
+		};
+
+		std::deque<Task> shared;
+		std::priority_queue<std::pair<uint64_t, Task>, std::vector<std::pair<uint64_t, Task>>, decltype(compare)> by_priority(compare);
+		std::vector<std::deque<Task>> local(workers);
+		std::vector<std::vector<Task>> inlined(workers);
+		std::vector<bool> idle(workers, true);
+
+		std::vector<std::vector<size_t>> missing(instances);
+		std::vector<size_t> remaining(instances, n);
+		std::vector<double> arrival(instances, 0);
+		size_t completed = 0;
+		double now = 0;
+
+		result._busy.assign(workers, 0);
+
+		auto enqueue = [&](const Task& task, size_t origin) {
+			switch (config._policy) {
+				case FIFO:
+					shared.push_back(task);
+					break;
+				case CRITICAL_PATH:
+					by_priority.push({sequence++, task});
+					break;
+				case WORK_STEALING:
+					local[origin < workers ? origin : task._instance % workers].push_back(task);
+					break;
+				case STATIC:
+					local[(_assignment[task._node] + task._instance) % workers].push_back(task);
+					break;
+			}
+		};
+
+		auto start = [&](size_t worker, const Task& task, double cost) {
+			idle[worker] = false;
+			result._busy[worker] += _costs[task._node];
+			result._overhead 	 += cost;
+
+			events.emplace(now + cost + _costs[task._node], sequence++, worker, task);
+		};
+
+		// assegna un job al worker libero, se ce n'è uno che può eseguire
+		auto dispatch = [&](size_t worker) {
+			if (!inlined[worker].empty()) {
+				Task task = inlined[worker].back();
+				inlined[worker].pop_back();
+
+				result._inlined++;
+				start(worker, task, 0);
+				return;
+			}
+
+			switch (config._policy) {
+				case FIFO:
+					if (!shared.empty()) {
+						start(worker, shared.front(), overhead);
+						shared.pop_front();
+						result._jobs++;
+					}
+					return;
+				case CRITICAL_PATH:
+					if (!by_priority.empty()) {
+						start(worker, by_priority.top().second, overhead);
+						by_priority.pop();
+						result._jobs++;
+					}
+					return;
+				case STATIC:
+					if (!local[worker].empty()) {
+						start(worker, local[worker].front(), overhead);
+						local[worker].pop_front();
+						result._jobs++;
+					}
+					return;
+				case WORK_STEALING:
+					break;
+			}
+
+			if (!local[worker].empty()) {
+				start(worker, local[worker].back(), overhead);
+				local[worker].pop_back();
+				result._jobs++;
+				return;
+			}
+
+			std::vector<size_t> victims;
+
+			for(size_t other = 0; other < workers; other++) {
+				if (!local[other].empty())
+					victims.push_back(other);
+			}
+
+			if (victims.empty())
+				return;
+
+			size_t victim = victims[random() % victims.size()];
+
+			start(worker, local[victim].front(), overhead + steal);
+			local[victim].pop_front();
+			result._jobs++;
+			result._steals++;
+		};
+
+		auto wake = [&]() {
+			for(size_t worker = 0; worker < workers; worker++) {
+				if (idle[worker])
+					dispatch(worker);
+			}
+		};
+
+		for(size_t i = 0; i < instances; i++) {
+			arrival[i] = (double) i * config._interval.count();
+			missing[i] = _predecessors;
+			events.emplace(arrival[i], sequence++, ARRIVAL, Task{i, 0});
+		}
+
+		while (!events.empty()) {
+			auto [time, order, worker, task] = events.top();
+			events.pop();
+			now = time;
+
+			if (worker == ARRIVAL) {
+				for(size_t id = 0; id < n; id++) {
+					if (_predecessors[id] == 0)
+						enqueue(Task{task._instance, id}, ARRIVAL);
+				}
+
+				wake();
+				continue;
+			}
+
+			Node& node = *_model -> _nodes[task._node];
+			idle[worker] = true;
+
+			for(const size_t& next : *node._successors) {
+				if (--missing[task._instance][next] > 0)
+					continue;
+
+				if (_model -> _nodes[next] -> _cluster == node._cluster)
+					inlined[worker].push_back(Task{task._instance, next});
+				else
+					enqueue(Task{task._instance, next}, worker);
+			}
+
+			if (--remaining[task._instance] == 0) {
+				double latency = now - arrival[task._instance];
+
+				result._mean_latency += latency;
+				result._max_latency   = std::max(result._max_latency, latency);
+				result._makespan 	  = std::max(result._makespan, now);
+				completed++;
+			}
+
+			dispatch(worker);
+			wake();
+		}
+
+		if (completed > 0)
+			result._mean_latency /= completed;
+
+		if (result._makespan > 0) {
+			double busy = 0;
+
+			for(const double& time : result._busy) {
+				busy += time;
+			}
+
+			result._utilization = busy / (workers * result._makespan);
+		}
+
+		return result;
+	}
+
+}
+
+#endif /* SIMULATOR_HPP */
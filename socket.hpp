@@ -0,0 +1,90 @@
+#ifndef SOCKET_HPP
+#define SOCKET_HPP
+
+#include <string>
+#include <utility>
+#include <stdexcept>
+#include <cerrno>
+#include <cstring>
+#include <cstdint>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+
+namespace mdf {
+
+	/**
+	 * @brief Apre un socket in ascolto sull'indirizzo dato; la porta 0
+	 * 			sceglie una porta libera
+	 *
+	 * @return il socket e la porta effettiva
+	 */
+	inline std::pair<int, uint16_t> tcp_listen(const std::string& host, uint16_t port) {
+		int fd = socket(AF_INET, SOCK_STREAM, 0);
+		int enable = 1;
+		sockaddr_in address{};
+
+		if (fd < 0)
+			throw std::runtime_error(std::string("Impossibile creare il socket: ") + std::strerror(errno));
+
+		setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+
+		address.sin_family = AF_INET;
+		address.sin_port   = htons(port);
+
+		if (inet_pton(AF_INET, host.c_str(), &address.sin_addr) != 1 ||
+			bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(fd, 64) != 0) {
+			int error = errno;
+
+			close(fd);
+			throw std::runtime_error("Impossibile ascoltare su " + host + ":" + std::to_string(port) + ": " + std::strerror(error));
+		}
+
+		socklen_t length = sizeof(address);
+		getsockname(fd, reinterpret_cast<sockaddr*>(&address), &length);
+
+		return {fd, ntohs(address.sin_port)};
+	}
+
+	/**
+	 * @brief Apre un socket Unix in ascolto sul percorso dato, rimuovendo
+	 * 			un eventuale socket rimasto da un processo precedente. Se
+	 * 			il percorso è un altro tipo di file il bind fallisce.
+	 */
+	inline int unix_listen(const std::string& path) {
+		int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		sockaddr_un address{};
+
+		if (fd < 0)
+			throw std::runtime_error(std::string("Impossibile creare il socket: ") + std::strerror(errno));
+
+		if (path.size() >= sizeof(address.sun_path)) {
+			close(fd);
+			throw std::invalid_argument("Percorso del socket troppo lungo: " + path);
+		}
+
+		address.sun_family = AF_UNIX;
+		std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+		// solo un socket: un file con lo stesso nome non va cancellato
+		struct stat status;
+
+		if (lstat(path.c_str(), &status) == 0 && S_ISSOCK(status.st_mode))
+			unlink(path.c_str());
+
+		if (bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(fd, 16) != 0) {
+			int error = errno;
+
+			close(fd);
+			throw std::runtime_error("Impossibile ascoltare su " + path + ": " + std::strerror(error));
+		}
+
+		return fd;
+	}
+
+}
+
+#endif /* SOCKET_HPP */
@@ -0,0 +1,461 @@
+#ifndef SPILL_HPP
+#define SPILL_HPP
+
+#include <string>
+#include <fstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <unordered_map>
+#include <deque>
+#include <vector>
+#include <cstdio>
+#include <unistd.h>
+#include "graph.hpp"
+
+namespace mdf {
+
+	/**
+	 * @struct SpillConfig
+	 * @brief Parametri dello scarico dei token su disco
+	 */
+	struct SpillConfig {
+
+		/**
+		 * @brief Directory dei file di scarico, deve esistere
+		 */
+		std::string _directory;
+
+		/**
+		 * @brief Memoria oltre la quale i token in attesa vengono scaricati
+		 */
+		size_t _memory_limit;
+
+		/**
+		 * @brief Dimensione minima di un token per essere scaricato
+		 */
+		size_t _min_size = 1 << 20;
+
+		/**
+		 * @brief Dimensione del buffer dei file di scarico
+		 */
+		size_t _buffer_size = 1 << 20;
+	};
+
+	/**
+	 * @struct SpillStats
+	 * @brief Contatori dello scarico dei token
+	 */
+	struct SpillStats {
+		uint64_t _spilled{0};
+		uint64_t _loaded{0};
+		uint64_t _prefetched{0};
+		uint64_t _bytes_written{0};
+		uint64_t _bytes_read{0};
+
+		/**
+		 * @brief Memoria occupata dai token in attesa ancora in memoria
+		 */
+		size_t 	 _resident{0};
+	};
+
+	/**
+	 * @class SpillManager
+	 * @brief Tiene traccia dei token serializzabili in attesa di un nodo
+	 * 			non ancora pronto e, quando la loro memoria supera il limite,
+	 * 			li scarica su disco a partire dai più vecchi.
+	 * I token scaricati vengono ricaricati in anticipo quando al loro nodo
+	 * manca un solo token, e comunque prima della sua esecuzione.
+	 * Scritture e letture avvengono su un thread dedicato.
+	 *
+	 * @note Vengono seguiti solo i token dei nodi standard, di cui è noto
+	 * 		il tipo degli input: i token in attesa in un nodo di merge
+	 * 		restano sempre in memoria.
+	 */
+	class SpillManager {
+	public:
+
+		SpillManager(const SpillConfig& config);
+
+		SpillManager(const SpillManager &) = delete;
+
+		~SpillManager();
+
+		/**
+		 * @brief Registra il token appena consegnato al nodo, se è un
+		 * 			candidato allo scarico. Va chiamato prima che il
+		 * 			contatore dei token del nodo venga decrementato.
+		 *
+		 * @param node il nodo destinatario
+		 * @param slot l'indice del token di input
+		 */
+		void track(Node& node, size_t slot);
+
+		/**
+		 * @brief Avvia il caricamento dei token scaricati del nodo
+		 */
+		void prefetch(Node& node);
+
+		/**
+		 * @brief Attende che tutti i token del nodo siano in memoria e
+		 * 			smette di seguirli. Va chiamato prima di eseguire il nodo.
+		 *
+		 * @throws std::runtime_error se un token scaricato non può essere
+		 * 			riletto dal disco
+		 */
+		void acquire(Node& node);
+
+		SpillStats stats();
+
+	private:
+
+		enum spill_state {
+			RESIDENT,
+			SPILLING,
+			SPILLED,
+			LOADING,
+			FAILED
+		};
+
+		struct Record {
+			Node*				_node;
+			size_t				_slot;
+			const TokenCodec*	_codec;
+			size_t				_size;
+			spill_state			_state;
+			bool				_claimed;
+			bool				_prefetched;
+		};
+
+		struct Operation {
+			uint64_t	_id;
+			bool		_load;
+		};
+
+		void evict_over_limit();
+
+		void spill(uint64_t id);
+
+		void load(uint64_t id);
+
+		std::string path(uint64_t id) const;
+
+		void io_loop();
+
+		SpillConfig 	_config;
+
+		std::mutex		_mutex;
+
+		std::condition_variable _changed;
+
+		std::condition_variable _pending;
+
+		std::unordered_map<uint64_t, Record> 				_records;
+
+		std::unordered_map<Node*, std::vector<uint64_t>> 	_by_node;
+
+		/**
+		 * @brief Id dei token in ordine di arrivo, per scaricare i più vecchi
+		 */
+		std::deque<uint64_t>	_age;
+
+		std::deque<Operation>	_operations;
+
+		uint64_t		_next_id;
+
+		/**
+		 * @brief Memoria dei token il cui scarico è in coda o in corso
+		 */
+		size_t			_queued;
+
+		SpillStats		_stats;
+
+		bool			_stop;
+
+		std::thread		_io;
+
+	};
+
+	inline SpillManager::SpillManager(const SpillConfig& config) :
+		_config{config},
+		_next_id{0},
+		_queued{0},
+		_stop{false}
+	{
+		_io = std::thread([this] { io_loop(); });
+	}
+
+	inline SpillManager::~SpillManager() {
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_stop = true;
+		}
+
+		_pending.notify_all();
+		_io.join();
+
+		for(auto& record : _records) {
+			if (record.second._state == SPILLED)
+				std::remove(path(record.first).c_str());
+		}
+	}
+
+	inline std::string SpillManager::path(uint64_t id) const {
+		return _config._directory + "/mdf-" + std::to_string(getpid()) + "-" +
+			std::to_string(reinterpret_cast<uintptr_t>(this)) + "-" + std::to_string(id) + ".spill";
+	}
+
+	inline void SpillManager::track(Node& node, size_t slot) {
+		const TokenCodec* codec = node._function -> input_codec(slot);
+
+		if (codec == nullptr)
+			return;
+
+		Token* token = node._input_tokens[slot].get();
+
+		if (!codec -> _owned(token))
+			return;
+
+		size_t size = codec -> _size(token);
+
+		if (size < _config._min_size)
+			return;
+
+		std::lock_guard<std::mutex> lock(_mutex);
+		uint64_t id = _next_id++;
+
+		_records.emplace(id, Record{&node, slot, codec, size, RESIDENT, false, false});
+		_by_node[&node].push_back(id);
+		_age.push_back(id);
+		_stats._resident += size;
+
+		evict_over_limit();
+	}
+
+	/**
+	 * @brief Accoda lo scarico dei token più vecchi finché la memoria dei
+	 * 			token in attesa non rientra nel limite. Richiede il lock.
+	 */
+	inline void SpillManager::evict_over_limit() {
+		bool queued = false;
+
+		while (_stats._resident - _queued > _config._memory_limit && !_age.empty()) {
+			uint64_t id = _age.front();
+			_age.pop_front();
+
+			auto it = _records.find(id);
+
+			if (it == _records.end())
+				continue;
+
+			Record& record = it -> second;
+
+			// un token condiviso con altri nodi non può essere scaricato
+			if (record._state != RESIDENT || record._claimed || record._prefetched ||
+				record._node -> _input_tokens[record._slot].use_count() != 1)
+				continue;
+
+			record._state = SPILLING;
+			_queued += record._size;
+
+			_operations.push_back(Operation{id, false});
+			queued = true;
+		}
+
+		if (queued)
+			_pending.notify_one();
+	}
+
+	inline void SpillManager::prefetch(Node& node) {
+		std::lock_guard<std::mutex> lock(_mutex);
+		auto it = _by_node.find(&node);
+		bool queued = false;
+
+		if (it == _by_node.end())
+			return;
+
+		for(const uint64_t& id : it -> second) {
+			Record& record = _records.at(id);
+			record._prefetched = true;
+
+			if (record._state == SPILLED && !record._claimed) {
+				record._state = LOADING;
+				_operations.push_back(Operation{id, true});
+				_stats._prefetched++;
+				queued = true;
+			}
+		}
+
+		if (queued)
+			_pending.notify_one();
+	}
+
+	inline void SpillManager::acquire(Node& node) {
+		std::unique_lock<std::mutex> lock(_mutex);
+		auto it = _by_node.find(&node);
+
+		if (it == _by_node.end())
+			return;
+
+		std::vector<uint64_t> ids = std::move(it -> second);
+		std::string failed;
+		_by_node.erase(it);
+
+		for(const uint64_t& id : ids) {
+			_records.at(id)._claimed = true;
+		}
+
+		for(const uint64_t& id : ids) {
+			Record& record = _records.at(id);
+
+			_changed.wait(lock, [&record] { 
+				return record._state == RESIDENT || record._state == SPILLED || record._state == FAILED;
+			});
+
+			if (record._state == SPILLED) {
+				record._state = LOADING;
+
+				lock.unlock();
+				load(id);
+				lock.lock();
+			}
+
+			if (record._state == FAILED)
+				failed = path(id);
+			else
+				_stats._resident -= record._size;
+				
+			_records.erase(id);
+		}
+		
+		if (!failed.empty())
+			throw std::runtime_error("Impossibile leggere il token scaricato " + failed);
+	}
+
+	/**
+	 * @brief Scrive su disco l'id del tipo e il token, e ne distrugge il
+	 * 			valore
+	 */
+	inline void SpillManager::spill(uint64_t id) {
+		Record* record;
+
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			record = &_records.at(id);
+		}
+
+		Token* token = record -> _node -> _input_tokens[record -> _slot].get();
+		std::vector<char> buffer(_config._buffer_size);
+		std::ofstream out;
+
+		out.rdbuf() -> pubsetbuf(buffer.data(), buffer.size());
+		out.open(path(id), std::ios::binary | std::ios::trunc);
+
+		if (out) {
+			write_token(record -> _codec, token, out);
+			out.close();
+		}
+
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		_queued -= record -> _size;
+
+		if (!out) {
+			// disco non disponibile: il token resta in memoria
+			record -> _state = RESIDENT;
+			std::remove(path(id).c_str());
+		} else {
+			record -> _codec -> _drop(token);
+			record -> _state = SPILLED;
+
+			_stats._resident 		-= record -> _size;
+			_stats._bytes_written 	+= record -> _size;
+			_stats._spilled++;
+		}
+
+		_changed.notify_all();
+	}
+
+	/**
+	 * @brief Legge il token dal disco e lo ripristina. Lo stato del record
+	 * 			deve essere LOADING; se la lettura fallisce o l'id del tipo
+	 * 			non corrisponde diventa FAILED e l'errore viene riportato
+	 * 			dal worker in acquire().
+	 */
+	inline void SpillManager::load(uint64_t id) {
+		Record* record;
+
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			record = &_records.at(id);
+		}
+
+		Token* token = record -> _node -> _input_tokens[record -> _slot].get();
+		std::vector<char> buffer(_config._buffer_size);
+		std::ifstream in;
+
+		in.rdbuf() -> pubsetbuf(buffer.data(), buffer.size());
+		in.open(path(id), std::ios::binary);
+
+		bool loaded = false;
+
+		if (in) {
+			try {
+				if (read_token_codec(in) -> _type == record -> _codec -> _type) {
+					record -> _codec -> _read(token, in);
+					loaded = !in.fail();
+				}
+			} catch (...) {
+				loaded = false;
+			}
+
+			in.close();
+		}
+
+		std::remove(path(id).c_str());
+
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		if (!loaded) {
+			record -> _state = FAILED;
+		} else {
+			record -> _state = RESIDENT;
+
+			_stats._resident 	+= record -> _size;
+			_stats._bytes_read 	+= record -> _size;
+			_stats._loaded++;
+		}
+
+		_changed.notify_all();
+	}
+
+	inline void SpillManager::io_loop() {
+		for(;;) {
+			Operation operation;
+
+			{
+				std::unique_lock<std::mutex> lock(_mutex);
+				_pending.wait(lock, [this] { return _stop || !_operations.empty(); });
+
+				if (_stop)
+					return;
+
+				operation = _operations.front();
+				_operations.pop_front();
+			}
+
+			if (operation._load)
+				load(operation._id);
+			else
+				spill(operation._id);
+		}
+	}
+
+	inline SpillStats SpillManager::stats() {
+		std::lock_guard<std::mutex> lock(_mutex);
+		return _stats;
+	}
+
+}
+
+#endif /* SPILL_HPP */
@@ -1,35 +1,104 @@
 #ifndef TOKEN_HPP
 #define TOKEN_HPP
 
+#include <utility>
+#include <new>
 
 	struct Token {
-		
+
 	};
 
+	/**
+	 * @struct TokenSlot
+	 * @brief Token che contiene un valore di tipo T oppure, se costruito
+	 * 			con Borrow, un riferimento ad un oggetto del chiamante.
+	 */
 	template <typename T>
 	struct TokenSlot : public Token {
 	public:
-	
-		TokenSlot() = default;
-		
+
+		/**
+		 * @brief Tag per costruire un TokenSlot che non possiede il dato
+		 */
+		struct Borrow {};
+
+		TokenSlot() :
+			_data{},
+			_ptr{&_data}
+		{}
+
 		TokenSlot(const TokenSlot& other) = delete;
-		
-		TokenSlot(T& data) : 
-			_data{data} 
+
+		TokenSlot(const T& data) :
+			_data{data},
+			_ptr{&_data}
+		{}
+
+		TokenSlot(T&& data) :
+			_data{std::move(data)},
+			_ptr{&_data}
+		{}
+
+		/**
+		 * @brief Costruisce un TokenSlot che si riferisce a data senza
+		 * 			copiarlo. data deve sopravvivere al TokenSlot.
+		 */
+		TokenSlot(Borrow, T& data) :
+			_ptr{&data}
 		{}
-		
+
+		~TokenSlot() {
+			if (_ptr == &_data)
+				_data.~T();
+		}
+
 		T& get_data() {
-			return _data;
+			return *_ptr;
 		};
-		
+
+		bool is_borrowed() const {
+			return _ptr != nullptr && _ptr != &_data;
+		}
+
+		/**
+		 * @brief Vero se il valore è in memoria, falso se è stato scaricato
+		 */
+		bool is_resident() const {
+			return _ptr != nullptr;
+		}
+
+		/**
+		 * @brief Distrugge il valore posseduto, ad esempio dopo averlo
+		 * 			scritto su disco. Il token non è utilizzabile finché il
+		 * 			valore non viene ripristinato con restore().
+		 */
+		void drop() {
+			if (_ptr == &_data)
+				_data.~T();
+
+			_ptr = nullptr;
+		}
+
+		/**
+		 * @brief Ripristina il valore di un token scaricato
+		 */
+		void restore(T&& data) {
+			new (&_data) T(std::move(data));
+			_ptr = &_data;
+		}
+
 		static T& from_token(Token* slot) {
 			return static_cast<TokenSlot<T>*>(slot) -> get_data();
 		}
-	
+
 	private:
-	
-		T _data;
-		
+
+		union {
+			T _data;
+		};
+
+		T* _ptr;
+
 	};
 
 #endif /* TOKEN_HPP */
@@ -0,0 +1,220 @@
+#ifndef WORKER_METRICS_HPP
+#define WORKER_METRICS_HPP
+
+#include <atomic>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <iomanip>
+#include <cstdint>
+
+namespace mdf {
+
+	/**
+	 * @brief I limiti superiori dei bucket dell'istogramma delle latenze
+	 * 			delle esecuzioni, in nanosecondi; l'ultimo bucket non ha limite
+	 */
+	static constexpr uint64_t LATENCY_BOUNDS_NS[] = {10000, 50000, 100000, 500000, 1000000, 5000000,
+		10000000, 50000000, 100000000, 500000000, 1000000000, 5000000000};
+
+	static constexpr size_t LATENCY_BUCKETS = sizeof(LATENCY_BOUNDS_NS) / sizeof(uint64_t) + 1;
+
+	/**
+	 * @struct WorkerCounters
+	 * @brief I contatori di un worker dell'Executor, su una propria linea
+	 * 			di cache. Vengono aggiornati solo con le metriche abilitate,
+	 * 			vedi Executor::set_metrics.
+	 */
+	struct alignas(64) WorkerCounters {
+
+		/**
+		 * @brief Tempo speso eseguendo job, compresi i nodi eseguiti inline
+		 */
+		std::atomic<uint64_t> _busy_ns{0};
+
+		/**
+		 * @brief Tempo speso fermo in attesa di job sulla coda vuota
+		 */
+		std::atomic<uint64_t> _parked_ns{0};
+
+		/**
+		 * @brief Job presi dalla coda
+		 */
+		std::atomic<uint64_t> _jobs{0};
+
+		/**
+		 * @brief Successori dello stesso cluster eseguiti senza passare
+		 * 			dalla coda
+		 */
+		std::atomic<uint64_t> _inlined{0};
+
+		/**
+		 * @brief Job messi in coda, a disposizione degli altri worker
+		 */
+		std::atomic<uint64_t> _donated{0};
+
+		/**
+		 * @brief Attesa del lock della coda per estrarre e per inserire
+		 */
+		std::atomic<uint64_t> _dequeue_wait_ns{0};
+
+		std::atomic<uint64_t> _enqueue_wait_ns{0};
+
+		/**
+		 * @brief Risvegli che hanno trovato la coda vuota, perché un altro
+		 * 			worker ha preso il job
+		 */
+		std::atomic<uint64_t> _empty_wakeups{0};
+
+		/**
+		 * @brief Esecuzioni avviate e completate dal thread
+		 */
+		std::atomic<uint64_t> _runs_started{0};
+
+		std::atomic<uint64_t> _runs_completed{0};
+
+		/**
+		 * @brief Istogramma delle latenze delle esecuzioni completate, 
+		 * 			vedi LATENCY_BOUNDS_NS, e loro somma
+		 */
+		std::atomic<uint64_t> _latency[LATENCY_BUCKETS] = {};
+
+		std::atomic<uint64_t> _latency_ns{0};
+
+		void add(std::atomic<uint64_t>& counter, uint64_t value) {
+			counter.fetch_add(value, std::memory_order_relaxed);
+		}
+
+		void reset() {
+			for(std::atomic<uint64_t>* counter : {&_busy_ns, &_parked_ns, &_jobs, &_inlined, &_donated,
+				&_dequeue_wait_ns, &_enqueue_wait_ns, &_empty_wakeups, &_runs_started, &_runs_completed, &_latency_ns}) {
+				counter -> store(0, std::memory_order_relaxed);
+			}
+
+			for(std::atomic<uint64_t>& bucket : _latency) {
+				bucket.store(0, std::memory_order_relaxed);
+			}
+		}
+
+		void record_latency(uint64_t ns) {
+			size_t bucket = 0;
+
+			while (bucket < LATENCY_BUCKETS - 1 && ns > LATENCY_BOUNDS_NS[bucket]) {
+				bucket++;
+			}
+
+			add(_runs_completed, 1);
+			add(_latency[bucket], 1);
+			add(_latency_ns, ns);
+		}
+	};
+
+	/**
+	 * @struct WorkerMetrics
+	 * @brief Le metriche di un worker, in nanosecondi. Il tempo idle è
+	 * 			quello né speso eseguendo job né fermo sulla coda vuota,
+	 * 			principalmente in attesa del lock della coda.
+	 */
+	struct WorkerMetrics {
+		uint64_t _busy_ns = 0;
+		uint64_t _idle_ns = 0;
+		uint64_t _parked_ns = 0;
+		uint64_t _jobs = 0;
+		uint64_t _inlined = 0;
+		uint64_t _donated = 0;
+		uint64_t _dequeue_wait_ns = 0;
+		uint64_t _enqueue_wait_ns = 0;
+		uint64_t _empty_wakeups = 0;
+	};
+
+	/**
+	 * @struct ExecutorMetrics
+	 * @brief Le metriche dei worker di un Executor dall'abilitazione, vedi
+	 * 			Executor::metrics. I contatori dei singoli thread vengono
+	 * 			sommati alla lettura, senza fermare i worker.
+	 * Worker poco occupati e spesso fermi indicano che il grafo non offre
+	 * abbastanza parallelismo; attese del lock alte e risvegli a vuoto
+	 * indicano contesa sulla coda, da ridurre con il clustering; worker
+	 * sempre occupati indicano che il limite è il costo dei nodi.
+	 */
+	struct ExecutorMetrics {
+
+		std::vector<WorkerMetrics> _workers;
+
+		/**
+		 * @brief Tempo trascorso dall'abilitazione delle metriche
+		 */
+		uint64_t _elapsed_ns = 0;
+
+		/**
+		 * @brief Il numero massimo di job in coda
+		 */
+		uint64_t _max_queue_depth = 0;
+
+		/**
+		 * @brief Job accodati da thread diversi dai worker, cioè le
+		 * 			esecuzioni avviate, e la loro attesa del lock della coda
+		 */
+		uint64_t _external_enqueues = 0;
+
+		uint64_t _external_enqueue_wait_ns = 0;
+
+		/**
+		 * @brief Il numero di job in coda alla lettura
+		 */
+		uint64_t _queue_depth = 0;
+
+		uint64_t _runs_started = 0;
+
+		uint64_t _runs_completed = 0;
+
+		/**
+		 * @brief Le esecuzioni completate per bucket di latenza, non
+		 * 			cumulative, e la somma delle latenze
+		 */
+		std::vector<uint64_t> _latency = std::vector<uint64_t>(LATENCY_BUCKETS, 0);
+
+		uint64_t _latency_ns = 0;
+
+		/**
+		 * @brief Ritorna la frazione del tempo dei worker spesa eseguendo job
+		 */
+		double utilization() const {
+			uint64_t busy = 0;
+
+			for(const WorkerMetrics& worker : _workers) {
+				busy += worker._busy_ns;
+			}
+
+			return _elapsed_ns > 0 && !_workers.empty() ? (double) busy / (_elapsed_ns * _workers.size()) : 0;
+		}
+
+		std::string to_string() const;
+
+	};
+
+	inline std::string ExecutorMetrics::to_string() const {
+		std::ostringstream out;
+
+		out << std::fixed << std::setprecision(2);
+		out << "tempo: " << _elapsed_ns / 1e6 << " ms, utilizzo: " << utilization() * 100 << "%";
+		out << ", coda massima: " << _max_queue_depth << "\n";
+		out << "worker\toccupato ms\tidle ms\tfermo ms\tjob\tinline\tdonati\tlock estr. ms\tlock ins. ms\trisvegli a vuoto\n";
+
+		for(size_t i = 0; i < _workers.size(); i++) {
+			const WorkerMetrics& worker = _workers[i];
+
+			out << i << "\t" << worker._busy_ns / 1e6 << "\t" << worker._idle_ns / 1e6 << "\t"
+				<< worker._parked_ns / 1e6 << "\t" << worker._jobs << "\t" << worker._inlined << "\t"
+				<< worker._donated << "\t" << worker._dequeue_wait_ns / 1e6 << "\t"
+				<< worker._enqueue_wait_ns / 1e6 << "\t" << worker._empty_wakeups << "\n";
+		}
+
+		out << "job esterni: " << _external_enqueues << ", attesa del lock: " << _external_enqueue_wait_ns / 1e6 << " ms\n";
+
+		return out.str();
+	}
+
+}
+
+#endif /* WORKER_METRICS_HPP */